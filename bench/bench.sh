@@ -0,0 +1,38 @@
+#!/bin/sh
+# Generate a large lemon program and report the phase and dump statistics
+#
+# USAGE: ./bench/bench.sh [statements]
+
+LEMON=${LEMON:-./build/lemon}
+STATEMENTS=${1:-1000000}
+INPUT=${TMPDIR:-/tmp}/lemon_bench_$STATEMENTS.lemon
+
+if [ ! -f "$INPUT" ]; then
+	awk -v n="$STATEMENTS" 'BEGIN {
+		print "var v0 = 1;"
+		for (i = 1; i < n; i++)
+			printf "var v%d = %d + v%d - 3;\n", i, i % 1000, i - 1
+	}' > "$INPUT"
+fi
+
+echo "== lex ($STATEMENTS statements)"
+$LEMON --stats --only-tokens "$INPUT" > /dev/null
+
+THREADS=$(nproc 2> /dev/null || echo 4)
+echo "== lex, $THREADS threads"
+$LEMON --stats --lex-threads "$THREADS" --only-tokens "$INPUT" > /dev/null
+
+# The dumps are written to /dev/null, so this is the formatting and buffering
+# cost alone
+for DUMP in tokens ast; do
+	for FORMAT in "" --jsonl; do
+		echo "== dump $DUMP ${FORMAT:-(text)}"
+		$LEMON --stats $FORMAT --only-$DUMP "$INPUT" 2>&1 > /dev/null |
+			grep "dump:"
+	done
+done
+
+# Lowering to ir analyzes every variable and literal first; the text ir dump
+# starts with the scope dump, so only the jsonl one is measured
+echo "== dump ir --jsonl"
+$LEMON --stats --jsonl --only-ir "$INPUT" 2>&1 > /dev/null | grep "dump:"
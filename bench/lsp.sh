@@ -0,0 +1,61 @@
+#!/bin/sh
+# Open a large document in the language server, edit it in many places and
+# report the time taken by every update
+#
+# USAGE: ./bench/lsp.sh [statements] [edits]
+
+LEMON=${LEMON:-./build/lemon}
+STATEMENTS=${1:-100000}
+EDITS=${2:-1000}
+
+LC_ALL=C awk -v n="$STATEMENTS" -v edits="$EDITS" '
+function send(body) {
+	printf "Content-Length: %d\r\n\r\n%s", length(body), body
+}
+function line(i) {
+	if (i == 0) return "var v0 = 1;\\n"
+	return sprintf("var v%d = %d + v%d - 3;\\n", i, i % 1000, i - 1)
+}
+BEGIN {
+	uri = "file:///bench.lemon"
+	send("{\"jsonrpc\":\"2.0\",\"id\":1,\"method\":\"initialize\",\"params\":{}}")
+
+	# The text is written out line by line; building it as one string
+	# takes longer than the whole benchmark
+	head = "{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didOpen\"," \
+		"\"params\":{\"textDocument\":{\"uri\":\"" uri "\",\"version\":1," \
+		"\"text\":\""
+	tail = "\"}}}"
+	len = length(head) + length(tail)
+	for (i = 0; i < n; i++) len += length(line(i))
+	printf "Content-Length: %d\r\n\r\n%s", len, head
+	for (i = 0; i < n; i++) printf "%s", line(i)
+	printf "%s", tail
+
+	# Alternately break and fix a statement spread over the document
+	for (i = 0; i < edits; i++) {
+		at = int(i / 2) * 7919 % n
+		if (i % 2 == 0) { end = 0; change = "x" } else { end = 1; change = "" }
+		send("{\"jsonrpc\":\"2.0\",\"method\":\"textDocument/didChange\"," \
+			"\"params\":{\"textDocument\":{\"uri\":\"" uri "\",\"version\":" \
+			(i + 2) "},\"contentChanges\":[{\"range\":{\"start\":{\"line\":" \
+			at ",\"character\":0},\"end\":{\"line\":" at ",\"character\":" \
+			end "}},\"text\":\"" change "\"}]}}")
+	}
+
+	send("{\"jsonrpc\":\"2.0\",\"id\":2,\"method\":\"shutdown\"}")
+	send("{\"jsonrpc\":\"2.0\",\"method\":\"exit\"}")
+}' | $LEMON --lsp --stats 2>&1 > /dev/null | awk '
+/didOpen/ { print "open:", $(NF - 1), "ms" }
+/didChange/ { t[++count] = $(NF - 1) }
+END {
+	if (count == 0) exit 1
+	# Sort the update times to report the median and the worst case
+	for (i = 2; i <= count; i++) {
+		v = t[i]
+		for (j = i - 1; j > 0 && t[j] > v; j--) t[j + 1] = t[j]
+		t[j + 1] = v
+	}
+	printf "%d edits: median %s ms, max %s ms\n", count,
+		t[int((count + 1) / 2)], t[count]
+}'
@@ -0,0 +1,72 @@
+#!/bin/sh
+# Compile long and deeply nested programs with a small C stack; every tree
+# walk uses explicit stacks, so the time should grow linearly with the input
+#
+# USAGE: ./bench/scale.sh [statements] [depth]
+
+LEMON=${LEMON:-./build/lemon}
+STATEMENTS=${1:-10000000}
+DEPTH=${2:-100000}
+DIR=${TMPDIR:-/tmp}
+
+# Recursion proportional to the input would overflow this
+ulimit -s 1024
+
+run() {
+	START=$(date +%s.%N)
+	$LEMON "$@" > /dev/null || echo "FAILED: $LEMON $*"
+	END=$(date +%s.%N)
+	echo "$START $END" | awk '{ printf "%.2f s\n", $2 - $1 }'
+}
+
+for N in $((STATEMENTS / 10)) $STATEMENTS; do
+	INPUT=$DIR/lemon_scale_$N.lemon
+	if [ ! -f "$INPUT" ]; then
+		awk -v n="$N" 'BEGIN {
+			print "var x = 0;"
+			for (i = 0; i < n; i++) print "x = x + 1;"
+			print "print x;"
+		}' > "$INPUT"
+	fi
+
+	echo "== $N statements (--stream)"
+	run --stream "$INPUT"
+done
+
+for SHAPE in block braced if while expr assign; do
+	INPUT=$DIR/lemon_scale_${SHAPE}_$DEPTH.lemon
+	if [ ! -f "$INPUT" ]; then
+		awk -v n="$DEPTH" -v shape="$SHAPE" 'BEGIN {
+			print "var x = 1;"
+			if (shape == "block") {
+				for (i = 0; i < n; i++) printf "{"
+				printf "print x;"
+				for (i = 0; i < n; i++) printf "}"
+			}
+			else if (shape == "braced") {
+				# Every level looks x up from the innermost scope
+				for (i = 0; i < n; i++) printf "while (x < 1) {"
+				printf "x = 0;"
+				for (i = 0; i < n; i++) printf "}"
+			}
+			else if (shape == "if") {
+				for (i = 0; i < n; i++) printf "if (x) "
+				printf "print x;"
+			}
+			else if (shape == "while") {
+				for (i = 0; i < n; i++) printf "while (x) "
+				printf "x = 0;"
+			}
+			else {
+				op = shape == "expr" ? " + " : " = "
+				printf "print x"
+				for (i = 1; i < n; i++) printf "%sx", op
+				printf ";"
+			}
+			print ""
+		}' > "$INPUT"
+	fi
+
+	echo "== $SHAPE nested $DEPTH deep"
+	run "$INPUT"
+done
@@ -5,8 +5,52 @@
 
 /**
  * Semantic analyze the ast
+ *
+ * Params:
+ * 	ast     program ast
+ * 	tokens  token stream the ast was parsed from
+ * 	memory  arena of the memory scopes (needed until the ir is generated)
+ * 	names   arena of the name scopes
  */
-void analyze(ast_t *ast);
+void analyze(ast_t *ast, tokens_t *tokens, arena_t *memory, arena_t *names);
+
+/**
+ * Start analyzing a program statement by statement (see analyze_toplevel)
+ *
+ * Params:
+ * 	memory  arena of the memory scopes (needed until the ir is generated)
+ * 	names   arena of the name scopes
+ *
+ * Returns:
+ * 	Global memory scope (see ir_begin)
+ */
+st_t *analyze_begin(arena_t *memory, arena_t *names);
+
+/**
+ * Semantic analyze a top-level statement, in program order
+ *
+ * Params:
+ * 	stmt    top-level statement
+ * 	tokens  token stream the statement was parsed from
+ */
+void analyze_toplevel(ast_t *stmt, tokens_t *tokens);
+
+/**
+ * Semantic analyze a top-level statement on its own, without the
+ * statements before it. Variables it does not declare itself are taken to
+ * be global ints; the identifiers using them are collected instead of
+ * reported
+ *
+ * Params:
+ * 	stmt        top-level statement
+ * 	tokens      token stream the statement was parsed from
+ * 	total_uses  set to the number of identifiers using global variables
+ *
+ * Returns:
+ * 	Identifiers using global variables, in source order (valid until the
+ * 	next call)
+ */
+ast_t **analyze_isolated(ast_t *stmt, tokens_t *tokens, int *total_uses);
 
 #endif // ANALYZER_H
 
@@ -0,0 +1,87 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdalign.h>
+#include <stddef.h>
+
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk_t {
+	struct arena_chunk_t *next;
+	size_t size;
+	size_t used;
+	alignas(max_align_t) char data[];
+};
+
+typedef struct arena_chunk_t arena_chunk_t;
+
+// Bump pointer allocator; everything allocated from an arena is released
+// together by arena_free
+struct arena_t {
+	arena_chunk_t *head;
+};
+
+typedef struct arena_t arena_t;
+
+// Point in an arena that allocations can be rolled back to
+struct arena_mark_t {
+	arena_chunk_t *chunk;
+	size_t used;
+};
+
+typedef struct arena_mark_t arena_mark_t;
+
+/**
+ * Allocate memory from the arena (aligned for any type)
+ *
+ * Params:
+ * 	arena  arena to allocate from
+ * 	size   number of bytes
+ *
+ * Returns:
+ * 	Memory that lives until the arena is freed
+ */
+void *arena_alloc(arena_t *arena, size_t size);
+
+/**
+ * Copy a string into the arena (packed, without alignment padding)
+ *
+ * Params:
+ * 	arena  arena to allocate from
+ * 	str    string to copy
+ * 	len    length of the string
+ *
+ * Returns:
+ * 	Null terminated copy that lives until the arena is freed
+ */
+char *arena_strndup(arena_t *arena, const char *str, size_t len);
+
+/**
+ * Get the current point of the arena, for arena_release
+ *
+ * Params:
+ * 	arena  arena to mark
+ *
+ * Returns:
+ * 	Mark of everything allocated so far
+ */
+arena_mark_t arena_mark(arena_t *arena);
+
+/**
+ * Release every allocation made after the mark was taken
+ *
+ * Params:
+ * 	arena  arena the mark was taken from
+ * 	mark   mark returned by arena_mark
+ */
+void arena_release(arena_t *arena, arena_mark_t mark);
+
+/**
+ * Release every allocation made from the arena
+ *
+ * Params:
+ * 	arena  arena that needs freeing
+ */
+void arena_free(arena_t *arena);
+
+#endif // ARENA_H
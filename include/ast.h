@@ -1,17 +1,17 @@
 #ifndef AST_H
 #define AST_H
 
+#include "arena.h"
 #include "pos.h"
 #include "token.h"
 #include "type.h"
 #include "st.h"
 
-#define AST_PRINT_DEPTH 1024
-
 enum {
 	AST_LITERAL,
 	AST_IDENTIFIER,
 	AST_BINARY,
+	AST_UNARY,
 	AST_EXPR_STMT,
 	AST_PRINT_STMT,
 	AST_BLOCK_STMT,
@@ -23,119 +23,132 @@ enum {
 	AST_PROG,
 };
 
+// Nodes are allocated with only the header and the member of the union of
+// their type (see ast_malloc), so a node is between 40 and 64 bytes. The
+// text, symbol and value of a node are not copied; they are looked up in
+// the token stream through the node's token index (see token_at)
 struct ast_t {
-	int type;
-	const char *filepath;
-	const char *src;
+	unsigned char type;
+
+	// Token type of the operator of AST_BINARY and AST_UNARY
+	unsigned char op;
+	unsigned char is_lhs;
+
+	// Index of the token of the node in its token stream: the literal,
+	// the identifier, the operator, the declared identifier of a var stmt,
+	// the ';' of an expr stmt and the first token of everything else
+	int token;
 	pos_t start;
 	pos_t end;
 
-	// Keep track of the datatype of any and scope
-	type_t *data_type;
-	st_t *memory_scope;
-	st_t *name_scope;
+	// Set by analyze for expressions and var stmts
 	int offset;
-	int is_lhs;
+	type_t *data_type;
 
 	struct ast_t *next;
 
-	struct {
-		token_t token;
-	} literal;
-
-	struct {
-		token_t token;
-	} identifier;
-
-	struct {
-		struct ast_t *left;
-		token_t op;
-		struct ast_t *right;
-	} binary;
-
-	struct {
-		struct ast_t *expr;
-		token_t semicolon;
-	} expr_stmt;
-
-	struct {
-		token_t var_keyword;
-		token_t identifier;
-		struct ast_t *expr;
-		token_t semicolon;
-	} var_stmt;
-
-	struct {
-		token_t print_keyword;
-		struct ast_t *expr;
-	} print_stmt;
-
-	struct {
-		struct ast_t *stmts;
-	} block_stmt;
-
-	struct {
-		token_t if_keyword;
-		struct ast_t *if_cond;
-		struct ast_t *if_block;
-		struct ast_t *else_block;
-	} if_stmt;
-
-	struct {
-		token_t while_keyword;
-		struct ast_t *while_cond;
-		struct ast_t *while_block;
-	} while_stmt;
-
-	struct {
-		token_t break_keyword;
-	} break_stmt;
-
-	struct {
-		token_t continue_keyword;
-	} continue_stmt;
-
-	struct {
-		struct ast_t *asts;
-	} prog;
+	union {
+		struct {
+			// Decoded value, so the ir can use it as an immediate
+			int64_t value;
+		} literal;
+
+		struct {
+			struct ast_t *left;
+			struct ast_t *right;
+		} binary;
+
+		struct {
+			struct ast_t *expr;
+		} unary;
+
+		struct {
+			struct ast_t *expr;
+		} expr_stmt;
+
+		struct {
+			struct ast_t *expr;
+
+			// Token of the declared type (-1 if the type is inferred)
+			int type;
+		} var_stmt;
+
+		struct {
+			struct ast_t *expr;
+		} print_stmt;
+
+		struct {
+			struct ast_t *stmts;
+		} block_stmt;
+
+		struct {
+			struct ast_t *if_cond;
+			struct ast_t *if_block;
+			struct ast_t *else_block;
+		} if_stmt;
+
+		struct {
+			struct ast_t *while_cond;
+			struct ast_t *while_block;
+		} while_stmt;
+
+		struct {
+			struct ast_t *asts;
+
+			// Global scopes, set by analyze
+			st_t *memory_scope;
+			st_t *name_scope;
+		} prog;
+	};
 };
 
 typedef struct ast_t ast_t;
 
 /**
- * Generate the ast based on the list of tokens
+ * Generate the ast based on the token stream
  *
  * Params:
- * 	tokens  List of tokens
+ * 	tokens  Token stream
+ * 	arena   arena the nodes are allocated from
  *
  * Returns:
- * 	Generated ast (Users responsibility to free memory)
+ * 	Generated ast (lives until the arena is freed)
  */
-ast_t *generate_ast(token_t *tokens);
+ast_t *generate_ast(tokens_t *tokens, arena_t *arena);
 
 /**
- * Free ast memory
+ * Parse the next top-level statement; used to compile a streamed token
+ * stream one statement at a time. Tokens of the statements returned by
+ * earlier calls are discarded from the stream
  *
  * Params:
- * 	ast  Ast that needs freeing
+ * 	tokens  Token stream
+ * 	arena   arena the nodes are allocated from
+ *
+ * Returns:
+ * 	Statement ast, NULL at eof (lives until the arena is released)
  */
-void free_ast(ast_t *ast);
+ast_t *generate_ast_stmt(tokens_t *tokens, arena_t *arena);
 
 /**
- * Print the ast
+ * Print the ast, depth first
  *
  * Params:
- * 	ast  Ast that needs printing
+ * 	ast     Ast that needs printing
+ * 	tokens  Token stream the ast was parsed from
+ * 	out     output buffer
+ * 	format  DUMP_TEXT (a tree) or DUMP_JSONL (one node per line)
  */
-void print_ast(ast_t *ast);
+void print_ast(ast_t *ast, tokens_t *tokens, buffer_t *out, int format);
 
 /**
  * Print the scope information
  *
  * Params:
- * 	ast  Ast that needs printing
+ * 	ast     Ast that needs printing
+ * 	tokens  Token stream the ast was parsed from
  */
-void print_ast_scope(ast_t *ast);
+void print_ast_scope(ast_t *ast, tokens_t *tokens);
 
 #endif // AST_H
 
@@ -0,0 +1,96 @@
+#ifndef BIGINT_H
+#define BIGINT_H
+
+#include "arena.h"
+
+#include <stdint.h>
+
+// Arbitrary precision integer; values are never modified once created
+struct bigint_t {
+	// 1 or -1 (1 for zero)
+	int sign;
+
+	// Limbs of the magnitude, least significant first; the last one is not
+	// 0, so zero has no limbs
+	int len;
+	uint32_t limbs[];
+};
+
+typedef struct bigint_t bigint_t;
+
+/**
+ * Create a bigint from an integer
+ *
+ * Params:
+ * 	arena  arena the bigint lives in
+ * 	value  value of the bigint
+ *
+ * Returns:
+ * 	the bigint
+ */
+bigint_t *bigint_from_int(arena_t *arena, int64_t value);
+
+/**
+ * Get the value of a bigint if it fits in an int64_t
+ *
+ * Params:
+ * 	a      the bigint
+ * 	value  (output) value of the bigint, set only if it fits
+ *
+ * Returns:
+ * 	1 if the value fits, 0 otherwise
+ */
+int bigint_to_int(bigint_t *a, int64_t *value);
+
+/**
+ * Get the low 64 bits of a bigint in two's complement
+ */
+int64_t bigint_wrap(bigint_t *a);
+
+/**
+ * Add two bigints
+ *
+ * Params:
+ * 	arena  arena the result lives in
+ * 	a      left operand
+ * 	b      right operand
+ *
+ * Returns:
+ * 	a + b
+ */
+bigint_t *bigint_add(arena_t *arena, bigint_t *a, bigint_t *b);
+
+/**
+ * Subtract two bigints
+ *
+ * Params:
+ * 	arena  arena the result lives in
+ * 	a      left operand
+ * 	b      right operand
+ *
+ * Returns:
+ * 	a - b
+ */
+bigint_t *bigint_sub(arena_t *arena, bigint_t *a, bigint_t *b);
+
+/**
+ * Compare two bigints
+ *
+ * Returns:
+ * 	-1, 0 or 1 if a is less than, equal to or greater than b
+ */
+int bigint_cmp(bigint_t *a, bigint_t *b);
+
+/**
+ * Convert a bigint to decimal. Large values are split by powers of 10^9
+ * and both halves converted on their own (divide and conquer)
+ *
+ * Params:
+ * 	a  the bigint
+ *
+ * Returns:
+ * 	Null terminated decimal string (User responsible for freeing)
+ */
+char *bigint_str(bigint_t *a);
+
+#endif // BIGINT_H
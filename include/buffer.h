@@ -0,0 +1,99 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Formats of the --only-* dumps
+enum {
+	DUMP_TEXT,
+	DUMP_JSONL,
+};
+
+// Size of the buffer of an output sink; it is written out whenever it fills
+#define BUFFER_SINK_SIZE (1 << 20)
+
+// Growable byte buffer, always null terminated. A buffer with a sink is
+// instead a fixed size output buffer that is written to the sink whenever
+// it fills, so arbitrarily large output needs a single allocation
+struct buffer_t {
+	char *data;
+	int len;
+	int cap;
+
+	FILE *sink;
+
+	// Bytes written to the sink so far
+	long total;
+};
+
+typedef struct buffer_t buffer_t;
+
+/**
+ * Create an output buffer that writes to a file
+ *
+ * Params:
+ * 	sink  file the buffer is written to
+ *
+ * Returns:
+ * 	Empty buffer (User responsible for calling free_buffer)
+ */
+buffer_t buffer_sink(FILE *sink);
+
+/**
+ * Write out the pending bytes of a buffer with a sink
+ *
+ * Params:
+ * 	buffer  buffer to flush
+ */
+void buffer_flush(buffer_t *buffer);
+
+/**
+ * Flush and free the buffer
+ *
+ * Params:
+ * 	buffer  buffer to free
+ */
+void free_buffer(buffer_t *buffer);
+
+/**
+ * Append bytes to the buffer
+ *
+ * Params:
+ * 	buffer  buffer to append to
+ * 	str     bytes to append
+ * 	len     number of bytes (-1 if str is null terminated)
+ */
+void buffer_append(buffer_t *buffer, const char *str, int len);
+
+/**
+ * Append a character repeated count times (nothing if count <= 0)
+ */
+void buffer_fill(buffer_t *buffer, char ch, int count);
+
+/**
+ * Append an integer in decimal
+ */
+void buffer_int(buffer_t *buffer, int64_t value);
+
+/**
+ * Append an integer as "0x" followed by at least digits hex digits
+ */
+void buffer_hex(buffer_t *buffer, uint64_t value, int digits);
+
+/**
+ * Append printf style formatted text
+ */
+void buffer_printf(buffer_t *buffer, const char *format, ...);
+
+/**
+ * Append bytes as a quoted json string
+ *
+ * Params:
+ * 	buffer  buffer to append to
+ * 	str     bytes of the string
+ * 	len     number of bytes
+ */
+void buffer_string(buffer_t *buffer, const char *str, int len);
+
+#endif // BUFFER_H
@@ -0,0 +1,104 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "ir.h"
+#include "util.h"
+
+#include <stdint.h>
+
+// A .lbc file is the header, the constant pool (int64_t each) and then the
+// code (ir_t each), in native byte order. Jumps are instruction indices and
+// constants pool indices, so the file is loaded as is
+#define BYTECODE_MAGIC "\x7fLBC"
+#define BYTECODE_VERSION 1
+
+struct bytecode_header_t {
+	char magic[4];
+	uint32_t version;
+
+	// Hash of the source, the options and the compiler it was compiled by
+	// (see bytecode_key)
+	uint64_t key;
+
+	int64_t global_size;
+	int32_t total_regs;
+	int32_t total_consts;
+	int32_t total_code;
+	int32_t reserved;
+};
+
+typedef struct bytecode_header_t bytecode_header_t;
+
+/**
+ * Check if a file starts like a bytecode file
+ *
+ * Params:
+ * 	file  the file
+ *
+ * Returns:
+ * 	1 if it does, 0 otherwise
+ */
+int is_bytecode(file_t file);
+
+/**
+ * Load a program from a bytecode file. The code and constants are used
+ * where they are mapped. Every register, constant, jump target and global
+ * slot of the code is checked to be in range (and the slots aligned), so
+ * a damaged file is rejected before it can access anything out of bounds.
+ * The slots can still be accessed with any width; the vm does not trust
+ * what a slot holds, and loads a word last written raw as an integer
+ *
+ * Params:
+ * 	file   the file (owned by the program if it is loaded)
+ * 	key    (output) key in the header, can be NULL
+ * 	error  (output) why the file was rejected
+ *
+ * Returns:
+ * 	the program (User responsible for freeing with free_ir), NULL if the
+ * 	file is not valid bytecode
+ */
+ir_prog_t *load_bytecode(file_t file, uint64_t *key, const char **error);
+
+/**
+ * Write a program as a bytecode file. The file is written next to path and
+ * renamed over it, so a reader never sees a partial file
+ *
+ * Params:
+ * 	ir    the program
+ * 	key   key of the program (see bytecode_key)
+ * 	path  path of the bytecode file
+ *
+ * Returns:
+ * 	0 on success, -1 on failure (with errno set)
+ */
+int write_bytecode(ir_prog_t *ir, uint64_t key, const char *path);
+
+/**
+ * Hash a source together with the options it is optimized with, the
+ * bytecode version and the build of the compiler, so a rebuilt compiler
+ * never loads what an older one compiled, nor a run what was optimized
+ * for other options
+ *
+ * Params:
+ * 	file          the source
+ * 	opt_level     optimization level it is compiled with
+ * 	keep_globals  whether the global memory at exit is kept (see optimize)
+ *
+ * Returns:
+ * 	the key
+ */
+uint64_t bytecode_key(file_t file, int opt_level, int keep_globals);
+
+/**
+ * Get the path of the cached bytecode of a key
+ *
+ * Params:
+ * 	dir  cache directory
+ * 	key  key of the source (see bytecode_key)
+ *
+ * Returns:
+ * 	Null terminated path (User responsible for freeing)
+ */
+char *bytecode_cache_path(const char *dir, uint64_t key);
+
+#endif // BYTECODE_H
@@ -0,0 +1,83 @@
+#ifndef CFG_H
+#define CFG_H
+
+#include "arena.h"
+#include "buffer.h"
+#include "ir.h"
+
+// Instructions [start, end) of the code, entered only at start and left
+// only after end - 1
+struct cfg_block_t {
+	int start;
+	int end;
+
+	// Blocks control can go to next; leaving the code is not a successor
+	int succs[2];
+	int total_succs;
+
+	int *preds;
+	int total_preds;
+
+	// Position in the reverse postorder, and the closest other block every
+	// path from the entry goes through (the entry is its own); both -1
+	// when unreachable
+	int order;
+	int idom;
+};
+
+typedef struct cfg_block_t cfg_block_t;
+
+struct cfg_t {
+	ir_prog_t *ir;
+
+	// Block 0 starts at the first instruction
+	cfg_block_t *blocks;
+	int total_blocks;
+
+	// Block of every instruction
+	int *block_of;
+
+	// Reachable blocks in reverse postorder
+	int *order;
+	int total_order;
+};
+
+typedef struct cfg_t cfg_t;
+
+/**
+ * Split the code of a program into basic blocks, and compute the order and
+ * dominators of the blocks
+ *
+ * Params:
+ * 	ir     the program
+ * 	arena  arena the graph is allocated from
+ *
+ * Returns:
+ * 	the graph (lives until the arena is freed)
+ */
+cfg_t *build_cfg(ir_prog_t *ir, arena_t *arena);
+
+/**
+ * Check if every path from the entry to a block goes through another one
+ *
+ * Params:
+ * 	cfg  the graph
+ * 	a    block that dominates
+ * 	b    block that is dominated
+ *
+ * Returns:
+ * 	1 if a dominates b (every block dominates itself), 0 otherwise
+ */
+int cfg_dominates(cfg_t *cfg, int a, int b);
+
+/**
+ * Print the blocks of the graph, with the registers live at their borders
+ * and the definitions reaching them
+ *
+ * Params:
+ * 	cfg  the graph
+ * 	out  output buffer
+ */
+void print_cfg(cfg_t *cfg, buffer_t *out);
+
+#endif // CFG_H
@@ -0,0 +1,136 @@
+#ifndef DATAFLOW_H
+#define DATAFLOW_H
+
+#include "arena.h"
+#include "cfg.h"
+
+#include <stdint.h>
+
+// A problem over sets of a fixed universe, one per block border. A block
+// maps the set flowing into it to gen | (set & ~kill); forward problems
+// flow from the end of the predecessors to the start of a block, backward
+// ones from the start of the successors to the end of a block
+struct dataflow_t {
+	cfg_t *cfg;
+	int forward;
+
+	// Sets meet by intersection if set, by union otherwise
+	int intersect;
+
+	// Every set is words 64 bit words, total_bits of them used
+	int total_bits;
+	int words;
+
+	// Sets of every block, block * words words each
+	uint64_t *gen;
+	uint64_t *kill;
+	uint64_t *in;
+	uint64_t *out;
+};
+
+typedef struct dataflow_t dataflow_t;
+
+// Registers live at block borders. Only registers read in a block before
+// it writes them can be; they get a bit each
+struct liveness_t {
+	dataflow_t *flow;
+
+	// Bit of every register (-1 if it is never live across blocks), and
+	// register of every bit
+	int *bit_of;
+	int32_t *regs;
+};
+
+typedef struct liveness_t liveness_t;
+
+// Definitions reaching block borders. Only the definitions of registers
+// that can be live across blocks get a bit
+struct reaching_t {
+	dataflow_t *flow;
+
+	// Bit of every instruction (-1 if it is not such a definition), and
+	// instruction of every bit
+	int *bit_of;
+	int *defs;
+};
+
+typedef struct reaching_t reaching_t;
+
+/**
+ * Create a problem with empty sets
+ *
+ * Params:
+ * 	cfg         the graph
+ * 	total_bits  size of the universe
+ * 	forward     1 for a forward problem, 0 for a backward one
+ * 	intersect   1 to meet by intersection, 0 by union
+ * 	arena       arena the sets are allocated from
+ *
+ * Returns:
+ * 	the problem (lives until the arena is freed)
+ */
+dataflow_t *dataflow_create(cfg_t *cfg, int total_bits, int forward,
+	int intersect, arena_t *arena);
+
+/**
+ * Solve a problem whose gen and kill sets are set, iterating over the
+ * reachable blocks in (reverse) postorder until no set changes
+ *
+ * Params:
+ * 	flow  the problem
+ */
+void dataflow_solve(dataflow_t *flow);
+
+/**
+ * Get a set of a block
+ *
+ * Params:
+ * 	flow   the problem
+ * 	sets   gen, kill, in or out of the problem
+ * 	block  the block
+ *
+ * Returns:
+ * 	the set
+ */
+uint64_t *dataflow_set(dataflow_t *flow, uint64_t *sets, int block);
+
+/**
+ * Check if a bit is in a set
+ */
+int dataflow_has(uint64_t *set, int bit);
+
+/**
+ * Add a bit to a set
+ */
+void dataflow_add(uint64_t *set, int bit);
+
+/**
+ * Remove a bit from a set
+ */
+void dataflow_remove(uint64_t *set, int bit);
+
+/**
+ * Compute the registers live at the start and end of every block
+ *
+ * Params:
+ * 	cfg    the graph
+ * 	arena  arena the result is allocated from
+ *
+ * Returns:
+ * 	the solved liveness (lives until the arena is freed)
+ */
+liveness_t *liveness(cfg_t *cfg, arena_t *arena);
+
+/**
+ * Compute the definitions reaching the start and end of every block
+ *
+ * Params:
+ * 	cfg    the graph
+ * 	arena  arena the result is allocated from
+ *
+ * Returns:
+ * 	the solved reaching definitions (lives until the arena is freed)
+ */
+reaching_t *reaching_defs(cfg_t *cfg, arena_t *arena);
+
+#endif // DATAFLOW_H
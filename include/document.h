@@ -0,0 +1,84 @@
+#ifndef DOCUMENT_H
+#define DOCUMENT_H
+
+#include "error.h"
+
+// Source file kept up to date with text edits. An edit re-lexes and
+// re-parses only the top-level statements it touches, and re-checks only
+// the statements that use or declare a global whose declarations changed
+typedef struct document_t document_t;
+
+/**
+ * Open a document and compute its diagnostics
+ *
+ * Params:
+ * 	filepath  name of the document (copied)
+ * 	text      source code of the document (copied)
+ * 	len       length of the source code
+ *
+ * Returns:
+ * 	Document (User responsible for calling document_close)
+ */
+document_t *document_open(const char *filepath, const char *text, int len);
+
+/**
+ * Replace a range of the text and update the diagnostics
+ *
+ * Params:
+ * 	doc    document to edit
+ * 	start  start offset of the replaced range (inclusive)
+ * 	end    end offset of the replaced range (exclusive)
+ * 	text   new text of the range
+ * 	len    length of the new text
+ */
+void document_edit(document_t *doc, int start, int end, const char *text,
+	int len);
+
+/**
+ * Resolve a line and column (both starting at 0) to an offset; columns
+ * past the end of the line are clamped to it
+ *
+ * Params:
+ * 	doc     document the position is in
+ * 	line    line of the position
+ * 	column  column of the position
+ *
+ * Returns:
+ * 	Offset into the text of the document
+ */
+int document_offset(document_t *doc, int line, int column);
+
+/**
+ * Resolve an offset to its line and column (both starting at 0)
+ *
+ * Params:
+ * 	doc     document the offset is in
+ * 	offset  offset into the text of the document
+ * 	line    (output) line of the offset
+ * 	column  (output) column of the offset
+ */
+void document_position(document_t *doc, int offset, int *line, int *column);
+
+/**
+ * Get the diagnostics of the document, in no particular order
+ *
+ * Params:
+ * 	doc          document to get the diagnostics of
+ * 	diagnostics  (output) the diagnostics (valid until the next edit)
+ *
+ * Returns:
+ * 	Number of diagnostics
+ */
+int document_diagnostics(document_t *doc, diagnostic_t **diagnostics);
+
+/**
+ * Returns: number of statements parsed again by the last edit
+ */
+int document_reparsed(document_t *doc);
+
+/**
+ * Free the document
+ */
+void document_close(document_t *doc);
+
+#endif // DOCUMENT_H
@@ -3,8 +3,17 @@
 
 #include "pos.h"
 
+#include <setjmp.h>
+
 #define ERROR_TAB_INDENT_SIZE 8
 
+// Error kept by error_print while a recovery point is set
+typedef struct {
+	pos_t start;
+	pos_t end;
+	const char *message;
+} diagnostic_t;
+
 /**
  * Print error
  *
@@ -18,5 +27,25 @@
 void error_print(const char *filepath, const char *src, pos_t start, pos_t end,
 	const char *message);
 
+/**
+ * Stop compiling after an error was printed. Exits the program, unless
+ * a recovery point is set; then it jumps back to it. Never returns
+ */
+_Noreturn void error_exit();
+
+/**
+ * Set the recovery point of error_exit. While it is set, error_print
+ * keeps the error for error_last instead of printing it
+ *
+ * Params:
+ * 	env  buffer filled in by setjmp, or NULL to exit on errors again
+ */
+void error_recover(jmp_buf *env);
+
+/**
+ * Returns: the last error kept while a recovery point was set
+ */
+diagnostic_t error_last();
+
 #endif // ERROR_H
 
@@ -0,0 +1,102 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stdint.h>
+
+// Symbol ids are dense indices starting at 0; SYM_NONE marks tokens that
+// do not carry a symbol (punctuation, keywords, eof)
+#define SYM_NONE (-1)
+
+/**
+ * Intern a string, so equal strings get the same symbol id
+ *
+ * Params:
+ * 	str  string to intern (need not be null terminated)
+ * 	len  length of the string
+ *
+ * Returns:
+ * 	symbol id of the string
+ */
+int intern(const char *str, int len);
+
+/**
+ * Intern a string whose hash was already computed with intern_hash
+ *
+ * Params:
+ * 	str   string to intern (need not be null terminated)
+ * 	len   length of the string
+ * 	hash  intern_hash(str, len)
+ *
+ * Returns:
+ * 	symbol id of the string
+ */
+int intern_hashed(const char *str, int len, uint32_t hash);
+
+/**
+ * Hash a string the way the intern pool does; safe to call from any thread
+ *
+ * Params:
+ * 	str  string to hash
+ * 	len  length of the string
+ *
+ * Returns:
+ * 	hash of the string
+ */
+uint32_t intern_hash(const char *str, int len);
+
+/**
+ * Get the string of an interned symbol
+ *
+ * Params:
+ * 	sym  symbol id
+ *
+ * Returns:
+ * 	Null terminated string (owned by the intern pool)
+ */
+const char *intern_str(int sym);
+
+/**
+ * Get the length of an interned symbol
+ *
+ * Params:
+ * 	sym  symbol id
+ *
+ * Returns:
+ * 	length of the string
+ */
+int intern_len(int sym);
+
+/**
+ * Attach a value to a symbol (the decoded value of integer literals)
+ *
+ * Params:
+ * 	sym    symbol id
+ * 	value  value of the symbol
+ */
+void intern_set_value(int sym, int64_t value);
+
+/**
+ * Get the value attached to a symbol
+ *
+ * Params:
+ * 	sym  symbol id
+ *
+ * Returns:
+ * 	value of the symbol (0 if never set)
+ */
+int64_t intern_value(int sym);
+
+/**
+ * Get the total number of interned symbols
+ *
+ * Returns:
+ * 	number of symbols
+ */
+int intern_count();
+
+/**
+ * Release the pool; every symbol handed out so far becomes invalid
+ */
+void free_intern();
+
+#endif // INTERN_H
@@ -2,6 +2,7 @@
 #define IR_H
 
 #include "ast.h"
+#include "util.h"
 
 #include <stdint.h>
 
@@ -10,27 +11,35 @@ enum {
 	// No arguments
 	IR_NOP,
 
-	// Create the global memory scope
-	// arg1 = size of global memory scope;
-	IR_GLOBAL_ALLOC,
-
 	// Load a given offset and size with a literal value
 	// arg1 = offset; 
 	// arg2 = size (max 8 bytes); 
-	// arg3 = 64 bit int;
+	// arg3 = constant;
 	IR_GLOBAL_LOAD_CONST,
 
-	// Load a given offset and size with the value of register
-	// arg1 = offset; 
-	// arg2 = size (max 8 bytes); 
-	// arg3 = register;
-	IR_GLOBAL_LOAD,
+	// Store the low 1, 2, 4 or 8 bytes of a register at a global memory
+	// offset (aligned to the size)
+	// arg1 = offset;
+	// arg2 = register;
+	IR_STORE8,
+	IR_STORE16,
+	IR_STORE32,
+	IR_STORE64,
 
-	// Load a given register with the global memory offset and size
-	// arg1 = register; 
-	// arg2 = offset; 
-	// arg3 = size (max 8 bytes);
-	IR_LOAD_GLOBAL, 
+	// Store a register at a global memory offset (aligned to 8) as an int,
+	// which is not truncated to 64 bits
+	// arg1 = offset;
+	// arg2 = register;
+	IR_STORE_INT,
+
+	// Load a register with the 1, 2, 4 or 8 bytes at a global memory offset
+	// (aligned to the size), sign extended; an int is loaded by IR_LOAD64
+	// arg1 = register;
+	// arg2 = offset;
+	IR_LOAD8,
+	IR_LOAD16,
+	IR_LOAD32,
+	IR_LOAD64,
 
 	// Add the content of 2 register index and set to another register
 	// arg1 = register (lhs); 
@@ -48,50 +57,221 @@ enum {
 	// arg1 = register
 	IR_PRINT,
 
-	// Move ip to given pointer if register is true (non-zero)
+	// Move ip to given instruction if register is true (non-zero)
 	// arg1 = register
-	// arg2 = pointer
+	// arg2 = instruction
 	IR_JMP_TRUE,
 	
-	// Move ip to given pointer if register is false (zero)
+	// Move ip to given instruction if register is false (zero)
 	// arg1 = register
-	// arg2 = pointer
+	// arg2 = instruction
 	IR_JMP_FALSE,
 
-	// Move to a given ip
-	// arg1 = pointer
+	// Move to a given instruction
+	// arg1 = instruction
 	IR_JMP,
+
+	// Set a register to a constant
+	// arg1 = register;
+	// arg2 = constant;
+	IR_LOAD_CONST,
+
+	// Compare the content of 2 registers and set another register to 1 if
+	// the comparison holds, 0 otherwise. The comparisons of every group
+	// below are in the same order (see ir_compare)
+	// arg1 = register (lhs);
+	// arg2 = register (left operand);
+	// arg3 = register (right operand);
+	IR_LT,
+	IR_LE,
+	IR_GT,
+	IR_GE,
+	IR_EQ,
+	IR_NE,
+
+	// Set a register to 1 if the content of another register is zero, 0
+	// otherwise
+	// arg1 = register (lhs);
+	// arg2 = register (operand);
+	IR_NOT,
+
+	// Move ip to given instruction if the comparison of 2 registers holds
+	// arg1 = register (left operand);
+	// arg2 = register (right operand);
+	// arg3 = instruction
+	IR_JLT,
+	IR_JLE,
+	IR_JGT,
+	IR_JGE,
+	IR_JEQ,
+	IR_JNE,
+
+	// Move ip to given instruction if the comparison of a register with a
+	// constant holds
+	// arg1 = register (left operand);
+	// arg2 = constant (right operand);
+	// arg3 = instruction
+	IR_JLTI,
+	IR_JLEI,
+	IR_JGTI,
+	IR_JGEI,
+	IR_JEQI,
+	IR_JNEI,
+
+	// Set a register to the content of another register
+	// arg1 = register (lhs);
+	// arg2 = register (operand);
+	IR_MOV,
+
+	// Set a register to the low 1, 2, 4 or 8 bytes of another register,
+	// sign extended: what storing it with IR_STORE8..IR_STORE64 and loading
+	// it back gives
+	// arg1 = register (lhs);
+	// arg2 = register (operand);
+	IR_WRAP8,
+	IR_WRAP16,
+	IR_WRAP32,
+	IR_WRAP64,
 };
 
+// An instruction is 16 bytes. A constant is an index in the constant pool
+// of the program, and an instruction is an index in its code
 struct ir_t {
-	int type;
-	int64_t arg1;
-	int64_t arg2;
-	int64_t arg3;
-
-	struct ir_t *next;
+	int32_t type;
+	int32_t arg1;
+	int32_t arg2;
+	int32_t arg3;
 };
 
 typedef struct ir_t ir_t;
 
+// Program generated from the ast, with everything the vm allocates before
+// it starts running the code
+struct ir_prog_t {
+	int total_regs;
+	int64_t global_size;
+
+	// 64 bit ints the instructions refer to
+	int64_t *consts;
+	int total_consts;
+
+	ir_t *code;
+	int total_code;
+
+	// Bytecode file the code and constants are mapped from (see
+	// load_bytecode); empty when the program owns them
+	file_t file;
+};
+
+typedef struct ir_prog_t ir_prog_t;
+
 /**
- * Generate ir list given the ast
+ * Generate the program given the ast
  *
  * Params:
  * 	prog  program ast
  *
  * Returns:
- * 	head to the ir list
+ * 	the program (User responsible for freeing with free_ir)
+ */
+ir_prog_t *generate_ir(ast_t *prog);
+
+/**
+ * Start generating ir statement by statement (see ir_toplevel)
+ *
+ * Params:
+ * 	memory_scope  global memory scope (see analyze_begin)
+ */
+void ir_begin(st_t *memory_scope);
+
+/**
+ * Generate the ir of an analyzed top-level statement
+ *
+ * Params:
+ * 	stmt  top-level statement
+ */
+void ir_toplevel(ast_t *stmt);
+
+/**
+ * Finish generating ir statement by statement
+ *
+ * Returns:
+ * 	the program (User responsible for freeing with free_ir)
+ */
+ir_prog_t *ir_end();
+
+/**
+ * Get the argument of an instruction holding its jump target
+ *
+ * Params:
+ * 	ir  the instruction
+ *
+ * Returns:
+ * 	the argument, NULL if the instruction does not jump
+ */
+int32_t *ir_target(ir_t *ir);
+
+/**
+ * Get the register an instruction writes
+ *
+ * Params:
+ * 	ir  the instruction
+ *
+ * Returns:
+ * 	the register, -1 if the instruction writes none
+ */
+int32_t ir_def(ir_t *ir);
+
+/**
+ * Get the registers an instruction reads
+ *
+ * Params:
+ * 	ir    the instruction
+ * 	uses  (output) the registers, at most 3
+ *
+ * Returns:
+ * 	number of registers read
+ */
+int ir_uses(ir_t *ir, int32_t uses[3]);
+
+/**
+ * Get the global memory slot an instruction reads or writes
+ *
+ * Params:
+ * 	ir      the instruction
+ * 	offset  (output) offset of the slot
+ *
+ * Returns:
+ * 	size of the slot, 0 if the instruction does not access memory
+ */
+int ir_slot(ir_t *ir, int32_t *offset);
+
+/**
+ * Check if the only effect of an instruction is the register it writes,
+ * so it can be dropped when that register is not read
+ *
+ * Params:
+ * 	ir  the instruction
+ *
+ * Returns:
+ * 	1 if it is, 0 otherwise
  */
-ir_t *generate_ir(ast_t *prog);
+int ir_pure(ir_t *ir);
 
 /**
- * Print the ir list
+ * Print the program
  *
  * Params:
- * 	ir_head  head of the ir list
+ * 	ir      the program
+ * 	out     output buffer
+ * 	format  DUMP_TEXT or DUMP_JSONL
+ */
+void print_ir(ir_prog_t *ir, buffer_t *out, int format);
+
+/**
+ * Free a program
  */
-void print_ir(ir_t *ir_head);
+void free_ir(ir_prog_t *ir);
 
 #endif // IR_H
 
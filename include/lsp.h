@@ -0,0 +1,17 @@
+#ifndef LSP_H
+#define LSP_H
+
+/**
+ * Run a language server over stdin/stdout until the client exits. Open
+ * documents are kept as incremental documents (see document.h) and their
+ * diagnostics are published after every change
+ *
+ * Params:
+ * 	stats_flag  print the time taken by every document update to stderr
+ *
+ * Returns:
+ * 	Exit code of the server
+ */
+int lsp_run(int stats_flag);
+
+#endif // LSP_H
@@ -0,0 +1,26 @@
+#ifndef OPT_H
+#define OPT_H
+
+#include "ir.h"
+
+// Highest optimization level (-O2)
+#define OPT_MAX_LEVEL 2
+
+/**
+ * Optimize a program in place with the passes of a level. -O0 runs none,
+ * -O1 runs the cheap cleanup passes once, and -O2 adds the passes working
+ * on the SSA form and repeats all of them until the code stops changing.
+ * Both then allocate the registers from a file of at most 256, spilling
+ * what does not fit to a frame in global memory
+ *
+ * Params:
+ * 	ir            the program (owning its code)
+ * 	level         optimization level, 0 to OPT_MAX_LEVEL
+ * 	keep_globals  keep the global memory the program ends with (for
+ * 	              print_vm_state), even where it is never read; variables
+ * 	              moved into registers are stored back at the end
+ * 	stats_flag    print the time and instruction count of every pass
+ */
+void optimize(ir_prog_t *ir, int level, int keep_globals, int stats_flag);
+
+#endif // OPT_H
@@ -1,15 +1,26 @@
 #ifndef POS_H
 #define POS_H
 
-struct pos_t {
-	int index;
-	int line;
-	int column;
-};
+#include <stdint.h>
 
-typedef struct pos_t pos_t;
+// Byte offset into the source; line and column are only resolved through
+// the line table when a diagnostic or dump needs them
+typedef uint32_t pos_t;
 
-#define POS_INIT (pos_t) {.index=0, .line=1, .column=1}
+#define POS_INIT ((pos_t) 0)
 
-#endif // POS_H
+/**
+ * Resolve a source offset to its line and column (both starting at 1)
+ *
+ * The line table of the source is built on the first call and reused
+ * until a different source is passed
+ *
+ * Params:
+ * 	src     source code the offset points into
+ * 	pos     offset into the source
+ * 	line    (output) line of the offset
+ * 	column  (output) column of the offset
+ */
+void pos_line_column(const char *src, pos_t pos, int *line, int *column);
 
+#endif // POS_H
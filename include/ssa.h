@@ -0,0 +1,118 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "arena.h"
+#include "buffer.h"
+#include "cfg.h"
+
+#include <stdint.h>
+
+// A phi merges the values a variable has at the end of the predecessors of
+// a block, in the order of its preds; block 0 has one more argument, the
+// value the variable has when the program starts
+struct ssa_phi_t {
+	int var;
+	int block;
+	int *args;
+};
+
+typedef struct ssa_phi_t ssa_phi_t;
+
+// Static single assignment form of a program, kept beside its code. The
+// variables are the registers, then the global slots always accessed with
+// the same size and never overlapping another slot; other slots are not
+// variables, and only the instructions accessing them see their values.
+//
+// A value is numbered by where it is defined: values below total_code are
+// defined by the instruction with that index, then come the values every
+// variable starts with (zero, like the registers and global memory of the
+// vm), then the values of the phis
+struct ssa_t {
+	cfg_t *cfg;
+
+	int total_vars;
+
+	// Variable of the slot at every global offset (-1 if there is none),
+	// and offset and size of every slot variable (from total_regs on)
+	int *slot_var;
+	int32_t *var_offset;
+	int32_t *var_size;
+
+	// Phis grouped by block: the phis of a block are from block_phis[block]
+	// to block_phis[block + 1]
+	ssa_phi_t *phis;
+	int total_phis;
+	int *block_phis;
+
+	// Values read by every instruction, in the order of ssa_uses: from
+	// uses[use_start[index]] to uses[use_start[index + 1]]. Instructions
+	// of unreachable blocks read -1
+	int *use_start;
+	int *uses;
+
+	int total_values;
+};
+
+typedef struct ssa_t ssa_t;
+
+/**
+ * Build the static single assignment form of a program, with phis where
+ * the definitions of a variable live across blocks meet
+ *
+ * Params:
+ * 	cfg    the graph of the program
+ * 	arena  arena the form is allocated from
+ *
+ * Returns:
+ * 	the form (lives until the arena is freed)
+ */
+ssa_t *build_ssa(cfg_t *cfg, arena_t *arena);
+
+/**
+ * Get the variable an instruction defines
+ *
+ * Params:
+ * 	ssa  the form
+ * 	ir   the instruction
+ *
+ * Returns:
+ * 	the variable, -1 if it defines none
+ */
+int ssa_def(ssa_t *ssa, ir_t *ir);
+
+/**
+ * Get the variables an instruction reads: the registers of ir_uses, then
+ * the slot a load reads
+ *
+ * Params:
+ * 	ssa   the form
+ * 	ir    the instruction
+ * 	vars  (output) the variables, at most 3
+ *
+ * Returns:
+ * 	number of variables read
+ */
+int ssa_uses(ssa_t *ssa, ir_t *ir, int vars[3]);
+
+/**
+ * Get the variable of a value
+ *
+ * Params:
+ * 	ssa    the form
+ * 	value  the value
+ *
+ * Returns:
+ * 	the variable
+ */
+int ssa_value_var(ssa_t *ssa, int value);
+
+/**
+ * Print the phis of every block
+ *
+ * Params:
+ * 	ssa  the form
+ * 	out  output buffer
+ */
+void print_ssa(ssa_t *ssa, buffer_t *out);
+
+#endif // SSA_H
@@ -1,13 +1,13 @@
 #ifndef ST_H
 #define ST_H
 
+#include "arena.h"
 #include "token.h"
 #include "type.h"
 
 enum {
 	ST_MEMORY_SCOPE,
 	ST_NAME_SCOPE,
-	ST_LITERAL,
 	ST_VAR,
 };
 
@@ -19,15 +19,24 @@ struct st_t {
 	struct {
 		struct st_t *parent;
 		int size;
-	} scope;
 
-	struct {
-		token_t token;
-		type_t *data_type;
+		// Largest size the scope reached; the slots of a block are reused
+		// once it ends (see st_scope_release), so this is the memory the
+		// scope needs
+		int max;
 
-		// offset in the memory scope
-		int offset;
-	} literal;
+		// Where the scope and its symbols are allocated
+		arena_t *arena;
+
+		// Last symbol of the next chain, so appending is O(1)
+		struct st_t *tail;
+
+		// Open addressing table of the variables of a name scope. cap is 0
+		// or a power of 2, and the table is kept at most half full
+		struct st_t **table;
+		int total;
+		int cap;
+	} scope;
 
 	struct {
 		token_t token;
@@ -46,37 +55,33 @@ typedef struct st_t st_t;
  * Params:
  * 	scope_type  type of the scope
  * 	parent      Parent scope
+ * 	arena       arena the scope and the symbols created in it live in
  *
  * Returns:
  * 	Memory to new scope
  */
-st_t *st_create_scope(int scope_type, st_t *parent);
+st_t *st_create_scope(int scope_type, st_t *parent, arena_t *arena);
 
 /**
- * Check if a literal exists in scope (or parent scope)
+ * Current size of a scope, to be released to when a block ends
  *
  * Params:
- * 	scope      scope that needs scanning
- * 	token      token literal
- * 	data_type  type of literal
+ * 	scope  memory scope
  *
  * Returns:
- * 	pointer to the literal (null if no literal)
+ * 	mark for st_scope_release
  */
-st_t *st_check_literal(st_t *scope, token_t token, type_t *data_type);
+int st_scope_mark(st_t *scope);
 
 /**
- * Create a literal in scope
+ * Give back the slots created after a mark, so they are reused by the
+ * variables created next; the symbols stay in the scope
  *
  * Params:
- * 	scope      scope that needs scanning
- * 	token      token literal
- * 	data_type  type of literal
- *
- * Returns:
- * 	pointer to the symbol
+ * 	scope  memory scope
+ * 	mark   st_scope_mark of the scope
  */
-st_t *st_create_literal(st_t *scope, token_t token, type_t *data_type);
+void st_scope_release(st_t *scope, int mark);
 
 /**
  * Check if a variable exists (only in that scope)
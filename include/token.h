@@ -2,6 +2,9 @@
 #define TOKEN_H
 
 #include "pos.h"
+#include "buffer.h"
+
+#include <stdint.h>
 
 enum {
 	TT_EOF = 0,
@@ -14,6 +17,16 @@ enum {
 	TT_EQUAL,
 	TT_LPAREN,
 	TT_RPAREN,
+	TT_LESS,
+	TT_LESS_EQUAL,
+	TT_GREATER,
+	TT_GREATER_EQUAL,
+	TT_EQUAL_EQUAL,
+	TT_BANG_EQUAL,
+	TT_BANG,
+	TT_AND_AND,
+	TT_OR_OR,
+	TT_COLON,
 
 	TT_IDENTIFIER,
 
@@ -35,30 +48,123 @@ struct token_t {
 	pos_t start;
 	pos_t end;
 
-	struct token_t *next;
+	// Interned symbol of identifiers and literals (SYM_NONE otherwise)
+	int sym;
+
+	// Decoded value of integer literals
+	int64_t value;
 };
 
 typedef struct token_t token_t;
 
+// Token stream stored as parallel arrays; token_t values are only built
+// on demand through token_at
+//
+// A streamed token stream is lexed lazily (see tokens_fill) and may drop
+// the tokens it no longer needs (see tokens_discard); indices are always
+// absolute, the arrays hold the tokens [base, base + count)
+struct tokens_t {
+	const char *filepath;
+	const char *src;
+
+	// Lexer still producing tokens (NULL once eof was lexed)
+	struct lexer_t *lexer;
+	int base;
+
+	int count;
+	int cap;
+	unsigned char *types;
+	pos_t *starts;
+	int *lens;
+	int *syms;
+};
+
+typedef struct tokens_t tokens_t;
+
 /**
  * Generate the token based on the provided filepath and source code
  *
  * Params:
  * 	filepath  name of the file whose tokens are generated
  * 	src       source code based on which tokens are generated
+ * 	len       length of the source code
+ *
+ * Returns:
+ * 	Token stream, always ending in TT_EOF (User responsible for free memory)
+ */
+tokens_t *generate_tokens(const char *filepath, const char *src, int len);
+
+/**
+ * Generate the tokens, splitting the source into chunks that are lexed
+ * by separate threads; the result is identical to generate_tokens
+ *
+ * Params:
+ * 	filepath  name of the file whose tokens are generated
+ * 	src       source code based on which tokens are generated
+ * 	len       length of the source code
+ * 	threads   maximum number of threads (small sources use fewer)
  *
  * Returns:
- * 	Head of the token list (User responsible for free memory)
+ * 	Token stream, always ending in TT_EOF (User responsible for free memory)
  */
-token_t *generate_tokens(const char *filepath, const char *src);
+tokens_t *generate_tokens_parallel(const char *filepath, const char *src,
+	int len, int threads);
 
 /**
- * Free all the tokens
+ * Create a token stream that is lexed on demand
  *
  * Params:
- * 	token  head of the token list
+ * 	filepath  name of the file whose tokens are generated
+ * 	src       source code based on which tokens are generated
+ * 	start     position where lexing starts
+ * 	len       length of the source code
+ *
+ * Returns:
+ * 	Empty token stream (User responsible for free memory)
  */
-void free_tokens(token_t *token);
+tokens_t *generate_tokens_stream(const char *filepath, const char *src,
+	int start, int len);
+
+/**
+ * Make sure a token is available, lexing more of a streamed source if needed
+ *
+ * Params:
+ * 	tokens  token stream
+ * 	index   index of the token
+ *
+ * Returns:
+ * 	type of the token at index (TT_EOF past the end of the stream)
+ */
+int tokens_fill(tokens_t *tokens, int index);
+
+/**
+ * Drop the tokens before index; they must not be accessed anymore
+ *
+ * Params:
+ * 	tokens  token stream
+ * 	index   first token to keep
+ */
+void tokens_discard(tokens_t *tokens, int index);
+
+/**
+ * Free the token stream
+ *
+ * Params:
+ * 	tokens  token stream
+ */
+void free_tokens(tokens_t *tokens);
+
+/**
+ * Get a token from the stream
+ *
+ * Params:
+ * 	tokens  token stream
+ * 	index   index of the token (already filled and not discarded)
+ *
+ * Returns:
+ * 	Token at the given index
+ */
+token_t token_at(tokens_t *tokens, int index);
 
 /**
  * Get the token type
@@ -82,5 +188,15 @@ const char *token_type(token_t token);
  */
 char *token_lexical(token_t token);
 
+/**
+ * Print every token of a token stream, one per line
+ *
+ * Params:
+ * 	tokens  token stream (not streamed)
+ * 	out     output buffer
+ * 	format  DUMP_TEXT or DUMP_JSONL
+ */
+void print_tokens(tokens_t *tokens, buffer_t *out, int format);
+
 #endif // TOKEN_H
 
@@ -1,29 +1,75 @@
 #ifndef TYPE_H
 #define TYPE_H
 
+#include <stdint.h>
+
 enum {
+	TY_I8,
+	TY_I16,
+	TY_I32,
+	TY_I64,
 	TY_INT,
 };
 
 struct type_t {
 	int type;
 	int size;
+
+	// Offsets of a value of the type are a multiple of align
+	int align;
+
+	const char *name;
 };
 
 typedef struct type_t type_t;
 
 /**
- * Get the int type
+ * Get the int type, an arbitrary precision integer (8 bytes in memory,
+ * pointing to the digits of values that do not fit in 63 bits)
  *
  * Returns:
  * 	Get the int type
  */
 type_t *type_int();
 
+/**
+ * Get a type of the registry
+ *
+ * Params:
+ * 	type  one of TY_I8, TY_I16, TY_I32, TY_I64, TY_INT
+ *
+ * Returns:
+ * 	the type
+ */
+type_t *type_get(int type);
+
+/**
+ * Find a type by its name ("int", "i8", "i16", "i32" or "i64")
+ *
+ * Params:
+ * 	name  name of the type (not null terminated)
+ * 	len   length of the name
+ *
+ * Returns:
+ * 	the type (null if there is no such type)
+ */
+type_t *type_find(const char *name, int len);
+
+/**
+ * Check if a value can be stored in the given type
+ *
+ * Params:
+ * 	type   type of the storage
+ * 	value  value to check
+ *
+ * Returns:
+ * 	1 if value is representable, 0 otherwise
+ */
+int type_fits(type_t *type, int64_t value);
+
 /**
  * Print all the types
  */
 void print_all_types();
 
 #endif // TYPE_H
-
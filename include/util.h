@@ -1,16 +1,48 @@
 #ifndef UTIL_H
 #define UTIL_H
 
+#include <stddef.h>
+
+struct file_t {
+	// Always null terminated (the terminator is not counted in len)
+	const char *src;
+	size_t len;
+
+	// Size of the underlying mapping
+	size_t map_size;
+};
+
+typedef struct file_t file_t;
+
 /**
  * Read the content of a file; if filepath == '-' then read from stdin
  *
+ * Regular files (including a regular file redirected to stdin) are mapped
+ * read-only instead of copied; pipes are read into a single anonymous
+ * mapping that grows in place
+ *
  * Params:
  * 	filepath  File whose contents needs to be read
  *
  * Returns:
- * 	character array containing the source (Users responsibility of memory)
+ * 	file containing the source (Users responsibility to free_file)
  */
-char *read_file(const char *filepath);
+file_t read_file(const char *filepath);
 
-#endif // UTIL_H
+/**
+ * Release the memory of a file returned by read_file
+ *
+ * Params:
+ * 	file  file that needs freeing
+ */
+void free_file(file_t file);
+
+/**
+ * Get a monotonic timestamp, used for reporting phase timings
+ *
+ * Returns:
+ * 	time in seconds
+ */
+double time_now();
 
+#endif // UTIL_H
@@ -4,17 +4,17 @@
 #include "ir.h"
 
 /**
- * Run the vm with given ir list
+ * Run the vm with given program
  *
  * Params:
- * 	ir  head of ir list
+ * 	ir  the program
  */
-void run_vm(ir_t *ir);
+void run_vm(ir_prog_t *ir);
 
 /**
  * Print the current vm state
  */
-void print_vm_state(ir_t *ir);
+void print_vm_state(ir_prog_t *ir);
 
 #endif // VM_H
 
@@ -12,20 +12,74 @@ static st_t *global_memory_scope = NULL;
 static st_t *global_name_scope = NULL;
 static int inside_loop = 0;
 
+// Token stream of the ast being analyzed; nodes only keep token indices
+static tokens_t *ast_tokens = NULL;
+
+// Set while analyze_isolated runs; unresolved identifiers are collected
+static int isolated = 0;
+static ast_t **global_uses = NULL;
+static int total_global_uses = 0, global_uses_cap = 0;
+
+// Symbol tables of analyze_isolated, dropped by the next call
+static arena_t isolated_memory = {}, isolated_names = {};
+
+// Node waiting on the work stack of analyze_walk. It is visited before its
+// children, and once more after them if leave is set
+typedef struct {
+	ast_t *ast;
+	int leave;
+
+	// Name scope the node is analyzed in
+	st_t *name_scope;
+
+	// Where the names and the memory slots of a block are released to when
+	// it is left
+	arena_mark_t mark;
+	int slots;
+	int bound;
+} analyze_work_t;
+
+static analyze_work_t *works = NULL;
+static int total_works = 0, works_cap = 0;
+
+// Innermost variable of every symbol in the scopes being analyzed (NULL if
+// none), so an identifier is found without walking the scope chain
+static st_t **bindings = NULL;
+static int bindings_cap = 0;
+
+// Every declaration in order with the variable it hides, undone when its
+// block ends
+typedef struct {
+	int sym;
+	st_t *hidden;
+} analyze_binding_t;
+
+static analyze_binding_t *bound = NULL;
+static int total_bound = 0, bound_cap = 0;
+
 void analyzer_match(ast_t *ast, int type, const char *error_message);
+void analyzer_error(ast_t *ast, const char *error_message);
+
+void analyze_bind(st_t *var);
+void analyze_unbind(int mark);
+
+analyze_work_t *analyze_push(ast_t *ast, st_t *name_scope, int leave);
+void analyze_walk(st_t *memory_scope, st_t *name_scope, ast_t *ast);
+void analyze_enter(st_t *memory_scope, analyze_work_t work);
+void analyze_leave(st_t *memory_scope, analyze_work_t work);
 
 void analyze_prog(st_t *memory_scope, st_t *name_scope, ast_t *ast);
-void analyze_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast);
 void analyze_block_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast);
 void analyze_var_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast);
-void analyze_print_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast);
+void analyze_var_decl(st_t *memory_scope, st_t *name_scope, ast_t *ast);
 void analyze_if_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast);
 void analyze_while_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast);
 void analyze_break_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast);
 void analyze_continue_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast);
-void analyze_expr_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast);
-void analyze_expr(st_t *memory_scope, st_t *name_scope, ast_t *ast);
 void analyze_binary(st_t *memory_scope, st_t *name_scope, ast_t *ast);
+void analyze_binary_type(st_t *memory_scope, st_t *name_scope, ast_t *ast);
+void analyze_unary(st_t *memory_scope, st_t *name_scope, ast_t *ast);
+void analyze_unary_type(st_t *memory_scope, st_t *name_scope, ast_t *ast);
 void analyze_literal(st_t *memory_scope, st_t *name_scope, ast_t *ast);
 void analyze_identifier(st_t *memory_scope, st_t *name_scope, ast_t *ast);
 
@@ -33,13 +87,45 @@ void analyze_identifier(st_t *memory_scope, st_t *name_scope, ast_t *ast);
 // analyzer.h - definition
 // ========================================
 
-void analyze(ast_t *ast) {
+void analyze(ast_t *ast, tokens_t *tokens, arena_t *memory, arena_t *names) {
+	analyze_begin(memory, names);
+	ast_tokens = tokens;
+	analyze_prog(global_memory_scope, global_name_scope, ast);
+}
+
+st_t *analyze_begin(arena_t *memory, arena_t *names) {
 	// Create the global scope
-	global_memory_scope = st_create_scope(ST_MEMORY_SCOPE, NULL);
+	global_memory_scope = st_create_scope(ST_MEMORY_SCOPE, NULL, memory);
 	global_name_scope = st_create_scope(ST_NAME_SCOPE, 
-		global_memory_scope);
+		global_memory_scope, names);
 	inside_loop = 0;
-	analyze_prog(global_memory_scope, global_name_scope, ast);
+	isolated = 0;
+
+	// Drop the names of the previous program, and those of the blocks a
+	// failed analysis never left
+	analyze_unbind(0);
+	return global_memory_scope;
+}
+
+void analyze_toplevel(ast_t *stmt, tokens_t *tokens) {
+	ast_tokens = tokens;
+	analyze_walk(global_memory_scope, global_name_scope, stmt);
+}
+
+ast_t **analyze_isolated(ast_t *stmt, tokens_t *tokens, int *total_uses) {
+	// The scopes of the previous statement are not needed anymore
+	arena_free(&isolated_names);
+	arena_free(&isolated_memory);
+
+	analyze_begin(&isolated_memory, &isolated_names);
+	isolated = 1;
+	total_global_uses = 0;
+	ast_tokens = tokens;
+
+	analyze_walk(global_memory_scope, global_name_scope, stmt);
+
+	*total_uses = total_global_uses;
+	return global_uses;
 }
 
 // ========================================
@@ -47,30 +133,89 @@ void analyze(ast_t *ast) {
 // ========================================
 
 void analyzer_match(ast_t *ast, int type, const char *error_message) {
-	if (ast->type != type) {
-		error_print(ast->filepath, ast->src, ast->start, ast->end,
-			error_message);
-		exit(1);
+	if (ast->type != type) analyzer_error(ast, error_message);
+}
+
+void analyzer_error(ast_t *ast, const char *error_message) {
+	error_print(ast_tokens->filepath, ast_tokens->src, ast->start, ast->end,
+		error_message);
+	error_exit();
+}
+
+void analyze_bind(st_t *var) {
+	int sym = var->var.token.sym;
+	if (sym >= bindings_cap) {
+		int cap = bindings_cap ? bindings_cap : 64;
+		while (cap <= sym) cap *= 2;
+		bindings = realloc(bindings, cap * sizeof(st_t*));
+		if (bindings == NULL) {
+			perror("Error in analyze_bind with realloc");
+			exit(1);
+		}
+		for (int i = bindings_cap; i < cap; i++) bindings[i] = NULL;
+		bindings_cap = cap;
+	}
+
+	if (total_bound == bound_cap) {
+		bound_cap = bound_cap ? bound_cap * 2 : 64;
+		bound = realloc(bound, bound_cap * sizeof(analyze_binding_t));
+		if (bound == NULL) {
+			perror("Error in analyze_bind with realloc");
+			exit(1);
+		}
 	}
+
+	bound[total_bound].sym = sym;
+	bound[total_bound].hidden = bindings[sym];
+	total_bound++;
+	bindings[sym] = var;
 }
 
-void analyze_prog(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
-	analyzer_match(ast, AST_PROG, "Expected an AST_PROG ast");
+void analyze_unbind(int mark) {
+	// Latest first, so a name shadowed twice gets its outer variable back
+	while (total_bound > mark) {
+		total_bound--;
+		bindings[bound[total_bound].sym] = bound[total_bound].hidden;
+	}
+}
+
+analyze_work_t *analyze_push(ast_t *ast, st_t *name_scope, int leave) {
+	if (total_works == works_cap) {
+		works_cap = works_cap ? works_cap * 2 : 64;
+		works = realloc(works, works_cap * sizeof(analyze_work_t));
+		if (works == NULL) {
+			perror("Error in analyze_push with realloc");
+			exit(1);
+		}
+	}
+
+	analyze_work_t *work = &works[total_works++];
+	work->ast = ast;
+	work->leave = leave;
+	work->name_scope = name_scope;
+	return work;
+}
 
-	ast->memory_scope = memory_scope;
-	ast->name_scope = name_scope;
+void analyze_walk(st_t *memory_scope, st_t *name_scope, ast_t *ast) {
+	// Depth first with an explicit stack, so any depth can be analyzed; a
+	// failed analysis may have left work behind
+	total_works = 0;
+	analyze_push(ast, name_scope, 0);
 
-	for (ast_t *cur = ast->prog.asts; cur; cur = cur->next) {
-		analyze_stmt(memory_scope, name_scope, cur);
+	while (total_works > 0) {
+		analyze_work_t work = works[--total_works];
+		if (work.leave) analyze_leave(memory_scope, work);
+		else analyze_enter(memory_scope, work);
 	}
 }
 
-void analyze_stmt(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
-	ast->memory_scope = memory_scope;
-	ast->name_scope = name_scope;
+void analyze_enter(st_t *memory_scope, analyze_work_t work) {
+	ast_t *ast = work.ast;
+	st_t *name_scope = work.name_scope;
+
 	switch (ast->type) {
 	case AST_EXPR_STMT:
-		analyze_expr_stmt(memory_scope, name_scope, ast);
+		analyze_push(ast->expr_stmt.expr, name_scope, 0);
 		break;
 	case AST_BLOCK_STMT:
 		analyze_block_stmt(memory_scope, name_scope, ast);
@@ -79,7 +224,7 @@ void analyze_stmt(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
 		analyze_var_stmt(memory_scope, name_scope, ast);
 		break;
 	case AST_PRINT_STMT:
-		analyze_print_stmt(memory_scope, name_scope, ast);
+		analyze_push(ast->print_stmt.expr, name_scope, 0);
 		break;
 	case AST_IF_STMT:
 		analyze_if_stmt(memory_scope, name_scope, ast);
@@ -93,138 +238,211 @@ void analyze_stmt(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
 	case AST_CONTINUE_STMT:
 		analyze_continue_stmt(memory_scope, name_scope, ast);
 		break;
+	case AST_BINARY:
+		analyze_binary(memory_scope, name_scope, ast);
+		break;
+	case AST_UNARY:
+		analyze_unary(memory_scope, name_scope, ast);
+		break;
+	case AST_LITERAL:
+		analyze_literal(memory_scope, name_scope, ast);
+		break;
+	case AST_IDENTIFIER:
+		analyze_identifier(memory_scope, name_scope, ast);
+		break;
 	default:
-		fprintf(stderr, "what is this STMT type?\n");
+		fprintf(stderr, "what is this ast type?\n");
 		exit(1);
 	}
 }
 
-void analyze_block_stmt(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
-	analyzer_match(ast, AST_BLOCK_STMT, "Expected an AST_BLOCK_STMT ast");
+void analyze_leave(st_t *memory_scope, analyze_work_t work) {
+	ast_t *ast = work.ast;
 
-	st_t *block_scope = st_create_scope(ST_NAME_SCOPE, name_scope);
-	ast->memory_scope = memory_scope;
-	ast->name_scope = block_scope;
+	switch (ast->type) {
+	case AST_BLOCK_STMT:
+		// Names of the block are out of scope now, and the slots of its
+		// variables are reused by the next ones
+		analyze_unbind(work.bound);
+		arena_release(work.name_scope->scope.arena, work.mark);
+		st_scope_release(memory_scope, work.slots);
+		break;
+	case AST_VAR_STMT:
+		analyze_var_decl(memory_scope, work.name_scope, ast);
+		break;
+	case AST_WHILE_STMT:
+		inside_loop--;
+		break;
+	case AST_BINARY:
+		analyze_binary_type(memory_scope, work.name_scope, ast);
+		break;
+	case AST_UNARY:
+		analyze_unary_type(memory_scope, work.name_scope, ast);
+		break;
+	}
+}
 
+void analyze_prog(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
+	analyzer_match(ast, AST_PROG, "Expected an AST_PROG ast");
+
+	ast->prog.memory_scope = memory_scope;
+	ast->prog.name_scope = name_scope;
+
+	for (ast_t *cur = ast->prog.asts; cur; cur = cur->next) {
+		analyze_walk(memory_scope, name_scope, cur);
+	}
+}
+
+void analyze_block_stmt(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
+	// Blocks nest, so the names of a block are always the last ones
+	// allocated from the arena when it ends
+	arena_t *names = name_scope->scope.arena;
+	analyze_work_t *leave = analyze_push(ast, name_scope, 1);
+	leave->mark = arena_mark(names);
+	leave->slots = st_scope_mark(memory_scope);
+	leave->bound = total_bound;
+
+	st_t *block_scope = st_create_scope(ST_NAME_SCOPE, name_scope, names);
+
+	// Pushed in order, so reversed to be analyzed in order
+	int from = total_works;
 	for (ast_t *x = ast->block_stmt.stmts; x; x = x->next) {
-		analyze_stmt(memory_scope, block_scope, x);
+		analyze_push(x, block_scope, 0);
+	}
+	for (int i = from, j = total_works - 1; i < j; i++, j--) {
+		analyze_work_t tmp = works[i];
+		works[i] = works[j];
+		works[j] = tmp;
 	}
 }
 
 void analyze_var_stmt(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
-	analyzer_match(ast, AST_VAR_STMT, "Expected an AST_VAR_STMT ast");
-
-	token_t id = ast->var_stmt.identifier;
+	token_t id = token_at(ast_tokens, ast->token);
 	if (st_check_var(name_scope, id)) {
 		error_print(id.filepath, id.src, id.start, id.end, 
 			"Variable already defined in scope");
-		exit(1);
+		error_exit();
 	}
 
+	// The variable is declared once its initializer is analyzed
+	analyze_push(ast, name_scope, 1);
+	if (ast->var_stmt.expr) analyze_push(ast->var_stmt.expr, name_scope, 0);
+}
+
+void analyze_var_decl(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
+	token_t id = token_at(ast_tokens, ast->token);
+
+	ast_t *expr = ast->var_stmt.expr;
+
 	type_t *data_type = type_int();
-	if (ast->var_stmt.expr) {
-		analyze_expr(memory_scope, name_scope, ast->var_stmt.expr);
-		data_type = ast->var_stmt.expr->data_type;
+	if (expr) data_type = expr->data_type;
+
+	// A declared type holds the value of the initializer truncated, like
+	// an assignment, but a literal has to fit
+	if (ast->var_stmt.type >= 0) {
+		token_t name = token_at(ast_tokens, ast->var_stmt.type);
+		data_type = type_find(name.src + name.start, name.end - name.start);
+		if (data_type == NULL) {
+			error_print(name.filepath, name.src, name.start, name.end,
+				"Unknown type");
+			error_exit();
+		}
+
+		if (expr && expr->type == AST_LITERAL &&
+			!type_fits(data_type, expr->literal.value)) {
+			analyzer_error(expr, "Integer literal out of range for the type");
+		}
 	}
 
 	st_t *memory = st_create_var(memory_scope, id, data_type);
 	st_t *name = st_create_var(name_scope, id, data_type);
 	name->var.offset = memory->var.offset; // Set the memory offset value
+	analyze_bind(name);
 	ast->offset = name->var.offset;
 	ast->data_type = data_type;
 }
 
-void analyze_print_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast) {
-	analyze_expr(memory_scope, name_scope, ast->print_stmt.expr);
-}
-
 void analyze_if_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast) {
-	ast_t *if_cond = ast->if_stmt.if_cond;
-	ast_t *if_block = ast->if_stmt.if_block;
-	ast_t *else_block = ast->if_stmt.else_block;
-	analyze_expr(memory_scope, name_scope, if_cond);
-	analyze_stmt(memory_scope, name_scope, if_block);
-	if (else_block) {
-		analyze_stmt(memory_scope, name_scope, else_block);
+	// Pushed in reverse, so the condition is analyzed first
+	if (ast->if_stmt.else_block) {
+		analyze_push(ast->if_stmt.else_block, name_scope, 0);
 	}
+	analyze_push(ast->if_stmt.if_block, name_scope, 0);
+	analyze_push(ast->if_stmt.if_cond, name_scope, 0);
 }
 
 void analyze_while_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast) {
 	inside_loop++;
-	analyze_expr(memory_scope, name_scope, ast->while_stmt.while_cond);
-	analyze_stmt(memory_scope, name_scope, ast->while_stmt.while_block);
-	inside_loop--;
+	analyze_push(ast, name_scope, 1);
+	analyze_push(ast->while_stmt.while_block, name_scope, 0);
+	analyze_push(ast->while_stmt.while_cond, name_scope, 0);
 }
 
 void analyze_break_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast) {
 	if (!inside_loop) {
-		error_print(ast->filepath, ast->src, ast->start, ast->end,
+		token_t keyword = token_at(ast_tokens, ast->token);
+		error_print(keyword.filepath, keyword.src, keyword.start, keyword.end,
 			"Invalid break usage; not inside a loop");
-		exit(1);
+		error_exit();
 	}
 }
 
 void analyze_continue_stmt(st_t *memory_scope, st_t *name_scope, ast_t *ast) {
 	if (!inside_loop) {
-		error_print(ast->filepath, ast->src, ast->start, ast->end,
+		token_t keyword = token_at(ast_tokens, ast->token);
+		error_print(keyword.filepath, keyword.src, keyword.start, keyword.end,
 			"Invalid continue usage; not inside a loop");
-		exit(1);
-	}
-}
-
-void analyze_expr_stmt(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
-	analyzer_match(ast, AST_EXPR_STMT, "Expected an AST_EXPR_STMT ast");
-
-	analyze_expr(memory_scope, name_scope, ast->expr_stmt.expr);
-}
-
-void analyze_expr(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
-	ast->memory_scope = memory_scope;
-	ast->name_scope = name_scope;
-	switch (ast->type) {
-	case AST_BINARY:
-		analyze_binary(memory_scope, name_scope, ast);
-		break;
-	case AST_LITERAL:
-		analyze_literal(memory_scope, name_scope, ast);
-		break;
-	case AST_IDENTIFIER:
-		analyze_identifier(memory_scope, name_scope, ast);
-		break;
-	default:
-		fprintf(stderr, "what is this EXPR type?\n");
-		exit(1);
+		error_exit();
 	}
 }
 
 void analyze_binary(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
-	analyzer_match(ast, AST_BINARY, "Expected an AST_BINARY ast");
+	analyze_push(ast, name_scope, 1);
+	analyze_push(ast->binary.right, name_scope, 0);
+	analyze_push(ast->binary.left, name_scope, 0);
+}
 
+void analyze_binary_type(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
 	ast_t *left = ast->binary.left, *right = ast->binary.right;
-	analyze_expr(memory_scope, name_scope, left);
-	analyze_expr(memory_scope, name_scope, right);
 
-	if (ast->binary.op.type == TT_EQUAL && !left->is_lhs) {
-		error_print(left->filepath, left->src, left->start, left->end,
-			"Expected lhs instead got value");
-		exit(1);
+	if (ast->op == TT_EQUAL && !left->is_lhs) {
+		analyzer_error(left, "Expected lhs instead got value");
 	}
 
 	ast_t *err_ast = NULL;
 	if (!left->data_type) err_ast = left;
 	if (!right->data_type) err_ast = right;
 
-	if (err_ast) {
-		error_print(err_ast->filepath, err_ast->src, err_ast->start,
-			err_ast->end, "Expression should have data_type");
-		exit(1);
+	if (err_ast) analyzer_error(err_ast, "Expression should have data_type");
+
+	// Arithmetic is done on the 64 bit registers, and comparisons and
+	// logical operators give 0 or 1
+	switch (ast->op) {
+	case TT_EQUAL:
+		ast->data_type = left->data_type;
+		break;
+	default:
+		ast->data_type = type_int();
 	}
+}
 
-	ast->data_type = left->data_type;
+void analyze_unary(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
+	analyze_push(ast, name_scope, 1);
+	analyze_push(ast->unary.expr, name_scope, 0);
+}
+
+void analyze_unary_type(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
+	if (!ast->unary.expr->data_type) {
+		analyzer_error(ast->unary.expr, "Expression should have data_type");
+	}
+
+	// '!' gives 0 or 1
+	ast->data_type = type_int();
 }
 
 void analyze_literal(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
-	switch (ast->literal.token.type) {
+	token_t literal = token_at(ast_tokens, ast->token);
+	switch (literal.type) {
 	case TT_INT_LITERAL:
 		ast->data_type = type_int();
 		break;
@@ -233,34 +451,45 @@ void analyze_literal(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
 		exit(1);
 	}
 
-	// Keep all the literal in the global scope
-	// Try to find if there is any literal
-	st_t *var = st_check_literal(global_memory_scope, ast->literal.token, 
-		ast->data_type);
-	if (var == NULL) {
-		var = st_create_literal(global_memory_scope,
-			ast->literal.token, ast->data_type);
+	if (!type_fits(ast->data_type, literal.value)) {
+		analyzer_error(ast, "Integer literal out of range for int");
 	}
-	ast->offset = var->literal.offset;
+
+	// Literals are loaded as immediates (see ir_literal_expr), so they
+	// take no memory
 }
 
 void analyze_identifier(st_t* memory_scope, st_t *name_scope, ast_t *ast) {
+	token_t identifier = token_at(ast_tokens, ast->token);
+
+	// Only the scopes enclosing the identifier are bound, innermost last
 	st_t *found = NULL;
+	if (identifier.sym < bindings_cap) found = bindings[identifier.sym];
+	if (found) {
+		ast->data_type = found->var.data_type;
+		ast->offset = found->var.offset;
+		ast->is_lhs = 1;
+		return;
+	}
 
-	for (st_t *cur = name_scope; cur; cur = cur->scope.parent) {
-		if (cur->type == ST_NAME_SCOPE) {
-			found = st_check_var(cur, ast->identifier.token);
-			if (found) {
-				ast->data_type = found->var.data_type;
-				ast->offset = found->var.offset;
-				ast->is_lhs = 1;
-				return;
+	if (isolated) {
+		if (total_global_uses == global_uses_cap) {
+			global_uses_cap = global_uses_cap ? global_uses_cap * 2 : 16;
+			global_uses = realloc(global_uses,
+				global_uses_cap * sizeof(ast_t*));
+			if (global_uses == NULL) {
+				perror("Error in analyze_identifier with realloc");
+				exit(1);
 			}
-		} else break;
+		}
+		global_uses[total_global_uses++] = ast;
+
+		ast->data_type = type_int();
+		ast->offset = 0;
+		ast->is_lhs = 1;
+		return;
 	}
 
-	error_print(ast->filepath, ast->src, ast->start, ast->end,
-		"Variable not defined");
-	exit(1);
+	analyzer_error(ast, "Variable not defined");
 }
 
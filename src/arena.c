@@ -0,0 +1,81 @@
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+void *arena_bump(arena_t *arena, size_t size, size_t align);
+
+// ========================================
+// arena.h - definition
+// ========================================
+
+void *arena_alloc(arena_t *arena, size_t size) {
+	return arena_bump(arena, size, alignof(max_align_t));
+}
+
+char *arena_strndup(arena_t *arena, const char *str, size_t len) {
+	char *res = arena_bump(arena, len + 1, 1);
+	memcpy(res, str, len);
+	res[len] = '\0';
+	return res;
+}
+
+arena_mark_t arena_mark(arena_t *arena) {
+	arena_mark_t mark = {arena->head, 0};
+	if (arena->head) mark.used = arena->head->used;
+	return mark;
+}
+
+void arena_release(arena_t *arena, arena_mark_t mark) {
+	while (arena->head != mark.chunk) {
+		arena_chunk_t *next = arena->head->next;
+		free(arena->head);
+		arena->head = next;
+	}
+	if (arena->head) arena->head->used = mark.used;
+}
+
+void arena_free(arena_t *arena) {
+	arena_chunk_t *chunk = arena->head;
+	while (chunk) {
+		arena_chunk_t *next = chunk->next;
+		free(chunk);
+		chunk = next;
+	}
+	arena->head = NULL;
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+void *arena_bump(arena_t *arena, size_t size, size_t align) {
+	arena_chunk_t *chunk = arena->head;
+	size_t offset = 0;
+	if (chunk) offset = (chunk->used + align - 1) & ~(align - 1);
+
+	if (chunk == NULL || offset + size > chunk->size) {
+		size_t chunk_size = ARENA_CHUNK_SIZE;
+		if (size > chunk_size) chunk_size = size;
+
+		chunk = malloc(sizeof(arena_chunk_t) + chunk_size);
+		if (chunk == NULL) {
+			perror("Error in arena_bump with malloc");
+			exit(1);
+		}
+		chunk->size = chunk_size;
+		chunk->used = 0;
+		chunk->next = arena->head;
+		arena->head = chunk;
+		offset = 0;
+	}
+
+	void *res = chunk->data + offset;
+	chunk->used = offset + size;
+	return res;
+}
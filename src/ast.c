@@ -1,6 +1,7 @@
 #include "ast.h"
 #include "error.h"
 
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -8,146 +9,204 @@
 // helper declaration
 // ========================================
 
+// Compound statement whose body is still being parsed (see parse_stmt)
+typedef struct {
+	// AST_BLOCK_STMT, AST_IF_STMT or AST_WHILE_STMT
+	int type;
+
+	// Token of the '{' or of the keyword
+	int token;
+	ast_t *cond;
+
+	// Set once the if block is parsed and an else follows
+	ast_t *if_block;
+
+	// Statements of a block
+	ast_t *head, *tail;
+} parse_frame_t;
+
 static struct {
-	token_t *tokens;
-	token_t *cur;
-	token_t prev;
+	tokens_t *tokens;
+	int cur;
+	int prev;
+
+	// Where the nodes are allocated
+	arena_t *arena;
+
+	// Open compound statements, innermost last
+	parse_frame_t *frames;
+	int total_frames;
+	int frames_cap;
+
+	// Operands and operator tokens of the expression being parsed
+	ast_t **operands;
+	int total_operands;
+	int operands_cap;
+	int *operators;
+	int total_operators;
+	int operators_cap;
 } parser;
 
-void parser_init(token_t *tokens);
+void parser_init(tokens_t *tokens);
+void *parser_reserve(void *array, int *cap, int total, size_t size);
+int parser_precedence(int type);
+int parser_peek();
 int parser_match(int type);
 token_t parser_current();
 token_t parser_next();
 token_t parser_prev();
+token_t parser_token(int index);
 int parser_eof();
 
 ast_t *parse_prog();
 ast_t *parse_stmt();
-ast_t *parse_block_stmt();
+ast_t *parse_simple_stmt();
+void parse_open(int type, int token, ast_t *cond);
+ast_t *parse_cond(const char *keyword);
 ast_t *parse_print_stmt();
 ast_t *parse_var_stmt();
-ast_t *parse_if_stmt();
-ast_t *parse_while_stmt();
 ast_t *parse_break_stmt();
 ast_t *parse_continue_stmt();
 ast_t *parse_expr_stmt();
 ast_t *parse_expr();
-ast_t *parse_assign_expr();
-ast_t *parse_expr_add();
+void parse_push_operand(ast_t *operand);
+void parse_push_operator(int token);
+void parse_reduce();
 ast_t *parse_expr_primary();
 
-ast_t *ast_malloc(int type, const char *filepath, const char *src, pos_t start,
-	pos_t end);
-ast_t *ast_literal(token_t token);
-ast_t *ast_identifier(token_t token);
-ast_t *ast_binary(ast_t *left, token_t op, ast_t *right);
-ast_t *ast_expr_stmt(ast_t *expr, token_t semicolon);
-ast_t *ast_var_stmt(token_t var_keyword, token_t identifier, ast_t *expr, 
-	token_t semicolon);
-ast_t *ast_block_stmt(token_t lparen, ast_t *stmts, token_t rparen);
-ast_t *ast_print_stmt(token_t print_keyword, ast_t *expr, token_t semicolon);
-ast_t *ast_if_stmt(token_t if_keyword, ast_t *if_cond, ast_t *if_block, 
+// Bytes of a node up to the end of a member of its union
+#define AST_SIZE(member) \
+	(offsetof(ast_t, member) + sizeof(((ast_t *) 0)->member))
+
+size_t ast_size(int type);
+ast_t *ast_malloc(int type, int token, pos_t start, pos_t end);
+ast_t *ast_literal(int token);
+ast_t *ast_identifier(int token);
+ast_t *ast_binary(ast_t *left, int op, ast_t *right);
+ast_t *ast_unary(int op, ast_t *expr);
+ast_t *ast_expr_stmt(ast_t *expr, int semicolon);
+ast_t *ast_var_stmt(int var_keyword, int identifier, int type, ast_t *expr,
+	int semicolon);
+ast_t *ast_block_stmt(int lparen, ast_t *stmts, int rparen);
+ast_t *ast_print_stmt(int print_keyword, ast_t *expr, int semicolon);
+ast_t *ast_if_stmt(int if_keyword, ast_t *if_cond, ast_t *if_block,
 	ast_t *else_block);
-ast_t *ast_while_stmt(token_t while_keyword, ast_t *while_cond, 
+ast_t *ast_while_stmt(int while_keyword, ast_t *while_cond,
 	ast_t *while_block);
-ast_t *ast_break_stmt(token_t break_keyword);
-ast_t *ast_continue_stmt(token_t continue_keyword);
+ast_t *ast_break_stmt(int break_keyword, int semicolon);
+ast_t *ast_continue_stmt(int continue_keyword, int semicolon);
 ast_t *ast_prog(ast_t *asts);
 
-void print_ast_helper(ast_t *ast, int *last, int depth);
-void print_token(token_t token);
-void print_ast_scope_info(ast_t *ast);
+// Node waiting on the stack of print_ast
+typedef struct {
+	ast_t *ast;
+	int depth;
+
+	// Whether a sibling is printed after the node; its descendants draw a
+	// '|' in its column
+	int more;
+
+	// Index of the parent in the order the nodes are printed
+	int parent;
+} ast_print_t;
+
+typedef struct {
+	ast_print_t *stack;
+	int total;
+	int cap;
+
+	// more of the ancestors of the node being printed, by depth
+	char *more;
+	int more_cap;
+} ast_printer_t;
+
+void print_ast_push(ast_printer_t *printer, ast_t *ast, int depth, int more,
+	int parent);
+void print_ast_children(ast_printer_t *printer, ast_print_t node, int id);
+void print_ast_text(ast_printer_t *printer, ast_print_t node,
+	tokens_t *tokens, buffer_t *out);
+void print_ast_json(ast_print_t node, int id, tokens_t *tokens,
+	buffer_t *out);
+const char *ast_name(ast_t *ast);
+int ast_token(ast_t *ast);
+void print_ast_scope_info(ast_t *ast, tokens_t *tokens);
 
 // ========================================
 // ast.h - definition
 // ========================================
 
-ast_t *generate_ast(token_t *tokens) {
+ast_t *generate_ast(tokens_t *tokens, arena_t *arena) {
 	parser_init(tokens);
+	parser.arena = arena;
 
 	ast_t *res = parse_prog();
 	return res;
 }
 
-void free_ast(ast_t *ast) {
-	if (ast == NULL) return;
+ast_t *generate_ast_stmt(tokens_t *tokens, arena_t *arena) {
+	// A stream that has not lexed anything yet is new, even when it got
+	// the address of a freed one
+	if (parser.tokens != tokens || (tokens->base == 0 && tokens->count == 0)) {
+		parser_init(tokens);
+	}
+	parser.arena = arena;
 
-	if (ast->next) free_ast(ast->next);
+	// Only the previous token can still be looked at
+	if (parser.prev >= 0) tokens_discard(tokens, parser.prev);
 
-	switch (ast->type) {
-	case AST_LITERAL:
-	case AST_IDENTIFIER:
-	case AST_BREAK_STMT:
-	case AST_CONTINUE_STMT:
-		break;
-	case AST_BINARY:
-		free_ast(ast->binary.left);
-		free_ast(ast->binary.right);
-		break;
-	case AST_EXPR_STMT:
-		free_ast(ast->expr_stmt.expr);
-		break;
-	case AST_PRINT_STMT:
-		free_ast(ast->print_stmt.expr);
-		break;
-	case AST_BLOCK_STMT:
-		free_ast(ast->block_stmt.stmts);
-		break;
-	case AST_IF_STMT:
-		free_ast(ast->if_stmt.if_cond);
-		free_ast(ast->if_stmt.if_block);
-		free_ast(ast->if_stmt.else_block);
-		break;
-	case AST_WHILE_STMT:
-		free_ast(ast->while_stmt.while_cond);
-		free_ast(ast->while_stmt.while_block);
-		break;
-	case AST_PROG:
-		free_ast(ast->prog.asts);
-		break;
-	}
-	free(ast);
+	if (parser_eof()) return NULL;
+	return parse_stmt();
 }
 
-void print_ast(ast_t *ast) {
-	printf("AST\n");
-	int last[AST_PRINT_DEPTH] = {};
-	last[0] = 0;
-	print_ast_helper(ast, last, 0);
-}
+void print_ast(ast_t *ast, tokens_t *tokens, buffer_t *out, int format) {
+	if (format == DUMP_TEXT) buffer_append(out, "AST\n", 4);
 
-void print_ast_scope(ast_t *ast) {
-	if (ast->type == AST_PROG) { // Print all the type info
-		printf("========== TYPE INFO ==========\n");
-		print_all_types();
-		printf("===============================\n\n");
-	}
+	// Depth first with an explicit stack, so any depth can be printed
+	ast_printer_t printer = {};
+	print_ast_push(&printer, ast, 0, 0, -1);
 
-	if (ast->type == AST_PROG) {
-		print_ast_scope_info(ast);
+	for (int id = 0; printer.total > 0; id++) {
+		ast_print_t node = printer.stack[--printer.total];
 
-		ast_t *start = NULL;
-		if (ast->type == AST_PROG) start = ast->prog.asts;
-		else start = ast->block_stmt.stmts;
+		if (format == DUMP_TEXT) print_ast_text(&printer, node, tokens, out);
+		else print_ast_json(node, id, tokens, out);
 
-		for (ast_t *cur = start; cur; cur = cur->next) {
-			print_ast_scope(cur);
-		}
+		print_ast_children(&printer, node, id);
 	}
+
+	free(printer.stack);
+	free(printer.more);
+	buffer_flush(out);
+}
+
+void print_ast_scope(ast_t *ast, tokens_t *tokens) {
+	// Only the program keeps its scopes
+	if (ast->type != AST_PROG) return;
+
+	// Print all the type info
+	printf("========== TYPE INFO ==========\n");
+	print_all_types();
+	printf("===============================\n\n");
+
+	print_ast_scope_info(ast, tokens);
 }
 
 // ========================================
 // helper definition
 // ========================================
 
-void parser_init(token_t *tokens) {
+void parser_init(tokens_t *tokens) {
 	parser.tokens = tokens;
-	parser.cur = tokens;
-	parser.prev.type = TT_EOF;
+	parser.cur = 0;
+	parser.prev = -1;
+}
+
+int parser_peek() {
+	return tokens_fill(parser.tokens, parser.cur);
 }
 
 int parser_match(int type) {
-	if (parser_current().type == type) {
+	if (parser_peek() == type) {
 		parser_next();
 		return 1;
 	}
@@ -156,22 +215,65 @@ int parser_match(int type) {
 }
 
 token_t parser_current() {
-	return *parser.cur;
+	parser_peek();
+	return token_at(parser.tokens, parser.cur);
 }
 
 token_t parser_next() {
 	token_t token = parser_current();
-	parser.prev = token;
-	parser.cur = parser.cur->next;
+	parser.prev = parser.cur;
+
+	// The stream always ends in TT_EOF; never walk past it
+	if (token.type != TT_EOF) parser.cur++;
 	return token;
 }
 
+void *parser_reserve(void *array, int *cap, int total, size_t size) {
+	if (total <= *cap) return array;
+
+	*cap = *cap ? *cap * 2 : 64;
+	if (*cap < total) *cap = total;
+	array = realloc(array, *cap * size);
+	if (array == NULL) {
+		perror("Error in parser_reserve with realloc");
+		exit(1);
+	}
+	return array;
+}
+
+int parser_precedence(int type) {
+	// Binding strength of binary operators (0 for any other token)
+	switch (type) {
+	case TT_EQUAL: return 1;
+	case TT_OR_OR: return 2;
+	case TT_AND_AND: return 3;
+	case TT_EQUAL_EQUAL:
+	case TT_BANG_EQUAL: return 4;
+	case TT_LESS:
+	case TT_LESS_EQUAL:
+	case TT_GREATER:
+	case TT_GREATER_EQUAL: return 5;
+	case TT_PLUS:
+	case TT_MINUS: return 6;
+	}
+	return 0;
+}
+
+token_t parser_token(int index) {
+	return token_at(parser.tokens, index);
+}
+
 token_t parser_prev() {
-	return parser.prev;
+	if (parser.prev < 0) {
+		token_t token = parser_current();
+		token.type = TT_EOF;
+		return token;
+	}
+	return token_at(parser.tokens, parser.prev);
 }
 
 int parser_eof() {
-	return parser_current().type == TT_EOF;
+	return parser_peek() == TT_EOF;
 }
 
 ast_t *parse_prog() {
@@ -198,21 +300,84 @@ ast_t *parse_prog() {
 }
 
 ast_t *parse_stmt() {
-	if (parser_match(TT_LBRACE)) {
-		return parse_block_stmt();
+	// Compound statements wait on an explicit stack of open frames, so the
+	// nesting depth is only limited by memory
+	parser.total_frames = 0;
+	parser.total_operands = parser.total_operators = 0;
+
+	for (;;) {
+		parse_frame_t *top = NULL;
+		if (parser.total_frames) top = &parser.frames[parser.total_frames - 1];
+
+		ast_t *stmt = NULL;
+		if (top && top->type == AST_BLOCK_STMT && parser_match(TT_RBRACE)) {
+			stmt = ast_block_stmt(top->token, top->head, parser.prev);
+			parser.total_frames--;
+		}
+		else if (top && top->type == AST_BLOCK_STMT && parser_eof()) {
+			token_t cur = parser_current();
+			error_print(cur.filepath, cur.src, cur.start, cur.end,
+				"Expected '}' but reached eof");
+			error_exit();
+		}
+		else if (parser_match(TT_LBRACE)) {
+			parse_open(AST_BLOCK_STMT, parser.prev, NULL);
+			continue;
+		}
+		else if (parser_match(TT_IF_KEYWORD)) {
+			int keyword = parser.prev;
+			parse_open(AST_IF_STMT, keyword, parse_cond("if"));
+			continue;
+		}
+		else if (parser_match(TT_WHILE_KEYWORD)) {
+			int keyword = parser.prev;
+			parse_open(AST_WHILE_STMT, keyword, parse_cond("while"));
+			continue;
+		}
+		else stmt = parse_simple_stmt();
+
+		// Close every statement the parsed one completes
+		while (parser.total_frames) {
+			parse_frame_t *frame = &parser.frames[parser.total_frames - 1];
+
+			if (frame->type == AST_BLOCK_STMT) {
+				if (frame->head == NULL) frame->head = frame->tail = stmt;
+				else {
+					frame->tail->next = stmt;
+					frame->tail = stmt;
+				}
+				stmt = NULL;
+				break;
+			}
+
+			if (frame->type == AST_IF_STMT && frame->if_block == NULL) {
+				if (parser_match(TT_ELSE_KEYWORD)) {
+					frame->if_block = stmt;
+					stmt = NULL;
+					break;
+				}
+				stmt = ast_if_stmt(frame->token, frame->cond, stmt, NULL);
+			}
+			else if (frame->type == AST_IF_STMT) {
+				stmt = ast_if_stmt(frame->token, frame->cond, frame->if_block,
+					stmt);
+			}
+			else stmt = ast_while_stmt(frame->token, frame->cond, stmt);
+
+			parser.total_frames--;
+		}
+
+		if (stmt) return stmt;
 	}
-	else if (parser_match(TT_VAR_KEYWORD)) {
+}
+
+ast_t *parse_simple_stmt() {
+	if (parser_match(TT_VAR_KEYWORD)) {
 		return parse_var_stmt();
 	}
 	else if (parser_match(TT_PRINT_KEYWORD)) {
 		return parse_print_stmt();
 	}
-	else if (parser_match(TT_IF_KEYWORD)) {
-		return parse_if_stmt();
-	}
-	else if (parser_match(TT_WHILE_KEYWORD)) {
-		return parse_while_stmt();
-	}
 	else if (parser_match(TT_BREAK_KEYWORD)) {
 		return parse_break_stmt();
 	}
@@ -223,144 +388,117 @@ ast_t *parse_stmt() {
 	return parse_expr_stmt();
 }
 
-ast_t *parse_block_stmt() {
-	token_t lparen = parser_prev();
-	ast_t *head = NULL, *tail = NULL;
-	while (!parser_match(TT_RBRACE)) {
-		token_t cur = parser_current();
-
-		if (parser_eof()) {
-			error_print(cur.filepath, cur.src, cur.start, cur.end,
-				"Expected '}' but reached eof");
-			exit(1);
-		}
-
-		ast_t *stmt = parse_stmt();
+void parse_open(int type, int token, ast_t *cond) {
+	parser.frames = parser_reserve(parser.frames, &parser.frames_cap,
+		parser.total_frames + 1, sizeof(parse_frame_t));
 
-		if (head == NULL) head = tail = stmt;
-		else {
-			tail->next = stmt;
-			tail = stmt;
-		}
-	}
-	return ast_block_stmt(lparen, head, parser_prev());
+	parse_frame_t *frame = &parser.frames[parser.total_frames++];
+	frame->type = type;
+	frame->token = token;
+	frame->cond = cond;
+	frame->if_block = NULL;
+	frame->head = frame->tail = NULL;
 }
 
-ast_t *parse_var_stmt() {
-	token_t var_keyword = parser_prev();
+ast_t *parse_cond(const char *keyword) {
+	char message[64];
 
-	token_t identifier = parser_current();
-	if (!parser_match(TT_IDENTIFIER)) {
+	if (!parser_match(TT_LPAREN)) {
 		token_t cur = parser_current();
-		error_print(cur.filepath, cur.src, cur.start, cur.end,
-			"Expected identifier after var keyword");
-		exit(1);
+		snprintf(message, sizeof(message), "Expected '(' after %s keyword",
+			keyword);
+		error_print(cur.filepath, cur.src, cur.start, cur.end, message);
+		error_exit();
 	}
 
-	ast_t *expr = NULL;
-	if (parser_match(TT_EQUAL)) {
-		expr = parse_expr();
-	}
+	ast_t *cond = parse_expr();
 
-	token_t semicolon = parser_current();
-	if (!parser_match(TT_SEMICOLON)) {
+	if (!parser_match(TT_RPAREN)) {
 		token_t cur = parser_current();
-		error_print(cur.filepath, cur.src, cur.start, cur.end,
-			"Expected ';' at the end of var stmt");
-		exit(1);
+		snprintf(message, sizeof(message), "Expected ')' after %s condition",
+			keyword);
+		error_print(cur.filepath, cur.src, cur.start, cur.end, message);
+		error_exit();
 	}
 
-	return ast_var_stmt(var_keyword, identifier, expr, semicolon);
+	return cond;
 }
 
-ast_t *parse_if_stmt() {
-	token_t if_keyword = parser_prev();
-
-	if (!parser_match(TT_LPAREN)) {
-		token_t cur = parser_current();
-		error_print(cur.filepath, cur.src, cur.start, cur.end,
-			"Expected '(' after if keyword");
-		exit(1);
-	}
-
-	ast_t *if_cond = parse_expr();
+ast_t *parse_var_stmt() {
+	int var_keyword = parser.prev;
 
-	if (!parser_match(TT_RPAREN)) {
+	int identifier = parser.cur;
+	if (!parser_match(TT_IDENTIFIER)) {
 		token_t cur = parser_current();
 		error_print(cur.filepath, cur.src, cur.start, cur.end,
-			"Expected ')' after if condition");
-		exit(1);
+			"Expected identifier after var keyword");
+		error_exit();
 	}
 
-	ast_t *if_block = parse_stmt();
-	ast_t *else_block = NULL;
-
-	if (parser_match(TT_ELSE_KEYWORD)) {
-		else_block = parse_stmt();
+	int type = -1;
+	if (parser_match(TT_COLON)) {
+		type = parser.cur;
+		if (!parser_match(TT_IDENTIFIER)) {
+			token_t cur = parser_current();
+			error_print(cur.filepath, cur.src, cur.start, cur.end,
+				"Expected type after ':'");
+			error_exit();
+		}
 	}
 
-	return ast_if_stmt(if_keyword, if_cond, if_block, else_block);
-}
-
-ast_t *parse_while_stmt() {
-	token_t while_keyword = parser_prev();
-
-	if (!parser_match(TT_LPAREN)) {
-		token_t cur = parser_current();
-		error_print(cur.filepath, cur.src, cur.start, cur.end,
-			"Expected '(' after while keyword");
-		exit(1);
+	ast_t *expr = NULL;
+	if (parser_match(TT_EQUAL)) {
+		expr = parse_expr();
 	}
 
-	ast_t *while_cond = parse_expr();
-
-	if (!parser_match(TT_RPAREN)) {
+	int semicolon = parser.cur;
+	if (!parser_match(TT_SEMICOLON)) {
 		token_t cur = parser_current();
 		error_print(cur.filepath, cur.src, cur.start, cur.end,
-			"Expected ')' after while condition");
-		exit(1);
+			"Expected ';' at the end of var stmt");
+		error_exit();
 	}
 
-	ast_t *while_block = parse_stmt();
-
-	return ast_while_stmt(while_keyword, while_cond, while_block);
+	return ast_var_stmt(var_keyword, identifier, type, expr, semicolon);
 }
 
 ast_t *parse_break_stmt() {
-	token_t break_keyword = parser_prev();
+	int break_keyword = parser.prev;
 
+	int semicolon = parser.cur;
 	if (!parser_match(TT_SEMICOLON)) {
 		token_t cur = parser_current();
 		error_print(cur.filepath, cur.src, cur.start, cur.end,
 			"Expected ';' after break keyword");
-		exit(1);
+		error_exit();
 	}
 
-	return ast_break_stmt(break_keyword);
+	return ast_break_stmt(break_keyword, semicolon);
 }
 
 ast_t *parse_continue_stmt() {
-	token_t continue_keyword = parser_prev();
+	int continue_keyword = parser.prev;
 
+	int semicolon = parser.cur;
 	if (!parser_match(TT_SEMICOLON)) {
 		token_t cur = parser_current();
 		error_print(cur.filepath, cur.src, cur.start, cur.end,
 			"Expected ';' after continue keyword");
-		exit(1);
+		error_exit();
 	}
 
-	return ast_continue_stmt(continue_keyword);
+	return ast_continue_stmt(continue_keyword, semicolon);
 }
 
 ast_t *parse_print_stmt() {
-	token_t print_keyword = parser_prev();
+	int print_keyword = parser.prev;
 	ast_t *expr = parse_expr();
-	token_t semicolon = parser_current();
+	int semicolon = parser.cur;
 	if (!parser_match(TT_SEMICOLON)) {
 		token_t cur = parser_current();
 		error_print(cur.filepath, cur.src, cur.start, cur.end,
 			"Expected ';' at the end of print stmt");
-		exit(1);
+		error_exit();
 	}
 
 	return ast_print_stmt(print_keyword, expr, semicolon);
@@ -368,164 +506,233 @@ ast_t *parse_print_stmt() {
 
 ast_t *parse_expr_stmt() {
 	ast_t *expr = parse_expr();
-	token_t token = parser_current();
+	int semicolon = parser.cur;
 	if (!parser_match(TT_SEMICOLON)) {
-		error_print(expr->filepath, expr->src, expr->start, expr->end,
-			"Expected ';' after expr");
-		exit(1);
+		error_print(parser.tokens->filepath, parser.tokens->src, expr->start,
+			expr->end, "Expected ';' after expr");
+		error_exit();
 	}
-	return ast_expr_stmt(expr, token);
+	return ast_expr_stmt(expr, semicolon);
 }
 
 ast_t *parse_expr() {
-	return parse_assign_expr();
-}
+	// Operator precedence parsing with an operand and an operator stack;
+	// an operator is reduced once one that binds looser follows it. '!'
+	// and '(' wait on the operator stack too
+	int operators = parser.total_operators;
+	int open = 0;
+
+	for (;;) {
+		while (parser_peek() == TT_BANG || parser_peek() == TT_LPAREN) {
+			if (parser_next().type == TT_LPAREN) open++;
+			parse_push_operator(parser.prev);
+		}
+		parse_push_operand(parse_expr_primary());
+
+		// A ')' closes the innermost '(' of this expression; one that was not
+		// opened here (like the one of an if condition) ends the expression
+		while (open > 0 && parser_match(TT_RPAREN)) {
+			while (parser_token(parser.operators[parser.total_operators - 1])
+				.type != TT_LPAREN) {
+				parse_reduce();
+			}
+			parser.total_operators--;
+			open--;
+		}
 
-ast_t *parse_assign_expr() {
-	ast_t *left = parse_expr_add();
-	if (parser_match(TT_EQUAL)) {
-		token_t op = parser_prev();
-		return ast_binary(left, op, parse_assign_expr());
+		int type = parser_peek();
+		int precedence = parser_precedence(type);
+		if (precedence == 0) break;
+		parser_next();
+
+		// '!' binds tighter than any binary operator; '=' is right
+		// associative, every other binary operator left associative
+		while (parser.total_operators > operators) {
+			int top = parser.operators[parser.total_operators - 1];
+			int top_type = parser_token(top).type;
+			if (top_type == TT_LPAREN) break;
+
+			int top_precedence = parser_precedence(top_type);
+			if (top_type != TT_BANG) {
+				if (top_precedence < precedence) break;
+				if (top_precedence == precedence && type == TT_EQUAL) break;
+			}
+			parse_reduce();
+		}
+		parse_push_operator(parser.prev);
 	}
 
-	return left;
+	if (open > 0) {
+		token_t cur = parser_current();
+		error_print(cur.filepath, cur.src, cur.start, cur.end,
+			"Expected ')' to close '('");
+		error_exit();
+	}
+
+	while (parser.total_operators > operators) parse_reduce();
+	return parser.operands[--parser.total_operands];
+}
+
+void parse_push_operand(ast_t *operand) {
+	parser.operands = parser_reserve(parser.operands, &parser.operands_cap,
+		parser.total_operands + 1, sizeof(ast_t*));
+	parser.operands[parser.total_operands++] = operand;
 }
 
-ast_t *parse_expr_add() {
-	ast_t *left = parse_expr_primary();
-	while (parser_current().type == TT_PLUS || 
-		parser_current().type == TT_MINUS) {
-		token_t op = parser_next();
-		left = ast_binary(left, op, parse_expr_primary());
+void parse_push_operator(int token) {
+	parser.operators = parser_reserve(parser.operators, &parser.operators_cap,
+		parser.total_operators + 1, sizeof(int));
+	parser.operators[parser.total_operators++] = token;
+}
+
+void parse_reduce() {
+	int op = parser.operators[--parser.total_operators];
+	ast_t *right = parser.operands[--parser.total_operands];
+
+	if (parser_token(op).type == TT_BANG) {
+		parser.operands[parser.total_operands++] = ast_unary(op, right);
+		return;
 	}
-	return left;
+
+	ast_t *left = parser.operands[--parser.total_operands];
+	parser.operands[parser.total_operands++] = ast_binary(left, op, right);
 }
 
 ast_t *parse_expr_primary() {
 	token_t token = parser_current();
 	if (parser_match(TT_INT_LITERAL)) {
-		return ast_literal(token);
+		return ast_literal(parser.prev);
 	}
 	else if (parser_match(TT_IDENTIFIER)) {
-		return ast_identifier(token);
+		return ast_identifier(parser.prev);
 	}
 
 	error_print(token.filepath, token.src, token.start, token.end,
 		"Expected primary");
-	exit(1);
+	error_exit();
+}
+
+size_t ast_size(int type) {
+	switch (type) {
+	case AST_LITERAL: return AST_SIZE(literal);
+	case AST_BINARY: return AST_SIZE(binary);
+	case AST_UNARY: return AST_SIZE(unary);
+	case AST_EXPR_STMT: return AST_SIZE(expr_stmt);
+	case AST_VAR_STMT: return AST_SIZE(var_stmt);
+	case AST_PRINT_STMT: return AST_SIZE(print_stmt);
+	case AST_BLOCK_STMT: return AST_SIZE(block_stmt);
+	case AST_IF_STMT: return AST_SIZE(if_stmt);
+	case AST_WHILE_STMT: return AST_SIZE(while_stmt);
+	case AST_PROG: return AST_SIZE(prog);
+	}
+
+	// Identifiers, break and continue are only the header
+	return offsetof(ast_t, literal);
 }
 
-ast_t *ast_malloc(int type, const char *filepath, const char *src, pos_t start,
-	pos_t end) {
-	ast_t *res = malloc(sizeof(ast_t));
+ast_t *ast_malloc(int type, int token, pos_t start, pos_t end) {
+	ast_t *res = arena_alloc(parser.arena, ast_size(type));
 	res->type = type;
-	res->filepath = filepath;
-	res->src = src;
+	res->op = 0;
+	res->is_lhs = 0;
+	res->token = token;
 	res->start = start;
 	res->end = end;
-	res->data_type = NULL;
-	res->name_scope = NULL;
-	res->memory_scope = NULL;
 	res->offset = -1;
-	res->is_lhs = 0;
+	res->data_type = NULL;
 	res->next = NULL;
 	return res;
 }
 
-ast_t *ast_literal(token_t token) {
-	ast_t *res = ast_malloc(AST_LITERAL, token.filepath, token.src,
-		token.start, token.end);
-	res->literal.token = token;
+ast_t *ast_literal(int token) {
+	token_t literal = parser_token(token);
+	ast_t *res = ast_malloc(AST_LITERAL, token, literal.start, literal.end);
+	res->literal.value = literal.value;
 	return res;
 }
 
-ast_t *ast_identifier(token_t token) {
-	ast_t *res = ast_malloc(AST_IDENTIFIER, token.filepath, token.src,
-		token.start, token.end);
-	res->identifier.token = token;
-	return res;
+ast_t *ast_identifier(int token) {
+	token_t identifier = parser_token(token);
+	return ast_malloc(AST_IDENTIFIER, token, identifier.start,
+		identifier.end);
 }
 
-ast_t *ast_binary(ast_t *left, token_t op, ast_t *right) {
-	ast_t *res = ast_malloc(AST_BINARY, op.filepath, op.src, left->start,
-		right->end);
+ast_t *ast_binary(ast_t *left, int op, ast_t *right) {
+	ast_t *res = ast_malloc(AST_BINARY, op, left->start, right->end);
+	res->op = parser_token(op).type;
 	res->binary.left = left;
-	res->binary.op = op;
 	res->binary.right = right;
 	return res;
 }
 
-ast_t *ast_expr_stmt(ast_t *expr, token_t semicolon) {
-	ast_t *res = ast_malloc(AST_EXPR_STMT, expr->filepath, expr->src,
-		expr->start, semicolon.end);
+ast_t *ast_unary(int op, ast_t *expr) {
+	token_t token = parser_token(op);
+	ast_t *res = ast_malloc(AST_UNARY, op, token.start, expr->end);
+	res->op = token.type;
+	res->unary.expr = expr;
+	return res;
+}
+
+ast_t *ast_expr_stmt(ast_t *expr, int semicolon) {
+	ast_t *res = ast_malloc(AST_EXPR_STMT, semicolon, expr->start,
+		parser_token(semicolon).end);
 	res->expr_stmt.expr = expr;
-	res->expr_stmt.semicolon = semicolon;
 	return res;
 }
 
-ast_t *ast_var_stmt(token_t var_keyword, token_t identifier, ast_t *expr, 
-	token_t semicolon) {
-	ast_t *res = ast_malloc(AST_VAR_STMT, var_keyword.filepath, 
-		var_keyword.src, var_keyword.start, semicolon.end);
-	res->var_stmt.var_keyword = var_keyword;
-	res->var_stmt.identifier = identifier;
+ast_t *ast_var_stmt(int var_keyword, int identifier, int type, ast_t *expr,
+	int semicolon) {
+	ast_t *res = ast_malloc(AST_VAR_STMT, identifier,
+		parser_token(var_keyword).start, parser_token(semicolon).end);
 	res->var_stmt.expr = expr;
-	res->var_stmt.semicolon = semicolon;
+	res->var_stmt.type = type;
 	return res;
 }
 
-ast_t *ast_print_stmt(token_t print_keyword, ast_t *expr, token_t semicolon) {
-	ast_t *res = ast_malloc(AST_PRINT_STMT, print_keyword.filepath,
-		print_keyword.src, print_keyword.start, semicolon.end);
-	res->print_stmt.print_keyword = print_keyword;
+ast_t *ast_print_stmt(int print_keyword, ast_t *expr, int semicolon) {
+	ast_t *res = ast_malloc(AST_PRINT_STMT, print_keyword,
+		parser_token(print_keyword).start, parser_token(semicolon).end);
 	res->print_stmt.expr = expr;
 	return res;
 }
 
-ast_t *ast_block_stmt(token_t lparen, ast_t *stmts, token_t rparen) {
-	ast_t *res = ast_malloc(AST_BLOCK_STMT, lparen.filepath, lparen.src,
-		lparen.start, rparen.end);
+ast_t *ast_block_stmt(int lparen, ast_t *stmts, int rparen) {
+	ast_t *res = ast_malloc(AST_BLOCK_STMT, lparen,
+		parser_token(lparen).start, parser_token(rparen).end);
 	res->block_stmt.stmts = stmts;
 	return res;
 }
 
-ast_t *ast_if_stmt(token_t if_keyword, ast_t *if_cond, ast_t *if_block,
+ast_t *ast_if_stmt(int if_keyword, ast_t *if_cond, ast_t *if_block,
 	ast_t *else_block) {
 	pos_t end = if_block->end;
 	if (else_block) end = else_block->end;
 
-	ast_t *res = ast_malloc(AST_IF_STMT, if_keyword.filepath, 
-		if_keyword.src, if_keyword.start, end);
-	res->if_stmt.if_keyword = if_keyword;
+	ast_t *res = ast_malloc(AST_IF_STMT, if_keyword,
+		parser_token(if_keyword).start, end);
 	res->if_stmt.if_cond = if_cond;
 	res->if_stmt.if_block = if_block;
 	res->if_stmt.else_block = else_block;
 	return res;
 }
 
-ast_t *ast_while_stmt(token_t while_keyword, ast_t *while_cond, 
+ast_t *ast_while_stmt(int while_keyword, ast_t *while_cond,
 	ast_t *while_block) {
-	ast_t *res = ast_malloc(AST_WHILE_STMT, while_keyword.filepath,
-		while_keyword.src, while_keyword.start, while_block->end);
-	res->while_stmt.while_keyword = while_keyword;
+	ast_t *res = ast_malloc(AST_WHILE_STMT, while_keyword,
+		parser_token(while_keyword).start, while_block->end);
 	res->while_stmt.while_cond = while_cond;
 	res->while_stmt.while_block = while_block;
 	return res;
 }
 
-ast_t *ast_break_stmt(token_t break_keyword) {
-	ast_t *res = ast_malloc(AST_BREAK_STMT, break_keyword.filepath,
-		break_keyword.src, break_keyword.start, break_keyword.end);
-	res->break_stmt.break_keyword = break_keyword;
-	return res;
+ast_t *ast_break_stmt(int break_keyword, int semicolon) {
+	return ast_malloc(AST_BREAK_STMT, break_keyword,
+		parser_token(break_keyword).start, parser_token(semicolon).end);
 }
 
-ast_t *ast_continue_stmt(token_t continue_keyword) {
-	ast_t *res = ast_malloc(AST_CONTINUE_STMT, continue_keyword.filepath,
-		continue_keyword.src, continue_keyword.start, 
-		continue_keyword.end);
-	res->continue_stmt.continue_keyword = continue_keyword;
-	return res;
+ast_t *ast_continue_stmt(int continue_keyword, int semicolon) {
+	return ast_malloc(AST_CONTINUE_STMT, continue_keyword,
+		parser_token(continue_keyword).start, parser_token(semicolon).end);
 }
 
 ast_t *ast_prog(ast_t *asts) {
@@ -535,182 +742,225 @@ ast_t *ast_prog(ast_t *asts) {
 		end = cur->end;
 	}
 
-	ast_t *res = ast_malloc(AST_PROG, asts->filepath, asts->src, 
-		start, end);
+	ast_t *res = ast_malloc(AST_PROG, 0, start, end);
 	res->prog.asts = asts;
+	res->prog.memory_scope = NULL;
+	res->prog.name_scope = NULL;
 	return res;
 }
 
-void print_ast_helper(ast_t *ast, int *last, int depth) {
-	if (depth+1 >= AST_PRINT_DEPTH) {
-		printf("Very long ast depth, not printing the rest");
+void print_ast_push(ast_printer_t *printer, ast_t *ast, int depth, int more,
+	int parent) {
+	if (printer->total == printer->cap) {
+		printer->cap = printer->cap ? printer->cap * 2 : 64;
+		printer->stack = realloc(printer->stack,
+			printer->cap * sizeof(ast_print_t));
+		if (printer->stack == NULL) {
+			perror("Error in print_ast_push with realloc");
+			exit(1);
+		}
 	}
 
-	for (int i = 0; i < depth; i++) {
-		if (last[i]) printf("|   ");
-		else printf("    ");
-	}
+	ast_print_t *node = &printer->stack[printer->total++];
+	node->ast = ast;
+	node->depth = depth;
+	node->more = more;
+	node->parent = parent;
+}
+
+void print_ast_children(ast_printer_t *printer, ast_print_t node, int id) {
+	ast_t *ast = node.ast;
+	int depth = node.depth + 1;
+	int from = printer->total;
 
-	last[depth+1] = 1;
 	switch (ast->type) {
 	case AST_LITERAL:
-	case AST_IDENTIFIER: {
-		token_t token;
-		const char *ast_type = NULL;
-
-		if (ast->type == AST_LITERAL) {
-			token = ast->literal.token;
-			ast_type = "AST_LITERAL";
-		}
-		else {
-			token = ast->identifier.token;
-			ast_type = "AST_IDENTIFIER";
-		}
-
-		printf("+-- %s(", ast_type);
-		print_token(token);
-		printf(")\n");
-
-		last[depth+1] = 0;
+	case AST_IDENTIFIER:
+	case AST_BREAK_STMT:
+	case AST_CONTINUE_STMT:
 		break;
-	}
 
 	case AST_BINARY:
-		printf("+-- AST_BINARY(");
-		print_token(ast->binary.op);
-		printf(")\n");
-
-		print_ast_helper(ast->binary.left, last, depth+1);
-		last[depth+1] = 0;
-		print_ast_helper(ast->binary.right, last, depth+1);
+		print_ast_push(printer, ast->binary.left, depth, 1, id);
+		print_ast_push(printer, ast->binary.right, depth, 0, id);
 		break;
-	
-	case AST_EXPR_STMT:
-		printf("+-- AST_EXPR_STMT\n");
 
-		last[depth+1] = 0;
-		print_ast_helper(ast->expr_stmt.expr, last, depth+1);
+	case AST_UNARY:
+		print_ast_push(printer, ast->unary.expr, depth, 0, id);
 		break;
-	
-	case AST_BLOCK_STMT: {
-		printf("+-- AST_BLOCK_STMT\n");
 
-		for (ast_t *x = ast->block_stmt.stmts; x; x = x->next) {
-			last[depth+1] = (x->next ? 1 : 0);
-			print_ast_helper(x, last, depth+1);
-		}
+	case AST_EXPR_STMT:
+		print_ast_push(printer, ast->expr_stmt.expr, depth, 0, id);
 		break;
-	}
 
-	case AST_VAR_STMT: {
-		printf("+-- AST_VAR_STMT(");
-		print_token(ast->var_stmt.identifier);
-		printf(")\n");
+	case AST_PRINT_STMT:
+		print_ast_push(printer, ast->print_stmt.expr, depth, 0, id);
+		break;
 
-		last[depth+1] = 0;
+	case AST_VAR_STMT:
 		if (ast->var_stmt.expr) {
-			print_ast_helper(ast->var_stmt.expr, last, depth+1);
+			print_ast_push(printer, ast->var_stmt.expr, depth, 0, id);
 		}
 		break;
-	}
 
 	case AST_IF_STMT: {
-		printf("+-- AST_IF_STMT\n");
-
-		print_ast_helper(ast->if_stmt.if_cond, last, depth+1);
-
-		last[depth+1] = (ast->if_stmt.else_block ? 1 : 0);
-		print_ast_helper(ast->if_stmt.if_block, last, depth+1);
-
-		last[depth+1] = 0;
 		ast_t *else_block = ast->if_stmt.else_block;
-		if (else_block) {
-			print_ast_helper(else_block, last, depth+1);
-		}
+		print_ast_push(printer, ast->if_stmt.if_cond, depth, 1, id);
+		print_ast_push(printer, ast->if_stmt.if_block, depth,
+			else_block ? 1 : 0, id);
+		if (else_block) print_ast_push(printer, else_block, depth, 0, id);
 		break;
 	}
 
-	case AST_WHILE_STMT: {
-		printf("+-- AST_WHILE_STMT\n");
-
-		print_ast_helper(ast->while_stmt.while_cond, last, depth+1);
+	case AST_WHILE_STMT:
+		print_ast_push(printer, ast->while_stmt.while_cond, depth, 1, id);
+		print_ast_push(printer, ast->while_stmt.while_block, depth, 0, id);
+		break;
 
-		last[depth+1] = 0;
-		print_ast_helper(ast->while_stmt.while_block, last, depth+1);
+	case AST_BLOCK_STMT:
+	case AST_PROG: {
+		ast_t *x = ast->type == AST_PROG ?
+			ast->prog.asts : ast->block_stmt.stmts;
+		for (; x; x = x->next) {
+			print_ast_push(printer, x, depth, x->next ? 1 : 0, id);
+		}
 		break;
 	}
+	}
 
-	case AST_PRINT_STMT: {
-		printf("+-- AST_PRINT_STMT\n");
-
-		last[depth+1] = 0;
-		print_ast_helper(ast->print_stmt.expr, last, depth+1);
-		break;
+	// Pushed in order, so reversed to be popped in order
+	for (int i = from, j = printer->total - 1; i < j; i++, j--) {
+		ast_print_t tmp = printer->stack[i];
+		printer->stack[i] = printer->stack[j];
+		printer->stack[j] = tmp;
 	}
+}
 
-	case AST_BREAK_STMT: {
-		printf("+-- AST_BREAK_STMT\n");
-		break;
+void print_ast_text(ast_printer_t *printer, ast_print_t node,
+	tokens_t *tokens, buffer_t *out) {
+	if (node.depth >= printer->more_cap) {
+		printer->more_cap = printer->more_cap ? printer->more_cap : 64;
+		while (node.depth >= printer->more_cap) printer->more_cap *= 2;
+		printer->more = realloc(printer->more, printer->more_cap);
+		if (printer->more == NULL) {
+			perror("Error in print_ast_text with realloc");
+			exit(1);
+		}
 	}
-	
-	case AST_CONTINUE_STMT: {
-		printf("+-- AST_CONTINUE_STMT\n");
-		break;
+	printer->more[node.depth] = node.more;
+
+	for (int i = 0; i < node.depth; i++) {
+		buffer_append(out, printer->more[i] ? "|   " : "    ", 4);
 	}
-	
-	case AST_PROG: {
-		printf("+-- AST_PROG\n");
 
-		for (ast_t *x = ast->prog.asts; x; x = x->next) {
-			last[depth+1] = (x->next ? 1 : 0);
-			print_ast_helper(x, last, depth+1);
+	buffer_append(out, "+-- ", 4);
+	buffer_append(out, ast_name(node.ast), -1);
+
+	int index = ast_token(node.ast);
+	if (index >= 0) {
+		token_t token = token_at(tokens, index);
+		buffer_append(out, "(", 1);
+		buffer_append(out, token_type(token), -1);
+		buffer_append(out, " | ", 3);
+		if (token.type == TT_INT_LITERAL) buffer_int(out, token.value);
+		else {
+			buffer_append(out, token.src + token.start,
+				token.end - token.start);
 		}
-		break;
-	}
+		buffer_append(out, ")", 1);
+	}
+	buffer_append(out, "\n", 1);
+}
+
+void print_ast_json(ast_print_t node, int id, tokens_t *tokens,
+	buffer_t *out) {
+	ast_t *ast = node.ast;
+
+	buffer_append(out, "{\"id\":", -1);
+	buffer_int(out, id);
+	buffer_append(out, ",\"parent\":", -1);
+	buffer_int(out, node.parent);
+	buffer_append(out, ",\"type\":\"", -1);
+	buffer_append(out, ast_name(ast), -1);
+	buffer_append(out, "\",\"start\":", -1);
+	buffer_int(out, ast->start);
+	buffer_append(out, ",\"end\":", -1);
+	buffer_int(out, ast->end);
+
+	int index = ast_token(ast);
+	if (index >= 0) {
+		token_t token = token_at(tokens, index);
+		buffer_append(out, ",\"token\":{\"type\":\"", -1);
+		buffer_append(out, token_type(token), -1);
+		buffer_append(out, "\",\"text\":", -1);
+		buffer_string(out, token.src + token.start,
+			token.end - token.start);
+		if (token.type == TT_INT_LITERAL) {
+			buffer_append(out, ",\"value\":", -1);
+			buffer_int(out, token.value);
+		}
+		buffer_append(out, "}", 1);
 	}
+	buffer_append(out, "}\n", 2);
 }
 
-void print_token(token_t token) {
-	char *lexical = token_lexical(token);
-	printf("%s | %s", token_type(token), lexical);
-	free(lexical);
+const char *ast_name(ast_t *ast) {
+	switch (ast->type) {
+	case AST_LITERAL: return "AST_LITERAL";
+	case AST_IDENTIFIER: return "AST_IDENTIFIER";
+	case AST_BINARY: return "AST_BINARY";
+	case AST_UNARY: return "AST_UNARY";
+	case AST_EXPR_STMT: return "AST_EXPR_STMT";
+	case AST_PRINT_STMT: return "AST_PRINT_STMT";
+	case AST_BLOCK_STMT: return "AST_BLOCK_STMT";
+	case AST_VAR_STMT: return "AST_VAR_STMT";
+	case AST_IF_STMT: return "AST_IF_STMT";
+	case AST_WHILE_STMT: return "AST_WHILE_STMT";
+	case AST_BREAK_STMT: return "AST_BREAK_STMT";
+	case AST_CONTINUE_STMT: return "AST_CONTINUE_STMT";
+	case AST_PROG: return "AST_PROG";
+	}
+	return "UNKNOWN";
+}
+
+int ast_token(ast_t *ast) {
+	// Token shown next to the node in the dumps (-1 if none)
+	switch (ast->type) {
+	case AST_LITERAL:
+	case AST_IDENTIFIER:
+	case AST_BINARY:
+	case AST_UNARY:
+	case AST_VAR_STMT:
+		return ast->token;
+	}
+	return -1;
 }
 
-void print_ast_scope_info(ast_t *ast) {
+void print_ast_scope_info(ast_t *ast, tokens_t *tokens) {
+	st_t *memory_scope = ast->prog.memory_scope;
+	st_t *name_scope = ast->prog.name_scope;
 	printf("========== MEMORY_BLOCK: %p | MEMORY_SIZE: %d - NAME_BLOCK: %p | NAME_SIZE: %d ==========\n", 
-		ast->memory_scope, ast->memory_scope->scope.size, ast->name_scope, ast->name_scope->scope.size);
-	for (int i = ast->start.index; i < ast->end.index; i++) {
-		printf("%c", ast->src[i]);
+		memory_scope, memory_scope->scope.max, name_scope, name_scope->scope.size);
+	for (pos_t i = ast->start; i < ast->end; i++) {
+		printf("%c", tokens->src[i]);
 	}
 	printf("\n");
 
 	printf("xxxxxxxxxx SYMBOLS xxxxxxxxxx\n");
 
-	for (st_t *cur = ast->memory_scope; cur; cur = cur->next) {
+	for (st_t *cur = memory_scope; cur; cur = cur->next) {
 		switch (cur->type) {
 		case ST_MEMORY_SCOPE:
 		case ST_NAME_SCOPE:
 			continue;
-		case ST_LITERAL: 
 		case ST_VAR: {
-			token_t token;
-			type_t *data_type;
-			int offset;
-			if (cur->type == ST_LITERAL) {
-				token = cur->literal.token;
-				data_type = cur->literal.data_type;
-				offset = cur->literal.offset;
-			}
-			else {
-				token = cur->var.token;
-				data_type = cur->var.data_type;
-				offset = cur->var.offset;
-			}
+			token_t token = cur->var.token;
+			type_t *data_type = cur->var.data_type;
+			int offset = cur->var.offset;
 
 			const char *type_str = "ST_VAR";
-			if (cur->type == ST_LITERAL) type_str = "ST_LITERAL";
-
 			char *lexical = token_lexical(token);
+
 			int sz = 0;
 			sz = snprintf(NULL, 0, "type: %-10s | id: %p(offset: %d) | type: %p(size: %d) | lexical: %s", 
 				type_str, cur, offset, data_type, data_type->size, lexical);
@@ -0,0 +1,349 @@
+#include "bigint.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+// Digits of a limb in the base case of the decimal conversion, and the
+// number of limbs above which the conversion splits the value
+#define BIGINT_CHUNK 1000000000u
+#define BIGINT_CHUNK_DIGITS 9
+#define BIGINT_SPLIT 32
+
+// powers[k] is 10^(9 * 2^k), computed when first needed
+static struct {
+	uint32_t *limbs;
+	int len;
+} powers[32];
+static int total_powers = 0;
+
+bigint_t *bigint_alloc(arena_t *arena, int len);
+bigint_t *bigint_trim(bigint_t *a);
+bigint_t *bigint_add_signed(arena_t *arena, bigint_t *a, bigint_t *b,
+	int b_sign);
+
+int mag_cmp(const uint32_t *a, int a_len, const uint32_t *b, int b_len);
+int mag_trim(const uint32_t *a, int len);
+void mag_mul(const uint32_t *a, int a_len, const uint32_t *b, int b_len,
+	uint32_t *res);
+uint32_t mag_div_small(uint32_t *a, int len, uint32_t divisor);
+void mag_divmod(const uint32_t *u, int m, const uint32_t *v, int n,
+	uint32_t *q, uint32_t *r);
+void *mag_malloc(int len);
+
+int decimal_power(int k);
+void decimal_write(const uint32_t *limbs, int len, char *out, int width);
+
+// ========================================
+// bigint.h - definition
+// ========================================
+
+bigint_t *bigint_from_int(arena_t *arena, int64_t value) {
+	// The magnitude is taken as unsigned so INT64_MIN does not overflow
+	uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+
+	bigint_t *res = bigint_alloc(arena, 2);
+	res->sign = value < 0 ? -1 : 1;
+	res->limbs[0] = (uint32_t) magnitude;
+	res->limbs[1] = (uint32_t) (magnitude >> 32);
+	return bigint_trim(res);
+}
+
+int bigint_to_int(bigint_t *a, int64_t *value) {
+	if (a->len > 2) return 0;
+
+	uint64_t magnitude = 0;
+	for (int i = a->len - 1; i >= 0; i--) {
+		magnitude = (magnitude << 32) | a->limbs[i];
+	}
+
+	// -2^63 is the one value whose magnitude does not fit as positive
+	uint64_t limit = (uint64_t) INT64_MAX + (a->sign < 0);
+	if (magnitude > limit) return 0;
+
+	*value = a->sign < 0 ? (int64_t) -magnitude : (int64_t) magnitude;
+	return 1;
+}
+
+int64_t bigint_wrap(bigint_t *a) {
+	uint64_t magnitude = 0;
+	if (a->len > 0) magnitude = a->limbs[0];
+	if (a->len > 1) magnitude |= (uint64_t) a->limbs[1] << 32;
+
+	return (int64_t) (a->sign < 0 ? -magnitude : magnitude);
+}
+
+bigint_t *bigint_add(arena_t *arena, bigint_t *a, bigint_t *b) {
+	return bigint_add_signed(arena, a, b, b->sign);
+}
+
+bigint_t *bigint_sub(arena_t *arena, bigint_t *a, bigint_t *b) {
+	return bigint_add_signed(arena, a, b, -b->sign);
+}
+
+int bigint_cmp(bigint_t *a, bigint_t *b) {
+	if (a->sign != b->sign) return a->sign;
+
+	int cmp = mag_cmp(a->limbs, a->len, b->limbs, b->len);
+	return a->sign < 0 ? -cmp : cmp;
+}
+
+char *bigint_str(bigint_t *a) {
+	// 32 bits are less than 10 decimal digits, so this is enough room; the
+	// digits are written zero padded and the padding dropped after
+	int width = a->len * 10 + 1;
+	char *res = malloc(width + 2);
+	if (res == NULL) {
+		perror("Error in bigint_str with malloc");
+		exit(1);
+	}
+
+	decimal_write(a->limbs, a->len, res + 1, width);
+	res[width + 1] = '\0';
+
+	int start = 1;
+	while (start < width && res[start] == '0') start++;
+	if (a->sign < 0) res[--start] = '-';
+
+	memmove(res, res + start, width + 2 - start);
+	return res;
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+bigint_t *bigint_alloc(arena_t *arena, int len) {
+	bigint_t *res = arena_alloc(arena, sizeof(bigint_t) +
+		len * sizeof(uint32_t));
+	res->sign = 1;
+	res->len = len;
+	return res;
+}
+
+bigint_t *bigint_trim(bigint_t *a) {
+	a->len = mag_trim(a->limbs, a->len);
+	if (a->len == 0) a->sign = 1;
+	return a;
+}
+
+bigint_t *bigint_add_signed(arena_t *arena, bigint_t *a, bigint_t *b,
+	int b_sign) {
+
+	// Same signs add the magnitudes, different ones subtract the smaller
+	// magnitude from the larger
+	if (a->sign == b_sign) {
+		bigint_t *res = bigint_alloc(arena,
+			(a->len > b->len ? a->len : b->len) + 1);
+		res->sign = a->sign;
+
+		uint64_t carry = 0;
+		for (int i = 0; i < res->len; i++) {
+			uint64_t sum = carry;
+			if (i < a->len) sum += a->limbs[i];
+			if (i < b->len) sum += b->limbs[i];
+			res->limbs[i] = (uint32_t) sum;
+			carry = sum >> 32;
+		}
+		return bigint_trim(res);
+	}
+
+	int cmp = mag_cmp(a->limbs, a->len, b->limbs, b->len);
+	bigint_t *large = cmp >= 0 ? a : b;
+	bigint_t *small = cmp >= 0 ? b : a;
+
+	bigint_t *res = bigint_alloc(arena, large->len);
+	res->sign = cmp >= 0 ? a->sign : b_sign;
+
+	int64_t borrow = 0;
+	for (int i = 0; i < large->len; i++) {
+		int64_t diff = (int64_t) large->limbs[i] - borrow;
+		if (i < small->len) diff -= small->limbs[i];
+		borrow = diff < 0;
+		res->limbs[i] = (uint32_t) (diff + (borrow << 32));
+	}
+	return bigint_trim(res);
+}
+
+int mag_cmp(const uint32_t *a, int a_len, const uint32_t *b, int b_len) {
+	if (a_len != b_len) return a_len < b_len ? -1 : 1;
+
+	for (int i = a_len - 1; i >= 0; i--) {
+		if (a[i] != b[i]) return a[i] < b[i] ? -1 : 1;
+	}
+	return 0;
+}
+
+int mag_trim(const uint32_t *a, int len) {
+	while (len > 0 && a[len - 1] == 0) len--;
+	return len;
+}
+
+void mag_mul(const uint32_t *a, int a_len, const uint32_t *b, int b_len,
+	uint32_t *res) {
+
+	memset(res, 0, (a_len + b_len) * sizeof(uint32_t));
+	for (int i = 0; i < a_len; i++) {
+		uint64_t carry = 0;
+		for (int j = 0; j < b_len; j++) {
+			uint64_t cur = (uint64_t) a[i] * b[j] + res[i + j] + carry;
+			res[i + j] = (uint32_t) cur;
+			carry = cur >> 32;
+		}
+		res[i + b_len] = (uint32_t) carry;
+	}
+}
+
+uint32_t mag_div_small(uint32_t *a, int len, uint32_t divisor) {
+	// a /= divisor in place; returns the remainder
+	uint64_t rem = 0;
+	for (int i = len - 1; i >= 0; i--) {
+		uint64_t cur = (rem << 32) | a[i];
+		a[i] = (uint32_t) (cur / divisor);
+		rem = cur % divisor;
+	}
+	return (uint32_t) rem;
+}
+
+void mag_divmod(const uint32_t *u, int m, const uint32_t *v, int n,
+	uint32_t *q, uint32_t *r) {
+
+	// Long division (Knuth, algorithm D): q gets m - n + 1 limbs and r
+	// gets n limbs. Needs m >= n >= 2 and v[n - 1] != 0
+	const uint64_t base = (uint64_t) 1 << 32;
+
+	// Normalize so the top limb of the divisor has its high bit set, which
+	// keeps every estimate of a quotient limb at most 2 too large
+	int s = __builtin_clz(v[n - 1]);
+	uint32_t *vn = mag_malloc(n);
+	uint32_t *un = mag_malloc(m + 1);
+
+	for (int i = n - 1; i > 0; i--) {
+		vn[i] = (v[i] << s) | (uint32_t) ((uint64_t) v[i - 1] >> (32 - s));
+	}
+	vn[0] = v[0] << s;
+
+	un[m] = (uint32_t) ((uint64_t) u[m - 1] >> (32 - s));
+	for (int i = m - 1; i > 0; i--) {
+		un[i] = (u[i] << s) | (uint32_t) ((uint64_t) u[i - 1] >> (32 - s));
+	}
+	un[0] = u[0] << s;
+
+	for (int j = m - n; j >= 0; j--) {
+		uint64_t top = ((uint64_t) un[j + n] << 32) | un[j + n - 1];
+		uint64_t qhat = top / vn[n - 1];
+		uint64_t rhat = top % vn[n - 1];
+
+		while (qhat >= base ||
+			qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+			qhat--;
+			rhat += vn[n - 1];
+			if (rhat >= base) break;
+		}
+
+		// un[j..j+n] -= qhat * vn
+		int64_t borrow = 0;
+		uint64_t carry = 0;
+		for (int i = 0; i < n; i++) {
+			uint64_t p = qhat * vn[i] + carry;
+			carry = p >> 32;
+			int64_t t = (int64_t) un[i + j] - borrow - (uint32_t) p;
+			un[i + j] = (uint32_t) t;
+			borrow = t < 0;
+		}
+		int64_t t = (int64_t) un[j + n] - borrow - (int64_t) carry;
+		un[j + n] = (uint32_t) t;
+
+		// Estimated one too large; add the divisor back
+		if (t < 0) {
+			qhat--;
+			uint64_t sum = 0;
+			for (int i = 0; i < n; i++) {
+				sum = (uint64_t) un[i + j] + vn[i] + (sum >> 32);
+				un[i + j] = (uint32_t) sum;
+			}
+			un[j + n] += (uint32_t) (sum >> 32);
+		}
+		q[j] = (uint32_t) qhat;
+	}
+
+	for (int i = 0; i < n - 1; i++) {
+		r[i] = (un[i] >> s) | (uint32_t) ((uint64_t) un[i + 1] << (32 - s));
+	}
+	r[n - 1] = un[n - 1] >> s;
+
+	free(vn);
+	free(un);
+}
+
+void *mag_malloc(int len) {
+	void *res = malloc((len > 0 ? len : 1) * sizeof(uint32_t));
+	if (res == NULL) {
+		perror("Error in mag_malloc with malloc");
+		exit(1);
+	}
+	return res;
+}
+
+int decimal_power(int k) {
+	// Returns the number of limbs of powers[k]
+	while (total_powers <= k) {
+		int i = total_powers;
+		if (i == 0) {
+			powers[0].limbs = mag_malloc(1);
+			powers[0].limbs[0] = BIGINT_CHUNK;
+			powers[0].len = 1;
+		}
+		else {
+			int len = powers[i - 1].len * 2;
+			powers[i].limbs = mag_malloc(len);
+			mag_mul(powers[i - 1].limbs, powers[i - 1].len,
+				powers[i - 1].limbs, powers[i - 1].len, powers[i].limbs);
+			powers[i].len = mag_trim(powers[i].limbs, len);
+		}
+		total_powers++;
+	}
+	return powers[k].len;
+}
+
+void decimal_write(const uint32_t *limbs, int len, char *out, int width) {
+	// Writes exactly width digits, zero padded; the value has to fit
+	if (len <= BIGINT_SPLIT) {
+		uint32_t *cur = mag_malloc(len);
+		memcpy(cur, limbs, len * sizeof(uint32_t));
+
+		int pos = width;
+		while (len > 0 && pos > 0) {
+			uint32_t chunk = mag_div_small(cur, len, BIGINT_CHUNK);
+			len = mag_trim(cur, len);
+			for (int i = 0; i < BIGINT_CHUNK_DIGITS && pos > 0; i++) {
+				out[--pos] = '0' + chunk % 10;
+				chunk /= 10;
+			}
+		}
+		memset(out, '0', pos);
+		free(cur);
+		return;
+	}
+
+	// Split by the largest power with at most half the limbs; the low half
+	// is the remainder and has exactly digits digits
+	int k = 0;
+	while (decimal_power(k + 1) * 2 <= len) k++;
+	int power_len = decimal_power(k);
+	int digits = BIGINT_CHUNK_DIGITS << k;
+
+	uint32_t *q = mag_malloc(len - power_len + 1);
+	uint32_t *r = mag_malloc(power_len);
+	mag_divmod(limbs, len, powers[k].limbs, power_len, q, r);
+
+	decimal_write(q, mag_trim(q, len - power_len + 1), out, width - digits);
+	decimal_write(r, mag_trim(r, power_len), out + width - digits, digits);
+
+	free(q);
+	free(r);
+}
@@ -0,0 +1,151 @@
+#include "buffer.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+void buffer_reserve(buffer_t *buffer, int len);
+
+// ========================================
+// buffer.h - definition
+// ========================================
+
+buffer_t buffer_sink(FILE *sink) {
+	buffer_t buffer = {};
+	buffer.sink = sink;
+	buffer_reserve(&buffer, BUFFER_SINK_SIZE - 1);
+	return buffer;
+}
+
+void buffer_flush(buffer_t *buffer) {
+	if (buffer->sink == NULL || buffer->len == 0) return;
+
+	fwrite(buffer->data, 1, buffer->len, buffer->sink);
+	buffer->total += buffer->len;
+	buffer->len = 0;
+	buffer->data[0] = '\0';
+}
+
+void free_buffer(buffer_t *buffer) {
+	buffer_flush(buffer);
+	if (buffer->sink) fflush(buffer->sink);
+
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->len = buffer->cap = 0;
+}
+
+void buffer_append(buffer_t *buffer, const char *str, int len) {
+	if (len < 0) len = strlen(str);
+	buffer_reserve(buffer, len);
+
+	memcpy(buffer->data + buffer->len, str, len);
+	buffer->len += len;
+	buffer->data[buffer->len] = '\0';
+}
+
+void buffer_fill(buffer_t *buffer, char ch, int count) {
+	if (count <= 0) return;
+	buffer_reserve(buffer, count);
+
+	memset(buffer->data + buffer->len, ch, count);
+	buffer->len += count;
+	buffer->data[buffer->len] = '\0';
+}
+
+void buffer_int(buffer_t *buffer, int64_t value) {
+	// Digits are produced from the last one; the magnitude is taken as
+	// unsigned so INT64_MIN does not overflow
+	char digits[24];
+	int at = sizeof(digits);
+	uint64_t magnitude = value < 0 ? -(uint64_t) value : (uint64_t) value;
+
+	do {
+		digits[--at] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while (magnitude);
+	if (value < 0) digits[--at] = '-';
+
+	buffer_append(buffer, digits + at, sizeof(digits) - at);
+}
+
+void buffer_hex(buffer_t *buffer, uint64_t value, int digits) {
+	char hex[24];
+	int at = sizeof(hex);
+
+	do {
+		hex[--at] = "0123456789abcdef"[value & 15];
+		value >>= 4;
+		digits--;
+	} while (value || digits > 0);
+	hex[--at] = 'x';
+	hex[--at] = '0';
+
+	buffer_append(buffer, hex + at, sizeof(hex) - at);
+}
+
+void buffer_printf(buffer_t *buffer, const char *format, ...) {
+	va_list args, copy;
+	va_start(args, format);
+	va_copy(copy, args);
+	int len = vsnprintf(NULL, 0, format, copy);
+	va_end(copy);
+
+	buffer_reserve(buffer, len);
+	vsnprintf(buffer->data + buffer->len, len + 1, format, args);
+	buffer->len += len;
+	va_end(args);
+}
+
+void buffer_string(buffer_t *buffer, const char *str, int len) {
+	buffer_append(buffer, "\"", 1);
+
+	// Runs of characters that need no escaping are copied at once
+	int from = 0;
+	for (int i = 0; i < len; i++) {
+		unsigned char ch = str[i];
+		if (ch != '"' && ch != '\\' && ch >= 0x20) continue;
+
+		buffer_append(buffer, str + from, i - from);
+		from = i + 1;
+
+		if (ch == '"' || ch == '\\') {
+			char escaped[2] = {'\\', ch};
+			buffer_append(buffer, escaped, 2);
+		}
+		else {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", ch);
+			buffer_append(buffer, escaped, 6);
+		}
+	}
+	buffer_append(buffer, str + from, len - from);
+
+	buffer_append(buffer, "\"", 1);
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+void buffer_reserve(buffer_t *buffer, int len) {
+	if (buffer->len + len + 1 <= buffer->cap) return;
+
+	// A sink is emptied first; it only grows for a single oversized append
+	buffer_flush(buffer);
+	if (buffer->len + len + 1 <= buffer->cap) return;
+
+	int cap = buffer->cap ? buffer->cap : 256;
+	while (buffer->len + len + 1 > cap) cap *= 2;
+
+	buffer->data = realloc(buffer->data, cap);
+	if (buffer->data == NULL) {
+		perror("Error in buffer_reserve with realloc");
+		exit(1);
+	}
+	buffer->cap = cap;
+}
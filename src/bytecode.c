@@ -0,0 +1,260 @@
+#include "bytecode.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+#define BYTECODE_STR(x) #x
+#define BYTECODE_XSTR(x) BYTECODE_STR(x)
+
+// Everything the generated code depends on besides the source; the whole
+// compiler is built at once, so the build time changes with any of it
+#define BYTECODE_BUILD "lemon bytecode " BYTECODE_XSTR(BYTECODE_VERSION) \
+	" " __DATE__ " " __TIME__
+
+uint64_t bytecode_hash(uint64_t hash, const char *data, size_t len);
+const char *bytecode_check(ir_prog_t *ir, ir_t *ip);
+int bytecode_reg(ir_prog_t *ir, int32_t reg);
+int bytecode_const(ir_prog_t *ir, int32_t index);
+int bytecode_target(ir_prog_t *ir, int32_t target);
+int bytecode_slot(ir_prog_t *ir, int32_t offset, int32_t size);
+
+// ========================================
+// bytecode.h - definition
+// ========================================
+
+int is_bytecode(file_t file) {
+	return file.len >= 4 && memcmp(file.src, BYTECODE_MAGIC, 4) == 0;
+}
+
+ir_prog_t *load_bytecode(file_t file, uint64_t *key, const char **error) {
+	bytecode_header_t header;
+	if (file.len < sizeof(header)) {
+		*error = "File is too short";
+		return NULL;
+	}
+	memcpy(&header, file.src, sizeof(header));
+
+	if (memcmp(header.magic, BYTECODE_MAGIC, 4) != 0) {
+		*error = "Not a bytecode file";
+		return NULL;
+	}
+	if (header.version != BYTECODE_VERSION) {
+		*error = "Unsupported bytecode version";
+		return NULL;
+	}
+	if (header.total_regs < 1 || header.total_consts < 0 ||
+		header.total_code < 0 || header.global_size < 0 ||
+		header.global_size > INT32_MAX) {
+		*error = "Damaged header";
+		return NULL;
+	}
+
+	size_t consts_size = (size_t) header.total_consts * sizeof(int64_t);
+	size_t code_size = (size_t) header.total_code * sizeof(ir_t);
+	if (file.len != sizeof(header) + consts_size + code_size) {
+		*error = "File size does not match the header";
+		return NULL;
+	}
+
+	ir_prog_t *ir = malloc(sizeof(ir_prog_t));
+	if (ir == NULL) {
+		perror("Error in load_bytecode with malloc");
+		exit(1);
+	}
+
+	// The mapping is page aligned, and the header keeps the constants
+	// aligned to 8 bytes
+	const char *data = file.src + sizeof(header);
+	ir->total_regs = header.total_regs;
+	ir->global_size = header.global_size;
+	ir->consts = (int64_t *) data;
+	ir->total_consts = header.total_consts;
+	ir->code = (ir_t *) (data + consts_size);
+	ir->total_code = header.total_code;
+	ir->file = file;
+
+	// The vm trusts every index in the code
+	for (int i = 0; i < ir->total_code; i++) {
+		*error = bytecode_check(ir, &ir->code[i]);
+		if (*error) {
+			free(ir);
+			return NULL;
+		}
+	}
+
+	if (key) *key = header.key;
+	return ir;
+}
+
+int write_bytecode(ir_prog_t *ir, uint64_t key, const char *path) {
+	bytecode_header_t header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BYTECODE_MAGIC, 4);
+	header.version = BYTECODE_VERSION;
+	header.key = key;
+	header.global_size = ir->global_size;
+	header.total_regs = ir->total_regs;
+	header.total_consts = ir->total_consts;
+	header.total_code = ir->total_code;
+
+	size_t len = strlen(path) + 32;
+	char *tmp = malloc(len);
+	if (tmp == NULL) {
+		perror("Error in write_bytecode with malloc");
+		exit(1);
+	}
+	snprintf(tmp, len, "%s.%ld.tmp", path, (long) getpid());
+
+	FILE *fd = fopen(tmp, "wb");
+	if (fd == NULL) {
+		free(tmp);
+		return -1;
+	}
+
+	int ok = fwrite(&header, sizeof(header), 1, fd) == 1;
+	if (ok && ir->total_consts) {
+		ok = fwrite(ir->consts, sizeof(int64_t), ir->total_consts, fd) ==
+			(size_t) ir->total_consts;
+	}
+	if (ok && ir->total_code) {
+		ok = fwrite(ir->code, sizeof(ir_t), ir->total_code, fd) ==
+			(size_t) ir->total_code;
+	}
+	if (fclose(fd) != 0) ok = 0;
+	if (ok && rename(tmp, path) != 0) ok = 0;
+
+	if (!ok) unlink(tmp);
+	free(tmp);
+	return ok ? 0 : -1;
+}
+
+uint64_t bytecode_key(file_t file, int opt_level, int keep_globals) {
+	int options[2] = {opt_level, keep_globals};
+	uint64_t hash = bytecode_hash(0, BYTECODE_BUILD, strlen(BYTECODE_BUILD));
+	hash = bytecode_hash(hash, (const char *) options, sizeof(options));
+	return bytecode_hash(hash, file.src, file.len);
+}
+
+char *bytecode_cache_path(const char *dir, uint64_t key) {
+	size_t len = strlen(dir) + 32;
+	char *path = malloc(len);
+	if (path == NULL) {
+		perror("Error in bytecode_cache_path with malloc");
+		exit(1);
+	}
+	snprintf(path, len, "%s/%016llx.lbc", dir, (unsigned long long) key);
+	return path;
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+uint64_t bytecode_hash(uint64_t hash, const char *data, size_t len) {
+	// 8 bytes at a time, then the rest together with the length, so data
+	// ending in zeros hashes differently from shorter data
+	const uint64_t mul = 0x9e3779b97f4a7c15;
+	size_t total = len;
+
+	for (; len >= 8; data += 8, len -= 8) {
+		uint64_t word;
+		memcpy(&word, data, 8);
+		hash = (hash ^ word) * mul;
+		hash ^= hash >> 29;
+	}
+
+	uint64_t word = 0;
+	memcpy(&word, data, len);
+	hash = (hash ^ word ^ ((uint64_t) total << 3)) * mul;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+const char *bytecode_check(ir_prog_t *ir, ir_t *ip) {
+	// Every register, constant, target and global slot an instruction
+	// uses must be in the program
+	int ok = 1;
+
+	switch (ip->type) {
+	case IR_NOP:
+		break;
+	case IR_GLOBAL_LOAD_CONST:
+		ok = (ip->arg2 == 1 || ip->arg2 == 2 || ip->arg2 == 4 ||
+			ip->arg2 == 8) && bytecode_slot(ir, ip->arg1, ip->arg2) &&
+			bytecode_const(ir, ip->arg3);
+		break;
+	case IR_STORE8: case IR_STORE16: case IR_STORE32: case IR_STORE64:
+		ok = bytecode_slot(ir, ip->arg1, 1 << (ip->type - IR_STORE8)) &&
+			bytecode_reg(ir, ip->arg2);
+		break;
+	case IR_STORE_INT:
+		ok = bytecode_slot(ir, ip->arg1, 8) && bytecode_reg(ir, ip->arg2);
+		break;
+	case IR_LOAD8: case IR_LOAD16: case IR_LOAD32: case IR_LOAD64:
+		ok = bytecode_reg(ir, ip->arg1) &&
+			bytecode_slot(ir, ip->arg2, 1 << (ip->type - IR_LOAD8));
+		break;
+	case IR_ADD: case IR_SUB:
+	case IR_LT: case IR_LE: case IR_GT:
+	case IR_GE: case IR_EQ: case IR_NE:
+		ok = bytecode_reg(ir, ip->arg1) && bytecode_reg(ir, ip->arg2) &&
+			bytecode_reg(ir, ip->arg3);
+		break;
+	case IR_PRINT:
+		ok = bytecode_reg(ir, ip->arg1);
+		break;
+	case IR_JMP_TRUE: case IR_JMP_FALSE:
+		ok = bytecode_reg(ir, ip->arg1) && bytecode_target(ir, ip->arg2);
+		break;
+	case IR_JMP:
+		ok = bytecode_target(ir, ip->arg1);
+		break;
+	case IR_LOAD_CONST:
+		ok = bytecode_reg(ir, ip->arg1) && bytecode_const(ir, ip->arg2);
+		break;
+	case IR_NOT: case IR_MOV:
+	case IR_WRAP8: case IR_WRAP16: case IR_WRAP32: case IR_WRAP64:
+		ok = bytecode_reg(ir, ip->arg1) && bytecode_reg(ir, ip->arg2);
+		break;
+	case IR_JLT: case IR_JLE: case IR_JGT:
+	case IR_JGE: case IR_JEQ: case IR_JNE:
+		ok = bytecode_reg(ir, ip->arg1) && bytecode_reg(ir, ip->arg2) &&
+			bytecode_target(ir, ip->arg3);
+		break;
+	case IR_JLTI: case IR_JLEI: case IR_JGTI:
+	case IR_JGEI: case IR_JEQI: case IR_JNEI:
+		ok = bytecode_reg(ir, ip->arg1) && bytecode_const(ir, ip->arg2) &&
+			bytecode_target(ir, ip->arg3);
+		break;
+	default:
+		return "Unknown instruction";
+	}
+
+	return ok ? NULL : "Instruction argument out of range";
+}
+
+int bytecode_reg(ir_prog_t *ir, int32_t reg) {
+	return reg >= 0 && reg < ir->total_regs;
+}
+
+int bytecode_const(ir_prog_t *ir, int32_t index) {
+	return index >= 0 && index < ir->total_consts;
+}
+
+int bytecode_target(ir_prog_t *ir, int32_t target) {
+	// Jumping to the end stops the program
+	return target >= 0 && target <= ir->total_code;
+}
+
+int bytecode_slot(ir_prog_t *ir, int32_t offset, int32_t size) {
+	// Slots are aligned to their size, which the collection of the vm
+	// relies on for the 8 byte ones
+	return offset >= 0 && offset % size == 0 &&
+		(int64_t) offset + size <= ir->global_size;
+}
@@ -0,0 +1,299 @@
+#include "cfg.h"
+#include "dataflow.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+void cfg_split(cfg_t *cfg, arena_t *arena);
+void cfg_link(cfg_t *cfg, arena_t *arena);
+void cfg_order(cfg_t *cfg, arena_t *arena);
+void cfg_dominators(cfg_t *cfg);
+int cfg_intersect(cfg_t *cfg, int a, int b);
+void print_cfg_blocks(buffer_t *out, const char *title, int *blocks,
+	int total);
+void print_cfg_set(buffer_t *out, const char *title, uint64_t *set,
+	int total_bits, int32_t *names, const char *prefix);
+
+// ========================================
+// cfg.h - definition
+// ========================================
+
+cfg_t *build_cfg(ir_prog_t *ir, arena_t *arena) {
+	cfg_t *cfg = arena_alloc(arena, sizeof(cfg_t));
+	memset(cfg, 0, sizeof(cfg_t));
+	cfg->ir = ir;
+
+	cfg_split(cfg, arena);
+	cfg_link(cfg, arena);
+	cfg_order(cfg, arena);
+	cfg_dominators(cfg);
+	return cfg;
+}
+
+int cfg_dominates(cfg_t *cfg, int a, int b) {
+	if (cfg->blocks[a].order < 0 || cfg->blocks[b].order < 0) return 0;
+
+	// Walk up the dominator tree from b; the entry is the root
+	while (b != a && b != 0) b = cfg->blocks[b].idom;
+	return b == a;
+}
+
+void print_cfg(cfg_t *cfg, buffer_t *out) {
+	arena_t arena = {};
+	liveness_t *live = liveness(cfg, &arena);
+	reaching_t *reach = reaching_defs(cfg, &arena);
+
+	buffer_append(out, "========== CONTROL FLOW GRAPH ==========\n", -1);
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+
+		buffer_append(out, "block ", -1);
+		buffer_int(out, i);
+		buffer_append(out, " | ", 3);
+		buffer_hex(out, block->start, 9);
+		buffer_append(out, "..", 2);
+		buffer_hex(out, block->end - 1, 9);
+		buffer_append(out, " | idom: ", -1);
+		if (block->order < 0) buffer_append(out, "unreachable", -1);
+		else buffer_int(out, block->idom);
+		buffer_append(out, "\n", 1);
+
+		print_cfg_blocks(out, "preds", block->preds, block->total_preds);
+		print_cfg_blocks(out, "succs", block->succs, block->total_succs);
+
+		dataflow_t *flow = live->flow;
+		print_cfg_set(out, "live in", dataflow_set(flow, flow->in, i),
+			flow->total_bits, live->regs, "r");
+		print_cfg_set(out, "live out", dataflow_set(flow, flow->out, i),
+			flow->total_bits, live->regs, "r");
+
+		flow = reach->flow;
+		print_cfg_set(out, "reaching", dataflow_set(flow, flow->in, i),
+			flow->total_bits, reach->defs, "@");
+	}
+	buffer_flush(out);
+
+	arena_free(&arena);
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+void cfg_split(cfg_t *cfg, arena_t *arena) {
+	// A block starts at the first instruction, at every jump target and
+	// after every jump
+	ir_prog_t *ir = cfg->ir;
+	int n = ir->total_code;
+
+	cfg->block_of = arena_alloc(arena, (n + 1) * sizeof(int));
+	int *leader = cfg->block_of;
+	memset(leader, 0, (n + 1) * sizeof(int));
+	if (n > 0) leader[0] = 1;
+
+	for (int i = 0; i < n; i++) {
+		int32_t *target = ir_target(&ir->code[i]);
+		if (target == NULL) continue;
+		leader[*target] = 1;
+		leader[i + 1] = 1;
+	}
+
+	int total = 0;
+	for (int i = 0; i < n; i++) total += leader[i];
+
+	cfg->total_blocks = total;
+	cfg->blocks = arena_alloc(arena, (total + 1) * sizeof(cfg_block_t));
+	memset(cfg->blocks, 0, (total + 1) * sizeof(cfg_block_t));
+
+	// The leader marks become the block of every instruction
+	int block = -1;
+	for (int i = 0; i < n; i++) {
+		if (leader[i]) {
+			if (block >= 0) cfg->blocks[block].end = i;
+			cfg->blocks[++block].start = i;
+		}
+		cfg->block_of[i] = block;
+	}
+	if (block >= 0) cfg->blocks[block].end = n;
+	cfg->block_of[n] = -1;
+}
+
+void cfg_link(cfg_t *cfg, arena_t *arena) {
+	ir_prog_t *ir = cfg->ir;
+	int n = ir->total_code;
+
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+		ir_t *last = &ir->code[block->end - 1];
+		int32_t *target = ir_target(last);
+
+		// Jumping to the end leaves the code like falling off it
+		if (target && *target < n) {
+			block->succs[block->total_succs++] = cfg->block_of[*target];
+		}
+		if (last->type != IR_JMP && block->end < n) {
+			int next = cfg->block_of[block->end];
+			if (block->total_succs == 0 || block->succs[0] != next) {
+				block->succs[block->total_succs++] = next;
+			}
+		}
+	}
+
+	// The predecessors of every block are slices of one array
+	int total_preds = 0;
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+		for (int j = 0; j < block->total_succs; j++) {
+			cfg->blocks[block->succs[j]].total_preds++;
+			total_preds++;
+		}
+	}
+
+	int *preds = arena_alloc(arena, (total_preds + 1) * sizeof(int));
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+		block->preds = preds;
+		preds += block->total_preds;
+		block->total_preds = 0;
+	}
+
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+		for (int j = 0; j < block->total_succs; j++) {
+			cfg_block_t *succ = &cfg->blocks[block->succs[j]];
+			succ->preds[succ->total_preds++] = i;
+		}
+	}
+}
+
+void cfg_order(cfg_t *cfg, arena_t *arena) {
+	// Depth first from the entry with an explicit stack of blocks and the
+	// next successor of each to visit
+	int total = cfg->total_blocks;
+	cfg->order = arena_alloc(arena, (total + 1) * sizeof(int));
+	cfg->total_order = 0;
+
+	for (int i = 0; i < total; i++) {
+		cfg->blocks[i].order = -1;
+		cfg->blocks[i].idom = -1;
+	}
+	if (total == 0) return;
+
+	int *stack = malloc(total * sizeof(int));
+	int *next = malloc(total * sizeof(int));
+	if (stack == NULL || next == NULL) {
+		perror("Error in cfg_order with malloc");
+		exit(1);
+	}
+
+	// order is the visited mark until the final positions are known
+	int top = 0, postorder = 0;
+	stack[top++] = 0;
+	next[0] = 0;
+	cfg->blocks[0].order = 0;
+
+	while (top > 0) {
+		int block = stack[top - 1];
+		cfg_block_t *cur = &cfg->blocks[block];
+
+		if (next[block] < cur->total_succs) {
+			int succ = cur->succs[next[block]++];
+			if (cfg->blocks[succ].order < 0) {
+				cfg->blocks[succ].order = 0;
+				next[succ] = 0;
+				stack[top++] = succ;
+			}
+			continue;
+		}
+
+		cfg->order[postorder++] = block;
+		top--;
+	}
+
+	for (int i = 0, j = postorder - 1; i < j; i++, j--) {
+		int tmp = cfg->order[i];
+		cfg->order[i] = cfg->order[j];
+		cfg->order[j] = tmp;
+	}
+	cfg->total_order = postorder;
+	for (int i = 0; i < postorder; i++) {
+		cfg->blocks[cfg->order[i]].order = i;
+	}
+
+	free(stack);
+	free(next);
+}
+
+void cfg_dominators(cfg_t *cfg) {
+	// Cooper, Harvey and Kennedy: the dominator of a block is where the
+	// dominators of its processed predecessors meet, until nothing changes
+	if (cfg->total_order == 0) return;
+	cfg->blocks[0].idom = 0;
+
+	int changed = 1;
+	while (changed) {
+		changed = 0;
+
+		for (int i = 1; i < cfg->total_order; i++) {
+			int block = cfg->order[i];
+			cfg_block_t *cur = &cfg->blocks[block];
+
+			int idom = -1;
+			for (int j = 0; j < cur->total_preds; j++) {
+				int pred = cur->preds[j];
+				if (cfg->blocks[pred].idom < 0) continue;
+				idom = idom < 0 ? pred : cfg_intersect(cfg, pred, idom);
+			}
+
+			if (cur->idom != idom) {
+				cur->idom = idom;
+				changed = 1;
+			}
+		}
+	}
+}
+
+int cfg_intersect(cfg_t *cfg, int a, int b) {
+	while (a != b) {
+		while (cfg->blocks[a].order > cfg->blocks[b].order) {
+			a = cfg->blocks[a].idom;
+		}
+		while (cfg->blocks[b].order > cfg->blocks[a].order) {
+			b = cfg->blocks[b].idom;
+		}
+	}
+	return a;
+}
+
+void print_cfg_blocks(buffer_t *out, const char *title, int *blocks,
+	int total) {
+	buffer_append(out, "\t", 1);
+	buffer_append(out, title, -1);
+	buffer_append(out, ":", 1);
+	for (int i = 0; i < total; i++) {
+		buffer_append(out, " ", 1);
+		buffer_int(out, blocks[i]);
+	}
+	buffer_append(out, "\n", 1);
+}
+
+void print_cfg_set(buffer_t *out, const char *title, uint64_t *set,
+	int total_bits, int32_t *names, const char *prefix) {
+	// Registers are printed as r<register> and definitions as
+	// @<instruction>
+	buffer_append(out, "\t", 1);
+	buffer_append(out, title, -1);
+	buffer_append(out, ":", 1);
+	for (int i = 0; i < total_bits; i++) {
+		if (!dataflow_has(set, i)) continue;
+		buffer_append(out, " ", 1);
+		buffer_append(out, prefix, -1);
+		buffer_int(out, names[i]);
+	}
+	buffer_append(out, "\n", 1);
+}
@@ -0,0 +1,280 @@
+#include "dataflow.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+int dataflow_meet(dataflow_t *flow, int block, uint64_t *set);
+int *dataflow_globals(cfg_t *cfg, int *total, arena_t *arena);
+
+// ========================================
+// dataflow.h - definition
+// ========================================
+
+dataflow_t *dataflow_create(cfg_t *cfg, int total_bits, int forward,
+	int intersect, arena_t *arena) {
+	dataflow_t *flow = arena_alloc(arena, sizeof(dataflow_t));
+	flow->cfg = cfg;
+	flow->forward = forward;
+	flow->intersect = intersect;
+	flow->total_bits = total_bits;
+	flow->words = (total_bits + 63) / 64;
+
+	size_t size = ((size_t) cfg->total_blocks * flow->words + 1) *
+		sizeof(uint64_t);
+	flow->gen = arena_alloc(arena, size);
+	flow->kill = arena_alloc(arena, size);
+	flow->in = arena_alloc(arena, size);
+	flow->out = arena_alloc(arena, size);
+	memset(flow->gen, 0, size);
+	memset(flow->kill, 0, size);
+	memset(flow->in, 0, size);
+	memset(flow->out, 0, size);
+	return flow;
+}
+
+void dataflow_solve(dataflow_t *flow) {
+	cfg_t *cfg = flow->cfg;
+	int words = flow->words;
+
+	// The border a block computes, and the one it meets from its
+	// neighbours
+	uint64_t *result = flow->forward ? flow->out : flow->in;
+	uint64_t *meet = flow->forward ? flow->in : flow->out;
+
+	// With intersection everything but the borders of the code starts
+	// full, so a loop does not lose what flows into it
+	if (flow->intersect) {
+		for (int i = 0; i < cfg->total_order; i++) {
+			int block = cfg->order[i];
+			uint64_t *set = dataflow_set(flow, result, block);
+			for (int j = 0; j < words; j++) set[j] = ~(uint64_t) 0;
+		}
+	}
+
+	uint64_t *tmp = malloc((words + 1) * sizeof(uint64_t));
+	if (tmp == NULL) {
+		perror("Error in dataflow_solve with malloc");
+		exit(1);
+	}
+
+	int changed = 1;
+	while (changed) {
+		changed = 0;
+
+		for (int i = 0; i < cfg->total_order; i++) {
+			int block = flow->forward ? cfg->order[i] :
+				cfg->order[cfg->total_order - 1 - i];
+
+			uint64_t *in = dataflow_set(flow, meet, block);
+			if (dataflow_meet(flow, block, tmp)) {
+				memcpy(in, tmp, words * sizeof(uint64_t));
+			}
+
+			uint64_t *gen = dataflow_set(flow, flow->gen, block);
+			uint64_t *kill = dataflow_set(flow, flow->kill, block);
+			uint64_t *out = dataflow_set(flow, result, block);
+			for (int j = 0; j < words; j++) {
+				uint64_t word = gen[j] | (in[j] & ~kill[j]);
+				if (word != out[j]) {
+					out[j] = word;
+					changed = 1;
+				}
+			}
+		}
+	}
+
+	free(tmp);
+}
+
+uint64_t *dataflow_set(dataflow_t *flow, uint64_t *sets, int block) {
+	return sets + (size_t) block * flow->words;
+}
+
+int dataflow_has(uint64_t *set, int bit) {
+	return (set[bit >> 6] >> (bit & 63)) & 1;
+}
+
+void dataflow_add(uint64_t *set, int bit) {
+	set[bit >> 6] |= (uint64_t) 1 << (bit & 63);
+}
+
+void dataflow_remove(uint64_t *set, int bit) {
+	set[bit >> 6] &= ~((uint64_t) 1 << (bit & 63));
+}
+
+liveness_t *liveness(cfg_t *cfg, arena_t *arena) {
+	ir_prog_t *ir = cfg->ir;
+	liveness_t *live = arena_alloc(arena, sizeof(liveness_t));
+
+	int total = 0;
+	live->bit_of = dataflow_globals(cfg, &total, arena);
+	live->regs = arena_alloc(arena, (total + 1) * sizeof(int32_t));
+	for (int i = 0; i < ir->total_regs; i++) {
+		if (live->bit_of[i] >= 0) live->regs[live->bit_of[i]] = i;
+	}
+
+	// A block needs what it reads before writing, and does not need
+	// from before what it writes
+	dataflow_t *flow = dataflow_create(cfg, total, 0, 0, arena);
+	live->flow = flow;
+
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+		uint64_t *gen = dataflow_set(flow, flow->gen, i);
+		uint64_t *kill = dataflow_set(flow, flow->kill, i);
+
+		for (int j = block->end - 1; j >= block->start; j--) {
+			ir_t *ip = &ir->code[j];
+
+			int32_t def = ir_def(ip);
+			if (def >= 0 && live->bit_of[def] >= 0) {
+				dataflow_add(kill, live->bit_of[def]);
+				dataflow_remove(gen, live->bit_of[def]);
+			}
+
+			int32_t uses[3];
+			int total_uses = ir_uses(ip, uses);
+			for (int k = 0; k < total_uses; k++) {
+				if (live->bit_of[uses[k]] >= 0) {
+					dataflow_add(gen, live->bit_of[uses[k]]);
+				}
+			}
+		}
+	}
+
+	dataflow_solve(flow);
+	return live;
+}
+
+reaching_t *reaching_defs(cfg_t *cfg, arena_t *arena) {
+	ir_prog_t *ir = cfg->ir;
+	reaching_t *reach = arena_alloc(arena, sizeof(reaching_t));
+
+	int total_globals = 0;
+	int *global = dataflow_globals(cfg, &total_globals, arena);
+
+	// Definitions of every register, grouped by register, so a block can
+	// kill all the others of a register it defines
+	int *first = arena_alloc(arena, (ir->total_regs + 1) * sizeof(int));
+	memset(first, 0, (ir->total_regs + 1) * sizeof(int));
+
+	reach->bit_of = arena_alloc(arena, (ir->total_code + 1) * sizeof(int));
+	int total = 0;
+	for (int i = 0; i < ir->total_code; i++) {
+		int32_t def = ir_def(&ir->code[i]);
+		reach->bit_of[i] = -1;
+		if (def < 0 || global[def] < 0) continue;
+		first[def + 1]++;
+		total++;
+	}
+	for (int i = 0; i < ir->total_regs; i++) first[i + 1] += first[i];
+
+	int *next = arena_alloc(arena, (ir->total_regs + 1) * sizeof(int));
+	memcpy(next, first, (ir->total_regs + 1) * sizeof(int));
+	reach->defs = arena_alloc(arena, (total + 1) * sizeof(int));
+	for (int i = 0; i < ir->total_code; i++) {
+		int32_t def = ir_def(&ir->code[i]);
+		if (def < 0 || global[def] < 0) continue;
+		reach->bit_of[i] = next[def];
+		reach->defs[next[def]++] = i;
+	}
+
+	// The last definition of a register in a block reaches its end, and
+	// the block kills every definition of it
+	dataflow_t *flow = dataflow_create(cfg, total, 1, 0, arena);
+	reach->flow = flow;
+
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+		uint64_t *gen = dataflow_set(flow, flow->gen, i);
+		uint64_t *kill = dataflow_set(flow, flow->kill, i);
+
+		for (int j = block->start; j < block->end; j++) {
+			int bit = reach->bit_of[j];
+			if (bit < 0) continue;
+
+			int32_t def = ir_def(&ir->code[j]);
+			for (int k = first[def]; k < first[def + 1]; k++) {
+				dataflow_add(kill, k);
+				dataflow_remove(gen, k);
+			}
+			dataflow_add(gen, bit);
+		}
+	}
+
+	dataflow_solve(flow);
+	return reach;
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+int dataflow_meet(dataflow_t *flow, int block, uint64_t *set) {
+	// Meet the borders of the neighbours into set; returns 0 if the block
+	// has none, so its border keeps what it was created with
+	cfg_t *cfg = flow->cfg;
+	cfg_block_t *cur = &cfg->blocks[block];
+	uint64_t *sets = flow->forward ? flow->out : flow->in;
+	int *next = flow->forward ? cur->preds : cur->succs;
+	int total = flow->forward ? cur->total_preds : cur->total_succs;
+	int found = 0;
+
+	for (int i = 0; i < total; i++) {
+		// Unreachable predecessors flow nothing
+		if (cfg->blocks[next[i]].order < 0) continue;
+		uint64_t *other = dataflow_set(flow, sets, next[i]);
+
+		for (int j = 0; j < flow->words; j++) {
+			if (!found) set[j] = other[j];
+			else if (flow->intersect) set[j] &= other[j];
+			else set[j] |= other[j];
+		}
+		found = 1;
+	}
+
+	return found;
+}
+
+int *dataflow_globals(cfg_t *cfg, int *total, arena_t *arena) {
+	// A register read in a block that did not write it first can be live
+	// across blocks; every other register lives inside one block. seen
+	// holds the last block that wrote a register, plus one
+	ir_prog_t *ir = cfg->ir;
+	int *bit_of = arena_alloc(arena, (ir->total_regs + 1) * sizeof(int));
+	int *seen = calloc(ir->total_regs + 1, sizeof(int));
+	if (seen == NULL) {
+		perror("Error in dataflow_globals with calloc");
+		exit(1);
+	}
+
+	for (int i = 0; i < ir->total_regs; i++) bit_of[i] = -1;
+	*total = 0;
+
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+		for (int j = block->start; j < block->end; j++) {
+			ir_t *ip = &ir->code[j];
+
+			int32_t uses[3];
+			int total_uses = ir_uses(ip, uses);
+			for (int k = 0; k < total_uses; k++) {
+				int32_t reg = uses[k];
+				if (seen[reg] != i + 1 && bit_of[reg] < 0) {
+					bit_of[reg] = (*total)++;
+				}
+			}
+
+			int32_t def = ir_def(ip);
+			if (def >= 0) seen[def] = i + 1;
+		}
+	}
+
+	free(seen);
+	return bit_of;
+}
@@ -0,0 +1,694 @@
+#include "document.h"
+#include "token.h"
+#include "ast.h"
+#include "analyze.h"
+#include "intern.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+// Name a statement declares or uses; the position is relative to the
+// start of the statement so it survives edits before it
+typedef struct {
+	int sym;
+	pos_t start;
+	pos_t end;
+} doc_name_t;
+
+typedef struct doc_stmt_t doc_stmt_t;
+
+// Top-level statement, or the span skipped after a statement that did not
+// parse
+struct doc_stmt_t {
+	// Statements before the gap of the document are kept as offsets from
+	// the start of the text, the ones after it as offsets from the end of
+	// the text; edits happen at the gap so neither has to be shifted.
+	// A statement the edit cut into can end up before the start of the
+	// text, so the offsets are read back as ints (see doc_start)
+	int tail;
+	pos_t start;
+	pos_t end;
+
+	doc_name_t declares;
+	doc_name_t *uses;
+	int total_uses;
+
+	// Error of the statement on its own (syntax or semantic), and error
+	// against the globals declared by the other statements
+	int has_error;
+	diagnostic_t error;
+	int has_name_error;
+	diagnostic_t name_error;
+
+	int dead;
+	int stamp;
+	int in_errors;
+	doc_stmt_t *error_prev;
+	doc_stmt_t *error_next;
+};
+
+typedef struct {
+	// Statements declaring or using the symbol, in no particular order;
+	// removed statements are dropped in one pass at the end of the edit
+	doc_stmt_t **refs;
+	int total_refs;
+	int refs_cap;
+	int removed;
+
+	doc_stmt_t *first_decl;
+
+	// Declarations added minus removed by the current edit
+	int decl_delta;
+	int touched;
+	int stamp;
+} doc_sym_t;
+
+struct document_t {
+	char *filepath;
+
+	char *text;
+	int len;
+	int cap;
+
+	// Offset where each line starts
+	int *lines;
+	int total_lines;
+	int lines_cap;
+
+	doc_stmt_t **stmts;
+	int count;
+	int stmts_cap;
+	int gap;
+
+	// Indexed by symbol id
+	doc_sym_t *syms;
+	int total_syms;
+
+	// Statements parsed by the current edit
+	doc_stmt_t **fresh;
+	int total_fresh;
+	int fresh_cap;
+
+	int *touched;
+	int total_touched;
+	int touched_cap;
+
+	doc_stmt_t **queue;
+	int total_queue;
+	int queue_cap;
+	int stamp;
+
+	doc_stmt_t *errors;
+	diagnostic_t *diagnostics;
+	int diagnostics_cap;
+};
+
+void *doc_reserve(void *array, int *cap, int need, int size);
+int doc_start(document_t *doc, doc_stmt_t *stmt);
+int doc_end(document_t *doc, doc_stmt_t *stmt);
+int doc_find(document_t *doc, int pos);
+void doc_move_gap(document_t *doc, int index);
+void doc_replace_text(document_t *doc, int start, int end, const char *text,
+	int len);
+void doc_replace_lines(document_t *doc, int start, int end, const char *text,
+	int len);
+
+int doc_reparse(document_t *doc, int index, int from, int keep_from);
+int doc_parse_stmt(tokens_t *tokens, arena_t *arena, ast_t **stmt);
+pos_t doc_skip_space(document_t *doc, pos_t pos);
+pos_t doc_skip_stmt(document_t *doc, pos_t pos);
+doc_stmt_t *doc_stmt_create(document_t *doc, tokens_t *tokens, ast_t *stmt);
+doc_stmt_t *doc_stmt_failed(document_t *doc, pos_t start, diagnostic_t error);
+void doc_stmt_free(doc_stmt_t *stmt);
+
+void doc_splice(document_t *doc, int index, int next);
+doc_sym_t *doc_sym(document_t *doc, int sym);
+void doc_index(document_t *doc, doc_stmt_t *stmt, int add);
+void doc_touch(document_t *doc, int sym, int decl_delta);
+void doc_queue(document_t *doc, doc_stmt_t *stmt);
+void doc_check(document_t *doc, doc_stmt_t *stmt);
+void doc_link_error(document_t *doc, doc_stmt_t *stmt, int has_error);
+
+// ========================================
+// document.h - definition
+// ========================================
+
+document_t *document_open(const char *filepath, const char *text, int len) {
+	document_t *doc = calloc(1, sizeof(document_t));
+	if (doc == NULL) {
+		perror("Error in document_open with calloc");
+		exit(1);
+	}
+
+	doc->filepath = strdup(filepath);
+	doc->lines = doc_reserve(NULL, &doc->lines_cap, 1, sizeof(int));
+	doc->lines[0] = 0;
+	doc->total_lines = 1;
+	doc_replace_text(doc, 0, 0, text, len);
+
+	doc_splice(doc, 0, doc_reparse(doc, 0, 0, 0));
+	return doc;
+}
+
+void document_edit(document_t *doc, int start, int end, const char *text,
+	int len) {
+	if (start < 0) start = 0;
+	if (end > doc->len) end = doc->len;
+	if (start > end) start = end;
+
+	// The statement before the edit may have looked at the token after it
+	// (an if looks for an else), so it is parsed again too
+	int index = doc_find(doc, start);
+	if (index > 0) index--;
+	int from = index > 0 ? doc_start(doc, doc->stmts[index]) : 0;
+
+	// Statements from index on are now kept from the end of the text; the
+	// ones after the edit still have the right offsets after it
+	doc_move_gap(doc, index);
+	doc_replace_text(doc, start, end, text, len);
+	doc_splice(doc, index, doc_reparse(doc, index, from, start + len));
+}
+
+int document_offset(document_t *doc, int line, int column) {
+	if (line < 0) return 0;
+	if (line >= doc->total_lines) return doc->len;
+
+	int line_end = doc->len;
+	if (line + 1 < doc->total_lines) line_end = doc->lines[line + 1] - 1;
+
+	int offset = doc->lines[line] + (column > 0 ? column : 0);
+	return offset < line_end ? offset : line_end;
+}
+
+void document_position(document_t *doc, int offset, int *line, int *column) {
+	int lo = 0, hi = doc->total_lines - 1;
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (doc->lines[mid] <= offset) lo = mid;
+		else hi = mid - 1;
+	}
+
+	*line = lo;
+	*column = offset - doc->lines[lo];
+}
+
+int document_diagnostics(document_t *doc, diagnostic_t **diagnostics) {
+	int total = 0;
+	for (doc_stmt_t *cur = doc->errors; cur; cur = cur->error_next) {
+		doc->diagnostics = doc_reserve(doc->diagnostics,
+			&doc->diagnostics_cap, total + 1, sizeof(diagnostic_t));
+
+		diagnostic_t error = cur->has_error ? cur->error : cur->name_error;
+		error.start += doc_start(doc, cur);
+		error.end += doc_start(doc, cur);
+		doc->diagnostics[total++] = error;
+	}
+
+	*diagnostics = doc->diagnostics;
+	return total;
+}
+
+int document_reparsed(document_t *doc) {
+	return doc->total_fresh;
+}
+
+void document_close(document_t *doc) {
+	if (doc == NULL) return;
+
+	for (int i = 0; i < doc->count; i++) {
+		doc_stmt_free(doc->stmts[i]);
+	}
+	for (int i = 0; i < doc->total_syms; i++) {
+		free(doc->syms[i].refs);
+	}
+
+	free(doc->filepath);
+	free(doc->text);
+	free(doc->lines);
+	free(doc->stmts);
+	free(doc->syms);
+	free(doc->fresh);
+	free(doc->touched);
+	free(doc->queue);
+	free(doc->diagnostics);
+	free(doc);
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+void *doc_reserve(void *array, int *cap, int need, int size) {
+	if (need <= *cap) return array;
+
+	int new_cap = *cap ? *cap : 16;
+	while (new_cap < need) new_cap *= 2;
+
+	array = realloc(array, (size_t) new_cap * size);
+	if (array == NULL) {
+		perror("Error in doc_reserve with realloc");
+		exit(1);
+	}
+
+	*cap = new_cap;
+	return array;
+}
+
+int doc_start(document_t *doc, doc_stmt_t *stmt) {
+	return stmt->tail ? doc->len - stmt->start : stmt->start;
+}
+
+int doc_end(document_t *doc, doc_stmt_t *stmt) {
+	return stmt->tail ? doc->len - stmt->end : stmt->end;
+}
+
+int doc_find(document_t *doc, int pos) {
+	// First statement ending at or after pos
+	int lo = 0, hi = doc->count;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (doc_end(doc, doc->stmts[mid]) < pos) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+void doc_move_gap(document_t *doc, int index) {
+	// Offsets from the start and from the end convert the same way
+	for (; doc->gap < index; doc->gap++) {
+		doc_stmt_t *stmt = doc->stmts[doc->gap];
+		stmt->start = doc->len - stmt->start;
+		stmt->end = doc->len - stmt->end;
+		stmt->tail = 0;
+	}
+
+	while (doc->gap > index) {
+		doc_stmt_t *stmt = doc->stmts[--doc->gap];
+		stmt->start = doc->len - stmt->start;
+		stmt->end = doc->len - stmt->end;
+		stmt->tail = 1;
+	}
+}
+
+void doc_replace_text(document_t *doc, int start, int end, const char *text,
+	int len) {
+	int new_len = doc->len - (end - start) + len;
+	doc->text = doc_reserve(doc->text, &doc->cap, new_len + 1, sizeof(char));
+
+	memmove(doc->text + start + len, doc->text + end, doc->len - end);
+	memcpy(doc->text + start, text, len);
+	doc->text[new_len] = '\0';
+
+	doc_replace_lines(doc, start, end, text, len);
+	doc->len = new_len;
+}
+
+void doc_replace_lines(document_t *doc, int start, int end, const char *text,
+	int len) {
+	// Lines starting inside (start, end] go away, the new text brings its
+	// own and the lines after it move by the change in length
+	int from = 1, to;
+	while (from < doc->total_lines && doc->lines[from] <= start) from++;
+	for (to = from; to < doc->total_lines && doc->lines[to] <= end; to++);
+
+	int added = 0;
+	for (int i = 0; i < len; i++) added += text[i] == '\n';
+
+	int total = doc->total_lines - (to - from) + added;
+	doc->lines = doc_reserve(doc->lines, &doc->lines_cap, total, sizeof(int));
+	memmove(doc->lines + from + added, doc->lines + to,
+		(doc->total_lines - to) * sizeof(int));
+
+	int line = from;
+	for (int i = 0; i < len; i++) {
+		if (text[i] == '\n') doc->lines[line++] = start + i + 1;
+	}
+
+	int delta = len - (end - start);
+	for (; line < total; line++) doc->lines[line] += delta;
+	doc->total_lines = total;
+}
+
+int doc_reparse(document_t *doc, int index, int from, int keep_from) {
+	// Parse from the statement at index until the new statements line up
+	// with an old one starting after the edit; the old statements from
+	// there on are unchanged
+	pos_t pos = from;
+	int next = index;
+	tokens_t *tokens = NULL;
+	doc->total_fresh = 0;
+
+	// Nodes of one statement at a time, including those of a failed parse
+	arena_t ast_arena = {};
+
+	for (;;) {
+		if (tokens == NULL) {
+			tokens = generate_tokens_stream(doc->filepath, doc->text, pos,
+				doc->len);
+		}
+
+		ast_t *stmt = NULL;
+		int parsed = doc_parse_stmt(tokens, &ast_arena, &stmt);
+		if (parsed && stmt == NULL) {
+			next = doc->count;
+			break;
+		}
+
+		int start;
+		if (parsed) start = stmt->start;
+		else {
+			// The stream is left halfway through the statement
+			free_tokens(tokens);
+			tokens = NULL;
+			start = doc_skip_space(doc, pos);
+		}
+
+		while (next < doc->count) {
+			int old = doc_start(doc, doc->stmts[next]);
+			if (old >= keep_from && old >= start) break;
+			next++;
+		}
+		if (next < doc->count && doc_start(doc, doc->stmts[next]) == start) {
+			break;
+		}
+
+		doc_stmt_t *fresh;
+		if (parsed) fresh = doc_stmt_create(doc, tokens, stmt);
+		else fresh = doc_stmt_failed(doc, start, error_last());
+		arena_free(&ast_arena);
+
+		doc->fresh = doc_reserve(doc->fresh, &doc->fresh_cap,
+			doc->total_fresh + 1, sizeof(doc_stmt_t*));
+		doc->fresh[doc->total_fresh++] = fresh;
+		pos = fresh->end;
+	}
+
+	arena_free(&ast_arena);
+	free_tokens(tokens);
+	return next;
+}
+
+int doc_parse_stmt(tokens_t *tokens, arena_t *arena, ast_t **stmt) {
+	jmp_buf env;
+	if (setjmp(env)) {
+		error_recover(NULL);
+		return 0;
+	}
+
+	error_recover(&env);
+	*stmt = generate_ast_stmt(tokens, arena);
+	error_recover(NULL);
+	return 1;
+}
+
+pos_t doc_skip_space(document_t *doc, pos_t pos) {
+	while (pos < doc->len && (doc->text[pos] == ' ' ||
+		(doc->text[pos] >= '\t' && doc->text[pos] <= '\r'))) {
+		pos++;
+	}
+	return pos;
+}
+
+pos_t doc_skip_stmt(document_t *doc, pos_t pos) {
+	// Up to the ';' or the '}' that would have ended the statement
+	int depth = 0;
+	for (; pos < doc->len; pos++) {
+		char ch = doc->text[pos];
+		if (ch == '{') depth++;
+		else if (ch == '}' && --depth <= 0) return pos + 1;
+		else if (ch == ';' && depth == 0) return pos + 1;
+	}
+	return pos;
+}
+
+doc_stmt_t *doc_stmt_create(document_t *doc, tokens_t *tokens, ast_t *stmt) {
+	doc_stmt_t *res = calloc(1, sizeof(doc_stmt_t));
+	if (res == NULL) {
+		perror("Error in doc_stmt_create with calloc");
+		exit(1);
+	}
+
+	res->start = stmt->start;
+	res->end = stmt->end;
+	res->declares.sym = SYM_NONE;
+
+	jmp_buf env;
+	if (setjmp(env)) {
+		error_recover(NULL);
+		res->has_error = 1;
+		res->error = error_last();
+		res->error.start -= res->start;
+		res->error.end -= res->start;
+		return res;
+	}
+
+	error_recover(&env);
+	int total = 0;
+	ast_t **uses = analyze_isolated(stmt, tokens, &total);
+	error_recover(NULL);
+
+	if (stmt->type == AST_VAR_STMT) {
+		token_t id = token_at(tokens, stmt->token);
+		res->declares.sym = id.sym;
+		res->declares.start = id.start - res->start;
+		res->declares.end = id.end - res->start;
+	}
+
+	// Only the first use of each global can be the one reported
+	doc->stamp++;
+	res->uses = malloc(total * sizeof(doc_name_t));
+	if (total && res->uses == NULL) {
+		perror("Error in doc_stmt_create with malloc");
+		exit(1);
+	}
+
+	for (int i = 0; i < total; i++) {
+		token_t id = token_at(tokens, uses[i]->token);
+		doc_sym_t *sym = doc_sym(doc, id.sym);
+		if (sym->stamp == doc->stamp) continue;
+		sym->stamp = doc->stamp;
+
+		doc_name_t *use = &res->uses[res->total_uses++];
+		use->sym = id.sym;
+		use->start = id.start - res->start;
+		use->end = id.end - res->start;
+	}
+
+	return res;
+}
+
+doc_stmt_t *doc_stmt_failed(document_t *doc, pos_t start, diagnostic_t error) {
+	doc_stmt_t *res = calloc(1, sizeof(doc_stmt_t));
+	if (res == NULL) {
+		perror("Error in doc_stmt_failed with calloc");
+		exit(1);
+	}
+
+	pos_t end = doc_skip_stmt(doc, start);
+	if (error.end > end) end = error.end;
+
+	res->start = start;
+	res->end = end;
+	res->declares.sym = SYM_NONE;
+	res->has_error = 1;
+	res->error = error;
+	res->error.start -= start;
+	res->error.end -= start;
+	return res;
+}
+
+void doc_stmt_free(doc_stmt_t *stmt) {
+	free(stmt->uses);
+	free(stmt);
+}
+
+void doc_splice(document_t *doc, int index, int next) {
+	int removed = next - index;
+	int added = doc->total_fresh;
+
+	for (int i = index; i < next; i++) {
+		doc->stmts[i]->dead = 1;
+		doc_index(doc, doc->stmts[i], 0);
+	}
+	for (int i = 0; i < added; i++) {
+		doc_index(doc, doc->fresh[i], 1);
+	}
+
+	// The removed statements are still needed below, so they are kept in
+	// the queue until the end
+	doc->stamp++;
+	doc->total_queue = 0;
+	for (int i = index; i < next; i++) doc_queue(doc, doc->stmts[i]);
+
+	doc->stmts = doc_reserve(doc->stmts, &doc->stmts_cap,
+		doc->count - removed + added, sizeof(doc_stmt_t*));
+	memmove(doc->stmts + index + added, doc->stmts + next,
+		(doc->count - next) * sizeof(doc_stmt_t*));
+	memcpy(doc->stmts + index, doc->fresh, added * sizeof(doc_stmt_t*));
+	doc->count += added - removed;
+	doc->gap = index + added;
+
+	int dead = doc->total_queue;
+	for (int i = 0; i < added; i++) doc_queue(doc, doc->fresh[i]);
+
+	// When a symbol is declared as often as before, its first declaration
+	// can only have moved within the edit, to the first fresh statement
+	// declaring it; otherwise every statement referring to it is checked
+	// again
+	for (int i = 0; i < added; i++) {
+		doc_stmt_t *fresh = doc->fresh[i];
+		if (fresh->declares.sym == SYM_NONE) continue;
+
+		doc_sym_t *sym = &doc->syms[fresh->declares.sym];
+		if (sym->first_decl && sym->first_decl->dead) sym->first_decl = fresh;
+	}
+
+	for (int i = 0; i < doc->total_touched; i++) {
+		doc_sym_t *sym = &doc->syms[doc->touched[i]];
+		int id = doc->touched[i];
+
+		if (sym->removed) {
+			int total = 0;
+			for (int j = 0; j < sym->total_refs; j++) {
+				if (!sym->refs[j]->dead) sym->refs[total++] = sym->refs[j];
+			}
+			sym->total_refs = total;
+			sym->removed = 0;
+		}
+
+		if (sym->decl_delta != 0) {
+			sym->first_decl = NULL;
+			for (int j = 0; j < sym->total_refs; j++) {
+				doc_stmt_t *ref = sym->refs[j];
+				if (ref->declares.sym == id && (sym->first_decl == NULL ||
+					doc_start(doc, ref) < doc_start(doc, sym->first_decl))) {
+					sym->first_decl = ref;
+				}
+				doc_queue(doc, ref);
+			}
+		}
+
+		sym->decl_delta = 0;
+		sym->touched = 0;
+	}
+	doc->total_touched = 0;
+
+	for (int i = dead; i < doc->total_queue; i++) {
+		doc_check(doc, doc->queue[i]);
+	}
+	for (int i = 0; i < dead; i++) {
+		doc_link_error(doc, doc->queue[i], 0);
+		doc_stmt_free(doc->queue[i]);
+	}
+}
+
+doc_sym_t *doc_sym(document_t *doc, int sym) {
+	if (sym >= doc->total_syms) {
+		int old = doc->total_syms;
+		doc->syms = doc_reserve(doc->syms, &doc->total_syms, sym + 1,
+			sizeof(doc_sym_t));
+		memset(doc->syms + old, 0, (doc->total_syms - old) *
+			sizeof(doc_sym_t));
+	}
+	return &doc->syms[sym];
+}
+
+void doc_index(document_t *doc, doc_stmt_t *stmt, int add) {
+	// Every statement is in the refs of each symbol it names once
+	int total = stmt->total_uses + 1;
+	for (int i = 0; i < total; i++) {
+		int id = i < stmt->total_uses ? stmt->uses[i].sym : stmt->declares.sym;
+		if (id == SYM_NONE) continue;
+
+		int declares = id == stmt->declares.sym;
+		if (i == stmt->total_uses) {
+			// Already named as a use
+			int used = 0;
+			for (int j = 0; j < stmt->total_uses && !used; j++) {
+				used = stmt->uses[j].sym == id;
+			}
+			if (used) continue;
+		}
+
+		doc_sym_t *sym = doc_sym(doc, id);
+		if (add) {
+			sym->refs = doc_reserve(sym->refs, &sym->refs_cap,
+				sym->total_refs + 1, sizeof(doc_stmt_t*));
+			sym->refs[sym->total_refs++] = stmt;
+		}
+		else {
+			sym->removed = 1;
+			doc_touch(doc, id, 0);
+		}
+
+		if (declares) doc_touch(doc, id, add ? 1 : -1);
+	}
+}
+
+void doc_touch(document_t *doc, int id, int decl_delta) {
+	doc_sym_t *sym = doc_sym(doc, id);
+	sym->decl_delta += decl_delta;
+	if (sym->touched) return;
+
+	sym->touched = 1;
+	doc->touched = doc_reserve(doc->touched, &doc->touched_cap,
+		doc->total_touched + 1, sizeof(int));
+	doc->touched[doc->total_touched++] = id;
+}
+
+void doc_queue(document_t *doc, doc_stmt_t *stmt) {
+	if (stmt->stamp == doc->stamp) return;
+	stmt->stamp = doc->stamp;
+
+	doc->queue = doc_reserve(doc->queue, &doc->queue_cap,
+		doc->total_queue + 1, sizeof(doc_stmt_t*));
+	doc->queue[doc->total_queue++] = stmt;
+}
+
+void doc_check(document_t *doc, doc_stmt_t *stmt) {
+	stmt->has_name_error = 0;
+
+	if (!stmt->has_error && stmt->declares.sym != SYM_NONE &&
+		doc_sym(doc, stmt->declares.sym)->first_decl != stmt) {
+		stmt->has_name_error = 1;
+		stmt->name_error.start = stmt->declares.start;
+		stmt->name_error.end = stmt->declares.end;
+		stmt->name_error.message = "Variable already defined in scope";
+	}
+
+	// A global is visible from the statements after its first declaration
+	int start = doc_start(doc, stmt);
+	for (int i = 0; i < stmt->total_uses && !stmt->has_name_error; i++) {
+		doc_stmt_t *decl = doc_sym(doc, stmt->uses[i].sym)->first_decl;
+		if (decl && doc_start(doc, decl) < start) continue;
+
+		stmt->has_name_error = 1;
+		stmt->name_error.start = stmt->uses[i].start;
+		stmt->name_error.end = stmt->uses[i].end;
+		stmt->name_error.message = "Variable not defined";
+	}
+
+	doc_link_error(doc, stmt, stmt->has_error || stmt->has_name_error);
+}
+
+void doc_link_error(document_t *doc, doc_stmt_t *stmt, int has_error) {
+	if (has_error == stmt->in_errors) return;
+	stmt->in_errors = has_error;
+
+	if (has_error) {
+		stmt->error_prev = NULL;
+		stmt->error_next = doc->errors;
+		if (doc->errors) doc->errors->error_prev = stmt;
+		doc->errors = stmt;
+		return;
+	}
+
+	if (stmt->error_prev) stmt->error_prev->error_next = stmt->error_next;
+	else doc->errors = stmt->error_next;
+	if (stmt->error_next) stmt->error_next->error_prev = stmt->error_prev;
+}
@@ -1,6 +1,14 @@
 #include "error.h"
 
 #include <stdio.h>
+#include <stdlib.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+static jmp_buf *recovery = NULL;
+static diagnostic_t last_error;
 
 // ========================================
 // error.h - definition
@@ -9,11 +17,22 @@
 void error_print(const char *filepath, const char *src, pos_t start, pos_t end,
 	const char *message) {
 
-	fprintf(stderr, "%s:%d:%d: %s\n", filepath, start.line, start.column,
+	if (recovery) {
+		last_error.start = start;
+		last_error.end = end;
+		last_error.message = message;
+		return;
+	}
+
+	int start_line, start_column, end_line, end_column;
+	pos_line_column(src, start, &start_line, &start_column);
+	pos_line_column(src, end, &end_line, &end_column);
+
+	fprintf(stderr, "%s:%d:%d: %s\n", filepath, start_line, start_column,
 		message);
 
 	// Calculate where the line starts
-	int line_start = start.index;
+	int line_start = start - (start_column - 1);
 	while (line_start - 1 >= 0 && src[line_start - 1] != '\n') {
 		line_start--;
 	}
@@ -25,7 +44,7 @@ void error_print(const char *filepath, const char *src, pos_t start, pos_t end,
 	for (int i = line_start; src[i] && src[i] != '\n'; i++) {
 		char ch = src[i];
 		char error_sign = ' ';
-		if (start.index <= i && i < end.index) {
+		if (start <= i && i < end) {
 			error_sign = 'v';
 		}
 
@@ -47,7 +66,7 @@ void error_print(const char *filepath, const char *src, pos_t start, pos_t end,
 
 	// Now print each line where error occurs
 	int index = line_start;
-	for (int line = start.line; line <= end.line; line++) {
+	for (int line = start_line; line <= end_line; line++) {
 		// Print the line number
 		fprintf(stderr, "%-8d>%8s", line, "");
 
@@ -73,3 +92,15 @@ void error_print(const char *filepath, const char *src, pos_t start, pos_t end,
 	fprintf(stderr, "%-8s|\n", "");
 }
 
+void error_exit() {
+	if (recovery) longjmp(*recovery, 1);
+	exit(1);
+}
+
+void error_recover(jmp_buf *env) {
+	recovery = env;
+}
+
+diagnostic_t error_last() {
+	return last_error;
+}
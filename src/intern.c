@@ -0,0 +1,151 @@
+#include "intern.h"
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+#define INTERN_INITIAL_SLOTS 1024
+
+struct symbol_t {
+	const char *str;
+	int len;
+	uint32_t hash;
+	int64_t value;
+};
+
+typedef struct symbol_t symbol_t;
+
+// Open addressing (linear probing) table of symbol ids; the strings live
+// in the arena and the symbols in a dense array indexed by id
+static struct {
+	arena_t arena;
+
+	symbol_t *symbols;
+	int count;
+	int cap;
+
+	int *slots;
+	int total_slots;
+} pool;
+
+void intern_grow_slots();
+void intern_grow_symbols();
+
+// ========================================
+// intern.h - definition
+// ========================================
+
+int intern(const char *str, int len) {
+	return intern_hashed(str, len, intern_hash(str, len));
+}
+
+int intern_hashed(const char *str, int len, uint32_t hash) {
+	if (pool.slots == NULL) {
+		pool.total_slots = INTERN_INITIAL_SLOTS / 2;
+		intern_grow_slots();
+	}
+
+	int mask = pool.total_slots - 1;
+	int slot = hash & mask;
+
+	for (;;) {
+		int sym = pool.slots[slot];
+		if (sym == SYM_NONE) break;
+
+		symbol_t *cur = &pool.symbols[sym];
+		if (cur->hash == hash && cur->len == len &&
+			memcmp(cur->str, str, len) == 0) {
+			return sym;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	if (pool.count == pool.cap) intern_grow_symbols();
+
+	int sym = pool.count++;
+	pool.symbols[sym].str = arena_strndup(&pool.arena, str, len);
+	pool.symbols[sym].len = len;
+	pool.symbols[sym].hash = hash;
+	pool.symbols[sym].value = 0;
+	pool.slots[slot] = sym;
+
+	// Keep the load factor under a half
+	if (pool.count * 2 > pool.total_slots) intern_grow_slots();
+
+	return sym;
+}
+
+const char *intern_str(int sym) {
+	return pool.symbols[sym].str;
+}
+
+int intern_len(int sym) {
+	return pool.symbols[sym].len;
+}
+
+void intern_set_value(int sym, int64_t value) {
+	pool.symbols[sym].value = value;
+}
+
+int64_t intern_value(int sym) {
+	return pool.symbols[sym].value;
+}
+
+int intern_count() {
+	return pool.count;
+}
+
+uint32_t intern_hash(const char *str, int len) {
+	// FNV-1a
+	uint32_t hash = 2166136261u;
+	for (int i = 0; i < len; i++) {
+		hash ^= (unsigned char) str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+void free_intern() {
+	arena_free(&pool.arena);
+	free(pool.symbols);
+	free(pool.slots);
+	memset(&pool, 0, sizeof(pool));
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+void intern_grow_slots() {
+	free(pool.slots);
+
+	pool.total_slots *= 2;
+	pool.slots = malloc(pool.total_slots * sizeof(int));
+	if (pool.slots == NULL) {
+		perror("Error in intern_grow_slots with malloc");
+		exit(1);
+	}
+	memset(pool.slots, 0xff, pool.total_slots * sizeof(int));
+
+	int mask = pool.total_slots - 1;
+	for (int sym = 0; sym < pool.count; sym++) {
+		int slot = pool.symbols[sym].hash & mask;
+		while (pool.slots[slot] != SYM_NONE) slot = (slot + 1) & mask;
+		pool.slots[slot] = sym;
+	}
+}
+
+void intern_grow_symbols() {
+	pool.cap = pool.cap ? pool.cap * 2 : INTERN_INITIAL_SLOTS;
+	pool.symbols = realloc(pool.symbols, pool.cap * sizeof(symbol_t));
+	if (pool.symbols == NULL) {
+		perror("Error in intern_grow_symbols with realloc");
+		exit(1);
+	}
+}
@@ -3,341 +3,858 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // ========================================
 // helper declaration
 // ========================================
 
-static ir_t *global_head, *global_tail;
-static st_t *global_memory_scope, *global_name_scope;
-static int total_breaks = 0, total_continues = 0;
-static ir_t **breaks = NULL, **continues = NULL;
+// Code and constant pool of the program being generated; ir_end hands
+// both over to the program
+static ir_t *code = NULL;
+static int total_code = 0, code_cap = 0;
+static int64_t *consts = NULL;
+static int total_consts = 0, consts_cap = 0;
+
+// Index + 1 of every constant in the pool by value (0 for an empty slot),
+// so a value is added once however many times it is used
+static int *consts_table = NULL;
+static int consts_table_cap = 0;
+
+// Jumps are generated with the label they go to, and ir_end sets them to
+// the instruction each label was placed at
+static int *labels = NULL;
+static int total_labels = 0, labels_cap = 0;
+
+static int total_registers;
+static st_t *global_memory_scope;
+
+// The slots up to global_memory_init are already initialized
+static st_t *global_memory_init;
 
-ir_t *ir_append(int type, int64_t arg1, int64_t arg2, int64_t arg3);
+// Jumps of the breaks and continues of the loops being generated
+static int total_breaks = 0, total_continues = 0;
+static int breaks_cap = 0, continues_cap = 0;
+static int *breaks = NULL, *continues = NULL;
+
+// Node waiting on the work stack of ir_stmt. Nodes are lowered in stages;
+// in between their children are lowered, and every expression leaves its
+// register on the value stack
+typedef struct {
+	ast_t *ast;
+	int stage;
+
+	// Lowered as a jump to target when the value of the expression is
+	// jump_if (as a truth value), instead of into a register
+	int cond;
+	int jump_if;
+	int target;
+
+	// Labels placed by a later stage, and the register a value is built in
+	int label;
+	int body;
+	int end;
+	int reg;
+
+	// Breaks and continues pending when a while started
+	int breaks;
+	int continues;
+} ir_work_t;
+
+static ir_work_t *works = NULL;
+static int total_works = 0, works_cap = 0;
+static int *values = NULL;
+static int total_values = 0, values_cap = 0;
+
+int ir_append(int type, int32_t arg1, int32_t arg2, int32_t arg3);
+int ir_const(int64_t value);
+uint64_t ir_hash_const(int64_t value);
+void ir_grow_consts();
+int ir_label();
+void ir_place(int label);
 int new_register();
+int ir_compare(int op);
+int ir_width(type_t *type);
+int ir_store(type_t *type);
+
+void ir_append_break(int break_ir);
+void ir_append_continue(int continue_ir);
 
-void ir_append_break(ir_t *break_ir);
-void ir_append_continue(ir_t *continue_ir);
+ir_work_t *ir_push(ast_t *ast, int stage);
+void ir_push_cond(ast_t *ast, int jump_if, int target);
+void ir_push_value(int reg);
+int ir_pop_value();
 
-void ir_prog(ast_t *prog);
+void ir_global_init();
 void ir_stmt(ast_t *stmt);
-void ir_var_stmt(ast_t *stmt);
-void ir_print_stmt(ast_t *stmt);
-void ir_block_stmt(ast_t *stmt);
-void ir_expr_stmt(ast_t *stmt);
-void ir_if_stmt(ast_t *stmt);
-void ir_while_stmt(ast_t *stmt);
-void ir_break_stmt(ast_t *stmt);
-void ir_continue_stmt(ast_t *stmt);
-int ir_expr(ast_t *expr);
-int ir_binary_expr(ast_t *expr);
-int ir_literal_expr(ast_t *expr);
-int ir_identifier_expr(ast_t *expr);
+void ir_var_stmt(ir_work_t work);
+void ir_print_stmt(ir_work_t work);
+void ir_block_stmt(ir_work_t work);
+void ir_expr_stmt(ir_work_t work);
+void ir_if_stmt(ir_work_t work);
+void ir_while_stmt(ir_work_t work);
+void ir_break_stmt(ir_work_t work);
+void ir_continue_stmt(ir_work_t work);
+void ir_cond(ir_work_t work);
+void ir_binary_expr(ir_work_t work);
+void ir_logical_expr(ir_work_t work);
+void ir_unary_expr(ir_work_t work);
+void ir_literal_expr(ir_work_t work);
+void ir_identifier_expr(ir_work_t work);
+
+const char *ir_name(ir_t *ir, int *size);
 
 // ========================================
 // ir.h - definition
 // ========================================
 
-ir_t *generate_ir(ast_t *prog) {
-	global_head = global_tail = NULL;
-	ir_prog(prog);
-	return global_head;
+ir_prog_t *generate_ir(ast_t *prog) {
+	ir_begin(prog->prog.memory_scope);
+	for (ast_t *cur = prog->prog.asts; cur; cur = cur->next) {
+		ir_toplevel(cur);
+	}
+	return ir_end();
 }
 
-void print_ir(ir_t *ir_head) {
-	printf("========== IR REPRESENTATION ==========\n");
-	for (ir_t *cur = ir_head; cur; cur = cur->next) {
-		const char *name = "UNKNOWN";
-		int size = 0;
+void ir_begin(st_t *memory_scope) {
+	total_code = total_consts = total_labels = 0;
+	total_registers = 0;
+	global_memory_scope = memory_scope;
+	global_memory_init = NULL;
+}
 
-		switch (cur->type) {
-		case IR_NOP:
-			name = "IR_NOP";
-			break;
+void ir_toplevel(ast_t *stmt) {
+	// Slots created while analyzing this statement (or any statement when
+	// the whole program was analyzed first) must be initialized before
+	// the statement runs
+	ir_global_init();
+	ir_stmt(stmt);
+}
 
-		case IR_GLOBAL_ALLOC:
-			name = "IR_GLOBAL_ALLOC";
-			size = 3;
-			break;
+ir_prog_t *ir_end() {
+	for (int i = 0; i < total_code; i++) {
+		int32_t *target = ir_target(&code[i]);
+		if (target) *target = labels[*target];
+	}
 
-		case IR_GLOBAL_LOAD_CONST:
-			name = "IR_GLOBAL_LOAD_CONST";
-			size = 3;
-			break;
+	ir_prog_t *ir = malloc(sizeof(ir_prog_t));
+	if (ir == NULL) {
+		perror("Error in ir_end with malloc");
+		exit(1);
+	}
 
-		case IR_GLOBAL_LOAD:
-			name = "IR_GLOBAL_LOAD";
-			size = 3;
-			break;
+	// Registers are numbered from 1, and offsets are 32 bit arguments
+	ir->total_regs = total_registers + 1;
+	ir->global_size = global_memory_scope ? global_memory_scope->scope.max : 0;
+	if (ir->global_size > INT32_MAX) {
+		fprintf(stderr, "Global memory does not fit in 2 GiB\n");
+		exit(1);
+	}
 
-		case IR_LOAD_GLOBAL:
-			name = "IR_LOAD_GLOBAL";
-			size = 3;
-			break;
+	ir->consts = consts;
+	ir->total_consts = total_consts;
+	ir->code = code;
+	ir->total_code = total_code;
+	ir->file = (file_t) {};
+
+	code = NULL;
+	total_code = code_cap = 0;
+	consts = NULL;
+	total_consts = consts_cap = 0;
+	free(consts_table);
+	consts_table = NULL;
+	consts_table_cap = 0;
+	return ir;
+}
 
-		case IR_ADD:
-			name = "IR_ADD";
-			size = 3;
-			break;
+int32_t *ir_target(ir_t *ir) {
+	switch (ir->type) {
+	case IR_JMP:
+		return &ir->arg1;
+	case IR_JMP_TRUE: case IR_JMP_FALSE:
+		return &ir->arg2;
+	case IR_JLT: case IR_JLE: case IR_JGT:
+	case IR_JGE: case IR_JEQ: case IR_JNE:
+	case IR_JLTI: case IR_JLEI: case IR_JGTI:
+	case IR_JGEI: case IR_JEQI: case IR_JNEI:
+		return &ir->arg3;
+	}
+	return NULL;
+}
 
-		case IR_SUB:
-			name = "IR_SUB";
-			size = 3;
-			break;
+int32_t ir_def(ir_t *ir) {
+	switch (ir->type) {
+	case IR_LOAD8: case IR_LOAD16: case IR_LOAD32: case IR_LOAD64:
+	case IR_ADD: case IR_SUB: case IR_LOAD_CONST:
+	case IR_LT: case IR_LE: case IR_GT:
+	case IR_GE: case IR_EQ: case IR_NE:
+	case IR_NOT: case IR_MOV:
+	case IR_WRAP8: case IR_WRAP16: case IR_WRAP32: case IR_WRAP64:
+		return ir->arg1;
+	}
+	return -1;
+}
 
-		case IR_PRINT:
-			name = "IR_PRINT";
-			size = 1;
-			break;
+int ir_uses(ir_t *ir, int32_t uses[3]) {
+	switch (ir->type) {
+	case IR_STORE8: case IR_STORE16: case IR_STORE32: case IR_STORE64:
+	case IR_STORE_INT: case IR_NOT: case IR_MOV:
+	case IR_WRAP8: case IR_WRAP16: case IR_WRAP32: case IR_WRAP64:
+		uses[0] = ir->arg2;
+		return 1;
+	case IR_ADD: case IR_SUB:
+	case IR_LT: case IR_LE: case IR_GT:
+	case IR_GE: case IR_EQ: case IR_NE:
+		uses[0] = ir->arg2;
+		uses[1] = ir->arg3;
+		return 2;
+	case IR_PRINT: case IR_JMP_TRUE: case IR_JMP_FALSE:
+	case IR_JLTI: case IR_JLEI: case IR_JGTI:
+	case IR_JGEI: case IR_JEQI: case IR_JNEI:
+		uses[0] = ir->arg1;
+		return 1;
+	case IR_JLT: case IR_JLE: case IR_JGT:
+	case IR_JGE: case IR_JEQ: case IR_JNE:
+		uses[0] = ir->arg1;
+		uses[1] = ir->arg2;
+		return 2;
+	}
+	return 0;
+}
 
-		case IR_JMP_TRUE:
-			name = "IR_JMP_TRUE";
-			size = 2;
-			break;
+int ir_slot(ir_t *ir, int32_t *offset) {
+	switch (ir->type) {
+	case IR_GLOBAL_LOAD_CONST:
+		*offset = ir->arg1;
+		return ir->arg2;
+	case IR_STORE8: case IR_STORE16: case IR_STORE32: case IR_STORE64:
+		*offset = ir->arg1;
+		return 1 << (ir->type - IR_STORE8);
+	case IR_STORE_INT:
+		*offset = ir->arg1;
+		return 8;
+	case IR_LOAD8: case IR_LOAD16: case IR_LOAD32: case IR_LOAD64:
+		*offset = ir->arg2;
+		return 1 << (ir->type - IR_LOAD8);
+	}
+	return 0;
+}
 
-		case IR_JMP:
-			name = "IR_JMP";
-			size = 1;
-			break;
+int ir_pure(ir_t *ir) {
+	// Reading global memory has no effect either, and a bigint result
+	// only allocates
+	return ir_def(ir) >= 0;
+}
 
-		case IR_JMP_FALSE:
-			name = "IR_JMP_FALSE";
-			size = 2;
-			break;
+void print_ir(ir_prog_t *ir, buffer_t *out, int format) {
+	if (format == DUMP_TEXT) {
+		buffer_append(out, "========== IR REPRESENTATION ==========\n", -1);
+		buffer_append(out, "registers: ", -1);
+		buffer_int(out, ir->total_regs);
+		buffer_append(out, " | global size: ", -1);
+		buffer_int(out, ir->global_size);
+		buffer_append(out, " | constants: ", -1);
+		buffer_int(out, ir->total_consts);
+		buffer_append(out, " | instructions: ", -1);
+		buffer_int(out, ir->total_code);
+		buffer_append(out, "\n", 1);
+
+		for (int i = 0; i < ir->total_consts; i++) {
+			buffer_hex(out, i, 9);
+			buffer_append(out, " | CONST ", -1);
+			buffer_int(out, ir->consts[i]);
+			buffer_append(out, "\n", 1);
+		}
+	}
+	else {
+		buffer_append(out, "{\"registers\":", -1);
+		buffer_int(out, ir->total_regs);
+		buffer_append(out, ",\"global_size\":", -1);
+		buffer_int(out, ir->global_size);
+		buffer_append(out, ",\"consts\":[", -1);
+		for (int i = 0; i < ir->total_consts; i++) {
+			if (i) buffer_append(out, ",", 1);
+			buffer_int(out, ir->consts[i]);
+		}
+		buffer_append(out, "]}\n", 3);
+	}
+
+	for (int i = 0; i < ir->total_code; i++) {
+		ir_t *cur = &ir->code[i];
+		int size = 0;
+		const char *name = ir_name(cur, &size);
+		int64_t args[3] = {cur->arg1, cur->arg2, cur->arg3};
+
+		if (format == DUMP_TEXT) {
+			buffer_hex(out, i, 9);
+			buffer_append(out, " | ", 3);
+			buffer_append(out, name, -1);
+			buffer_fill(out, ' ', 30 - (int) strlen(name));
+			buffer_append(out, " ", 1);
+			for (int j = 0; j < size; j++) {
+				buffer_hex(out, args[j], 9);
+				buffer_append(out, " ", 1);
+			}
+			buffer_append(out, "\n", 1);
+			continue;
 		}
 
-		printf("0x%09llx | %-30s ", (int64_t) cur, name);
-		if (size >= 1) printf("0x%09llx ", cur->arg1);
-		if (size >= 2) printf("0x%09llx ", cur->arg2);
-		if (size >= 3) printf("0x%09llx ", cur->arg3);
-		printf("\n");
+		buffer_append(out, "{\"addr\":", -1);
+		buffer_int(out, i);
+		buffer_append(out, ",\"op\":\"", -1);
+		buffer_append(out, name, -1);
+		buffer_append(out, "\",\"args\":[", -1);
+		for (int j = 0; j < size; j++) {
+			if (j) buffer_append(out, ",", 1);
+			buffer_int(out, args[j]);
+		}
+		buffer_append(out, "]}\n", 3);
+	}
+	buffer_flush(out);
+}
+
+void free_ir(ir_prog_t *ir) {
+	if (ir->file.src) free_file(ir->file);
+	else {
+		free(ir->code);
+		free(ir->consts);
 	}
+	free(ir);
 }
 
 // ========================================
 // helper definition
 // ========================================
 
-ir_t *ir_append(int type, int64_t arg1, int64_t arg2, int64_t arg3) {
-	ir_t *res = malloc(sizeof(ir_t));
-	res->type = type;
-	res->arg1 = arg1;
-	res->arg2 = arg2;
-	res->arg3 = arg3;
-	res->next = NULL;
-
-	if (global_head == NULL) global_head = global_tail = res;
-	else {
-		global_tail->next = res;
-		global_tail = res;
+int ir_append(int type, int32_t arg1, int32_t arg2, int32_t arg3) {
+	if (total_code == code_cap) {
+		code_cap = code_cap ? code_cap * 2 : 256;
+		code = realloc(code, code_cap * sizeof(ir_t));
+		if (code == NULL) {
+			perror("Error in ir_append with realloc");
+			exit(1);
+		}
 	}
 
-	return res;
+	code[total_code] = (ir_t) {type, arg1, arg2, arg3};
+	return total_code++;
 }
 
-int new_register() {
-	static int total_register = 0;
-	return ++total_register;
+int ir_const(int64_t value) {
+	// Index of the value in the constant pool, added if it is not there
+	if (2 * (total_consts + 1) > consts_table_cap) ir_grow_consts();
+
+	uint64_t mask = consts_table_cap - 1;
+	uint64_t slot = ir_hash_const(value) & mask;
+	for (; consts_table[slot]; slot = (slot + 1) & mask) {
+		if (consts[consts_table[slot] - 1] == value) {
+			return consts_table[slot] - 1;
+		}
+	}
+
+	if (total_consts == consts_cap) {
+		consts_cap = consts_cap ? consts_cap * 2 : 64;
+		consts = realloc(consts, consts_cap * sizeof(int64_t));
+		if (consts == NULL) {
+			perror("Error in ir_const with realloc");
+			exit(1);
+		}
+	}
+
+	consts[total_consts++] = value;
+	consts_table[slot] = total_consts;
+	return total_consts - 1;
 }
 
-void ir_prog(ast_t *prog) {
-	global_memory_scope = prog->memory_scope;
-	global_name_scope = prog->name_scope;
+uint64_t ir_hash_const(int64_t value) {
+	return ((uint64_t) value * 0x9e3779b97f4a7c15) >> 32;
+}
 
-	int global_size = prog->memory_scope->scope.size;
-	ir_append(IR_GLOBAL_ALLOC, global_size, 0, 0);
+void ir_grow_consts() {
+	consts_table_cap = consts_table_cap ? consts_table_cap * 2 : 128;
+	free(consts_table);
+	consts_table = calloc(consts_table_cap, sizeof(int));
+	if (consts_table == NULL) {
+		perror("Error in ir_grow_consts with calloc");
+		exit(1);
+	}
 
-	for (st_t *cur = global_memory_scope->next; cur; cur = cur->next) {
-		int64_t offset = 0;
-		int64_t size = 0;
-		int64_t value = 0;
-		if (cur->type == ST_LITERAL) {
-			offset = cur->literal.offset;
-			size = cur->literal.data_type->size;
+	uint64_t mask = consts_table_cap - 1;
+	for (int i = 0; i < total_consts; i++) {
+		uint64_t slot = ir_hash_const(consts[i]) & mask;
+		while (consts_table[slot]) slot = (slot + 1) & mask;
+		consts_table[slot] = i + 1;
+	}
+}
 
-			char *lexical = token_lexical(cur->literal.token);
-			value = strtoll(lexical, NULL, 10);
-			free(lexical);
-		}
-		else if (cur->type == ST_VAR) {
-			offset = cur->var.offset;
-			size = cur->var.data_type->size;
-			value = 0;
+int ir_label() {
+	// A label can be jumped to before it is placed
+	if (total_labels == labels_cap) {
+		labels_cap = labels_cap ? labels_cap * 2 : 64;
+		labels = realloc(labels, labels_cap * sizeof(int));
+		if (labels == NULL) {
+			perror("Error in ir_label with realloc");
+			exit(1);
 		}
+	}
+
+	labels[total_labels] = -1;
+	return total_labels++;
+}
+
+void ir_place(int label) {
+	// The label is the next instruction generated
+	labels[label] = total_code;
+}
 
-		ir_append(IR_GLOBAL_LOAD_CONST, offset, size, value);
+int new_register() {
+	return ++total_registers;
+}
+
+int ir_compare(int op) {
+	// Offset of a comparison in the IR_LT..IR_NE, IR_JLT..IR_JNE and
+	// IR_JLTI..IR_JNEI groups, -1 if op is not a comparison
+	switch (op) {
+	case TT_LESS: return 0;
+	case TT_LESS_EQUAL: return 1;
+	case TT_GREATER: return 2;
+	case TT_GREATER_EQUAL: return 3;
+	case TT_EQUAL_EQUAL: return 4;
+	case TT_BANG_EQUAL: return 5;
 	}
+	return -1;
+}
 
-	for (ast_t *cur = prog->prog.asts; cur; cur = cur->next) {
-		ir_stmt(cur);
+int ir_width(type_t *type) {
+	// Offset of the type in the IR_LOAD8..IR_LOAD64 and
+	// IR_STORE8..IR_STORE64 groups
+	switch (type->size) {
+	case 1: return 0;
+	case 2: return 1;
+	case 4: return 2;
 	}
+	return 3;
 }
 
-void ir_stmt(ast_t *stmt) {
-	switch (stmt->type) {
-	case AST_VAR_STMT:
-		ir_var_stmt(stmt);
-		break;
-	case AST_BLOCK_STMT:
-		ir_block_stmt(stmt);
-		break;
-	case AST_EXPR_STMT:
-		ir_expr_stmt(stmt);
-		break;
-	case AST_PRINT_STMT:
-		ir_print_stmt(stmt);
-		break;
-	case AST_IF_STMT:
-		ir_if_stmt(stmt);
-		break;
-	case AST_WHILE_STMT:
-		ir_while_stmt(stmt);
-		break;
-	case AST_BREAK_STMT:
-		ir_break_stmt(stmt);
-		break;
-	case AST_CONTINUE_STMT:
-		ir_continue_stmt(stmt);
-		break;
-	default:
-		fprintf(stderr, "What is this STMT type?\n");
-		exit(1);
+int ir_store(type_t *type) {
+	if (type == type_int()) return IR_STORE_INT;
+	return IR_STORE8 + ir_width(type);
+}
+
+void ir_global_init() {
+	st_t *cur = global_memory_scope->next;
+	if (global_memory_init) cur = global_memory_init->next;
+
+	for (; cur; cur = cur->next) {
+		int64_t offset = cur->var.offset;
+		int64_t size = cur->var.data_type->size;
+
+		ir_append(IR_GLOBAL_LOAD_CONST, offset, size, ir_const(0));
+		global_memory_init = cur;
 	}
 }
 
-void ir_var_stmt(ast_t *stmt) {
-	token_t id = stmt->var_stmt.identifier;
-	if (stmt->var_stmt.expr) {
-		int offset = stmt->offset;
-		int size = stmt->data_type->size;
-		int reg = ir_expr(stmt->var_stmt.expr);
+ir_work_t *ir_push(ast_t *ast, int stage) {
+	if (total_works == works_cap) {
+		works_cap = works_cap ? works_cap * 2 : 64;
+		works = realloc(works, works_cap * sizeof(ir_work_t));
+		if (works == NULL) {
+			perror("Error in ir_push with realloc");
+			exit(1);
+		}
+	}
 
-		ir_append(IR_GLOBAL_LOAD, offset, size, reg);
+	ir_work_t *work = &works[total_works++];
+	memset(work, 0, sizeof(ir_work_t));
+	work->ast = ast;
+	work->stage = stage;
+	return work;
+}
+
+void ir_push_cond(ast_t *ast, int jump_if, int target) {
+	ir_work_t *work = ir_push(ast, 0);
+	work->cond = 1;
+	work->jump_if = jump_if;
+	work->target = target;
+}
+
+void ir_push_value(int reg) {
+	if (total_values == values_cap) {
+		values_cap = values_cap ? values_cap * 2 : 64;
+		values = realloc(values, values_cap * sizeof(int));
+		if (values == NULL) {
+			perror("Error in ir_push_value with realloc");
+			exit(1);
+		}
 	}
+	values[total_values++] = reg;
 }
 
-void ir_print_stmt(ast_t *stmt) {
-	int reg = ir_expr(stmt->print_stmt.expr);
-	ir_append(IR_PRINT, reg, 0, 0);
+int ir_pop_value() {
+	return values[--total_values];
 }
 
-void ir_if_stmt(ast_t *stmt) {
-	int reg = ir_expr(stmt->if_stmt.if_cond);
+void ir_stmt(ast_t *stmt) {
+	// Depth first with an explicit stack, so any depth can be lowered
+	ir_push(stmt, 0);
+
+	while (total_works > 0) {
+		ir_work_t work = works[--total_works];
+		if (work.cond) {
+			ir_cond(work);
+			continue;
+		}
 
-	// Need to set the pointer
-	ir_t *if_start = ir_append(IR_JMP_TRUE, reg, 0, 0);
+		switch (work.ast->type) {
+		case AST_VAR_STMT:
+			ir_var_stmt(work);
+			break;
+		case AST_BLOCK_STMT:
+			ir_block_stmt(work);
+			break;
+		case AST_EXPR_STMT:
+			ir_expr_stmt(work);
+			break;
+		case AST_PRINT_STMT:
+			ir_print_stmt(work);
+			break;
+		case AST_IF_STMT:
+			ir_if_stmt(work);
+			break;
+		case AST_WHILE_STMT:
+			ir_while_stmt(work);
+			break;
+		case AST_BREAK_STMT:
+			ir_break_stmt(work);
+			break;
+		case AST_CONTINUE_STMT:
+			ir_continue_stmt(work);
+			break;
+		case AST_LITERAL:
+			ir_literal_expr(work);
+			break;
+		case AST_IDENTIFIER:
+			ir_identifier_expr(work);
+			break;
+		case AST_BINARY:
+			if (work.ast->op == TT_AND_AND || work.ast->op == TT_OR_OR)
+				ir_logical_expr(work);
+			else ir_binary_expr(work);
+			break;
+		case AST_UNARY:
+			ir_unary_expr(work);
+			break;
+		default:
+			fprintf(stderr, "What is this ast type?\n");
+			exit(1);
+		}
+	}
+}
 
-	ir_t *else_start = ir_append(IR_NOP, 0, 0, 0);
+void ir_var_stmt(ir_work_t work) {
+	ast_t *stmt = work.ast;
 
-	if (stmt->if_stmt.else_block) {
-		ir_stmt(stmt->if_stmt.else_block);
+	if (work.stage == 0 && stmt->var_stmt.expr) {
+		ir_push(stmt, 1);
+		ir_push(stmt->var_stmt.expr, 0);
+		return;
 	}
 
-	// Need to set the pointer
-	ir_t *else_end = ir_append(IR_JMP, 0, 0, 0);
+	int reg = 0;
 
-	ir_t *if_block = ir_append(IR_NOP, 0, 0, 0);
+	// The slot may have held a variable of a block that ended, so a
+	// variable without a value is cleared where it is declared
+	if (stmt->var_stmt.expr) reg = ir_pop_value();
+	else {
+		reg = new_register();
+		ir_append(IR_LOAD_CONST, reg, ir_const(0), 0);
+	}
 
-	ir_stmt(stmt->if_stmt.if_block);
+	ir_append(ir_store(stmt->data_type), stmt->offset, reg, 0);
+}
 
-	ir_t *if_end = ir_append(IR_NOP, 0, 0, 0);
+void ir_print_stmt(ir_work_t work) {
+	if (work.stage == 0) {
+		ir_push(work.ast, 1);
+		ir_push(work.ast->print_stmt.expr, 0);
+		return;
+	}
 
-	if_start->arg2 = (int64_t) if_block;
-	else_end->arg1 = (int64_t) if_end;
+	int reg = ir_pop_value();
+	ir_append(IR_PRINT, reg, 0, 0);
 }
 
-void ir_while_stmt(ast_t *stmt) {
-	ir_t *while_start = ir_append(IR_NOP, 0, 0, 0);
+void ir_if_stmt(ir_work_t work) {
+	ast_t *stmt = work.ast;
+
+	switch (work.stage) {
+	case 0: {
+		// The condition jumps over the if block when it is false
+		int else_start = ir_label();
+
+		ir_push(stmt, 1)->label = else_start;
+		ir_push(stmt->if_stmt.if_block, 0);
+		ir_push_cond(stmt->if_stmt.if_cond, 0, else_start);
+		break;
+	}
+
+	case 1:
+		if (stmt->if_stmt.else_block == NULL) {
+			ir_place(work.label);
+			break;
+		}
 
-	int reg = ir_expr(stmt->while_stmt.while_cond);
+		int if_end = ir_label();
+		ir_append(IR_JMP, if_end, 0, 0);
+		ir_place(work.label);
+
+		ir_push(stmt, 2)->end = if_end;
+		ir_push(stmt->if_stmt.else_block, 0);
+		break;
+
+	case 2:
+		ir_place(work.end);
+		break;
+	}
+}
 
-	// Need to set pointer
-	ir_t *while_cond = ir_append(IR_JMP_FALSE, reg, 0, 0);
+void ir_while_stmt(ir_work_t work) {
+	ast_t *stmt = work.ast;
+
+	switch (work.stage) {
+	case 0: {
+		// The condition is placed after the block, so every iteration runs
+		// a single jump besides the block
+		int while_cond = ir_label();
+		int while_block = ir_label();
+		ir_append(IR_JMP, while_cond, 0, 0);
+		ir_place(while_block);
+
+		// Breaks and continues from here on belong to this loop
+		ir_work_t *loop = ir_push(stmt, 1);
+		loop->label = while_cond;
+		loop->body = while_block;
+		loop->end = ir_label();
+		loop->breaks = total_breaks;
+		loop->continues = total_continues;
+
+		ir_push(stmt->while_stmt.while_block, 0);
+		break;
+	}
 
-	ir_stmt(stmt->while_stmt.while_block);
+	case 1: {
+		ir_place(work.label);
 
-	ir_append(IR_JMP, (int64_t) while_start, 0, 0);
+		ir_work_t *loop = ir_push(stmt, 2);
+		*loop = work;
+		loop->stage = 2;
 
-	ir_t *while_end = ir_append(IR_NOP, 0, 0, 0);
+		ir_push_cond(stmt->while_stmt.while_cond, 1, work.body);
+		break;
+	}
 
-	while_cond->arg3 = (int64_t) while_end;
+	case 2: {
+		int while_cond = work.label;
+		int while_end = work.end;
+		ir_place(while_end);
 
-	// Add the breaks and continues
-	for (int i = 0; i < total_breaks; i++) 
-		breaks[i]->arg1 = (int64_t) while_end;
-	for (int i = 0; i < total_continues; i++) 
-		continues[i]->arg1 = (int64_t) while_start;
+		// Add the breaks and continues of this loop; the ones of the loops
+		// around it stay pending
+		for (int i = work.breaks; i < total_breaks; i++)
+			code[breaks[i]].arg1 = while_end;
+		for (int i = work.continues; i < total_continues; i++)
+			code[continues[i]].arg1 = while_cond;
 
-	free(breaks);
-	free(continues);
-	total_breaks = 0;
-	total_continues = 0;
-	breaks = NULL;
-	continues = NULL;
+		total_breaks = work.breaks;
+		total_continues = work.continues;
+		break;
+	}
+	}
 }
 
-void ir_break_stmt(ast_t *stmt) {
+void ir_break_stmt(ir_work_t work) {
 	// Need to add the result in the while statements
-	ir_t *res = ir_append(IR_JMP, 0, 0, 0);
+	int res = ir_append(IR_JMP, 0, 0, 0);
 	ir_append_break(res);
 }
 
-void ir_continue_stmt(ast_t *stmt) {
+void ir_continue_stmt(ir_work_t work) {
 	// Need to add the result in the while statements
-	ir_t *res = ir_append(IR_JMP, 0, 0, 0);
+	int res = ir_append(IR_JMP, 0, 0, 0);
 	ir_append_continue(res);
 }
 
-void ir_block_stmt(ast_t *stmt) {
-	for (ast_t *cur = stmt->block_stmt.stmts; cur; cur = cur->next) {
-		ir_stmt(cur);
+void ir_block_stmt(ir_work_t work) {
+	// Pushed in order, so reversed to be lowered in order
+	int from = total_works;
+	for (ast_t *cur = work.ast->block_stmt.stmts; cur; cur = cur->next) {
+		ir_push(cur, 0);
+	}
+	for (int i = from, j = total_works - 1; i < j; i++, j--) {
+		ir_work_t tmp = works[i];
+		works[i] = works[j];
+		works[j] = tmp;
 	}
 }
 
-void ir_expr_stmt(ast_t *stmt) {
-	ir_expr(stmt->expr_stmt.expr);
-}
-
-int ir_expr(ast_t *expr) {
-	switch (expr->type) {
-	case AST_LITERAL:
-		return ir_literal_expr(expr);
-	case AST_IDENTIFIER:
-		return ir_identifier_expr(expr);
-	case AST_BINARY:
-		return ir_binary_expr(expr);
-	default:
-		fprintf(stderr, "What is this EXPR type?\n");
-		exit(1);
+void ir_expr_stmt(ir_work_t work) {
+	if (work.stage == 0) {
+		ir_push(work.ast, 1);
+		ir_push(work.ast->expr_stmt.expr, 0);
+		return;
 	}
+
+	// The value of the expression is not used
+	ir_pop_value();
 }
 
-int ir_literal_expr(ast_t *expr) {
+void ir_literal_expr(ir_work_t work) {
+	ast_t *expr = work.ast;
 	int reg = new_register();
-	ir_append(IR_LOAD_GLOBAL, reg, expr->offset, expr->data_type->size);
-	return reg;
+	ir_append(IR_LOAD_CONST, reg, ir_const(expr->literal.value), 0);
+	ir_push_value(reg);
+}
+
+void ir_cond(ir_work_t work) {
+	ast_t *expr = work.ast;
+	int op = expr->op;
+
+	if (expr->type == AST_LITERAL) {
+		// Known at compile time, so either always or never jumps
+		if ((expr->literal.value != 0) == work.jump_if)
+			ir_append(IR_JMP, work.target, 0, 0);
+		return;
+	}
+
+	if (expr->type == AST_UNARY && op == TT_BANG) {
+		ir_push_cond(expr->unary.expr, !work.jump_if, work.target);
+		return;
+	}
+
+	if (expr->type == AST_BINARY && (op == TT_AND_AND || op == TT_OR_OR)) {
+		if (work.stage == 1) {
+			ir_place(work.label);
+			return;
+		}
+
+		// Jumping when a && is false (or a || is true) is decided by either
+		// operand; otherwise the left operand skips the right one
+		ast_t *left = expr->binary.left, *right = expr->binary.right;
+		if ((op == TT_AND_AND) != work.jump_if) {
+			ir_push_cond(right, work.jump_if, work.target);
+			ir_push_cond(left, work.jump_if, work.target);
+			return;
+		}
+
+		int skip = ir_label();
+		ir_work_t *place = ir_push(expr, 1);
+		place->cond = 1;
+		place->label = skip;
+
+		ir_push_cond(right, work.jump_if, work.target);
+		ir_push_cond(left, !work.jump_if, skip);
+		return;
+	}
+
+	int compare = expr->type == AST_BINARY ? ir_compare(op) : -1;
+
+	if (work.stage == 0) {
+		ir_work_t *jump = ir_push(expr, 1);
+		*jump = work;
+		jump->stage = 1;
+
+		if (compare < 0) {
+			ir_push(expr, 0);
+			return;
+		}
+
+		// A literal operand is compared as an immediate
+		ast_t *left = expr->binary.left, *right = expr->binary.right;
+		if (right->type != AST_LITERAL) ir_push(right, 0);
+		if (left->type != AST_LITERAL || right->type == AST_LITERAL)
+			ir_push(left, 0);
+		return;
+	}
+
+	if (compare < 0) {
+		int reg = ir_pop_value();
+		int type = work.jump_if ? IR_JMP_TRUE : IR_JMP_FALSE;
+		ir_append(type, reg, work.target, 0);
+		return;
+	}
+
+	// Jumping when the comparison is false is jumping on its negation, and
+	// an immediate on the left needs the operands swapped
+	static const int negate[] = {3, 2, 1, 0, 5, 4};
+	static const int swap[] = {2, 3, 0, 1, 4, 5};
+	if (!work.jump_if) compare = negate[compare];
+
+	ast_t *left = expr->binary.left, *right = expr->binary.right;
+	if (right->type == AST_LITERAL) {
+		int reg = ir_pop_value();
+		ir_append(IR_JLTI + compare, reg, ir_const(right->literal.value),
+			work.target);
+	}
+	else if (left->type == AST_LITERAL) {
+		int reg = ir_pop_value();
+		ir_append(IR_JLTI + swap[compare], reg,
+			ir_const(left->literal.value), work.target);
+	}
+	else {
+		int right_reg = ir_pop_value();
+		int left_reg = ir_pop_value();
+		ir_append(IR_JLT + compare, left_reg, right_reg, work.target);
+	}
 }
 
-int ir_binary_expr(ast_t *expr) {
-	int left_reg = ir_expr(expr->binary.left);
-	int right_reg = ir_expr(expr->binary.right);
+void ir_binary_expr(ir_work_t work) {
+	ast_t *expr = work.ast;
+
+	if (work.stage == 0) {
+		// Pushed in reverse, so the left operand is lowered first
+		ir_push(expr, 1);
+		ir_push(expr->binary.right, 0);
+		ir_push(expr->binary.left, 0);
+		return;
+	}
+
+	int right_reg = ir_pop_value();
+	int left_reg = ir_pop_value();
+
+	int compare = ir_compare(expr->op);
+	if (compare >= 0) {
+		int res = new_register();
+		ir_append(IR_LT + compare, res, left_reg, right_reg);
+		ir_push_value(res);
+		return;
+	}
 
-	switch (expr->binary.op.type) {
+	switch (expr->op) {
 	case TT_PLUS: {
 		int res = new_register();
 		ir_append(IR_ADD, res, left_reg, right_reg);
-		return res;
+		ir_push_value(res);
+		break;
 	}
 	case TT_MINUS: {
 		int res = new_register();
 		ir_append(IR_SUB, res, left_reg, right_reg);
-		return res;
+		ir_push_value(res);
+		break;
 	}
 	case TT_EQUAL: {
-		int64_t offset = expr->binary.left->offset;
-		int64_t size = expr->binary.left->data_type->size;
-		ir_append(IR_GLOBAL_LOAD, offset, size, right_reg);
-		return right_reg;
+		ast_t *left = expr->binary.left;
+		ir_append(ir_store(left->data_type), left->offset, right_reg, 0);
+
+		// The value of an assignment is the value stored, which is
+		// truncated in a fixed width variable
+		if (left->data_type != type_int()) {
+			right_reg = new_register();
+			int load = IR_LOAD8 + ir_width(left->data_type);
+			ir_append(load, right_reg, left->offset, 0);
+		}
+		ir_push_value(right_reg);
+		break;
 	}
 	default:
 		fprintf(stderr, "What is this BINARY_OP type?\n");
@@ -345,21 +862,289 @@ int ir_binary_expr(ast_t *expr) {
 	}
 }
 
-int ir_identifier_expr(ast_t *expr) {
+void ir_logical_expr(ir_work_t work) {
+	ast_t *expr = work.ast;
+
+	// The value of && and || is 0 or 1, set on either side of the jump
+	// that short circuits
+	if (work.stage == 0) {
+		int reg = new_register();
+		ir_append(IR_LOAD_CONST, reg, ir_const(0), 0);
+
+		ir_work_t *value = ir_push(expr, 1);
+		value->reg = reg;
+		value->end = ir_label();
+
+		ir_push_cond(expr, 0, value->end);
+		return;
+	}
+
+	ir_append(IR_LOAD_CONST, work.reg, ir_const(1), 0);
+	ir_place(work.end);
+	ir_push_value(work.reg);
+}
+
+void ir_unary_expr(ir_work_t work) {
+	ast_t *expr = work.ast;
+
+	if (work.stage == 0) {
+		ir_push(expr, 1);
+		ir_push(expr->unary.expr, 0);
+		return;
+	}
+
+	int reg = ir_pop_value();
+	int res = new_register();
+	ir_append(IR_NOT, res, reg, 0);
+	ir_push_value(res);
+}
+
+void ir_identifier_expr(ir_work_t work) {
+	ast_t *expr = work.ast;
 	int reg = new_register();
-	ir_append(IR_LOAD_GLOBAL, reg, expr->offset, expr->data_type->size);
-	return reg;
+	ir_append(IR_LOAD8 + ir_width(expr->data_type), reg, expr->offset, 0);
+	ir_push_value(reg);
 }
 
-void ir_append_break(ir_t *break_ir) {
-	total_breaks++;
-	breaks = realloc(breaks, total_breaks * sizeof(ir_t*));
-	breaks[total_breaks-1] = break_ir;
+void ir_append_break(int break_ir) {
+	if (total_breaks == breaks_cap) {
+		breaks_cap = breaks_cap ? breaks_cap * 2 : 16;
+		breaks = realloc(breaks, breaks_cap * sizeof(int));
+		if (breaks == NULL) {
+			perror("Error in ir_append_break with realloc");
+			exit(1);
+		}
+	}
+	breaks[total_breaks++] = break_ir;
 }
 
-void ir_append_continue(ir_t *continue_ir) {
-	total_continues++;
-	continues = realloc(continues, total_continues * sizeof(ir_t*));
-	continues[total_continues-1] = continue_ir;
+void ir_append_continue(int continue_ir) {
+	if (total_continues == continues_cap) {
+		continues_cap = continues_cap ? continues_cap * 2 : 16;
+		continues = realloc(continues, continues_cap * sizeof(int));
+		if (continues == NULL) {
+			perror("Error in ir_append_continue with realloc");
+			exit(1);
+		}
+	}
+	continues[total_continues++] = continue_ir;
 }
 
+const char *ir_name(ir_t *ir, int *size) {
+	// Name of the instruction and the number of arguments it uses
+	const char *name = "UNKNOWN";
+	*size = 0;
+
+	switch (ir->type) {
+	case IR_NOP:
+		name = "IR_NOP";
+		break;
+
+	case IR_GLOBAL_LOAD_CONST:
+		name = "IR_GLOBAL_LOAD_CONST";
+		*size = 3;
+		break;
+
+	case IR_STORE8:
+		name = "IR_STORE8";
+		*size = 2;
+		break;
+
+	case IR_STORE16:
+		name = "IR_STORE16";
+		*size = 2;
+		break;
+
+	case IR_STORE32:
+		name = "IR_STORE32";
+		*size = 2;
+		break;
+
+	case IR_STORE64:
+		name = "IR_STORE64";
+		*size = 2;
+		break;
+
+	case IR_STORE_INT:
+		name = "IR_STORE_INT";
+		*size = 2;
+		break;
+
+	case IR_LOAD8:
+		name = "IR_LOAD8";
+		*size = 2;
+		break;
+
+	case IR_LOAD16:
+		name = "IR_LOAD16";
+		*size = 2;
+		break;
+
+	case IR_LOAD32:
+		name = "IR_LOAD32";
+		*size = 2;
+		break;
+
+	case IR_LOAD64:
+		name = "IR_LOAD64";
+		*size = 2;
+		break;
+
+	case IR_ADD:
+		name = "IR_ADD";
+		*size = 3;
+		break;
+
+	case IR_SUB:
+		name = "IR_SUB";
+		*size = 3;
+		break;
+
+	case IR_PRINT:
+		name = "IR_PRINT";
+		*size = 1;
+		break;
+
+	case IR_JMP_TRUE:
+		name = "IR_JMP_TRUE";
+		*size = 2;
+		break;
+
+	case IR_JMP:
+		name = "IR_JMP";
+		*size = 1;
+		break;
+
+	case IR_JMP_FALSE:
+		name = "IR_JMP_FALSE";
+		*size = 2;
+		break;
+
+	case IR_LOAD_CONST:
+		name = "IR_LOAD_CONST";
+		*size = 2;
+		break;
+
+	case IR_LT:
+		name = "IR_LT";
+		*size = 3;
+		break;
+
+	case IR_LE:
+		name = "IR_LE";
+		*size = 3;
+		break;
+
+	case IR_GT:
+		name = "IR_GT";
+		*size = 3;
+		break;
+
+	case IR_GE:
+		name = "IR_GE";
+		*size = 3;
+		break;
+
+	case IR_EQ:
+		name = "IR_EQ";
+		*size = 3;
+		break;
+
+	case IR_NE:
+		name = "IR_NE";
+		*size = 3;
+		break;
+
+	case IR_NOT:
+		name = "IR_NOT";
+		*size = 2;
+		break;
+
+	case IR_JLT:
+		name = "IR_JLT";
+		*size = 3;
+		break;
+
+	case IR_JLE:
+		name = "IR_JLE";
+		*size = 3;
+		break;
+
+	case IR_JGT:
+		name = "IR_JGT";
+		*size = 3;
+		break;
+
+	case IR_JGE:
+		name = "IR_JGE";
+		*size = 3;
+		break;
+
+	case IR_JEQ:
+		name = "IR_JEQ";
+		*size = 3;
+		break;
+
+	case IR_JNE:
+		name = "IR_JNE";
+		*size = 3;
+		break;
+
+	case IR_JLTI:
+		name = "IR_JLTI";
+		*size = 3;
+		break;
+
+	case IR_JLEI:
+		name = "IR_JLEI";
+		*size = 3;
+		break;
+
+	case IR_JGTI:
+		name = "IR_JGTI";
+		*size = 3;
+		break;
+
+	case IR_JGEI:
+		name = "IR_JGEI";
+		*size = 3;
+		break;
+
+	case IR_JEQI:
+		name = "IR_JEQI";
+		*size = 3;
+		break;
+
+	case IR_JNEI:
+		name = "IR_JNEI";
+		*size = 3;
+		break;
+
+	case IR_MOV:
+		name = "IR_MOV";
+		*size = 2;
+		break;
+
+	case IR_WRAP8:
+		name = "IR_WRAP8";
+		*size = 2;
+		break;
+
+	case IR_WRAP16:
+		name = "IR_WRAP16";
+		*size = 2;
+		break;
+
+	case IR_WRAP32:
+		name = "IR_WRAP32";
+		*size = 2;
+		break;
+
+	case IR_WRAP64:
+		name = "IR_WRAP64";
+		*size = 2;
+		break;
+	}
+
+	return name;
+}
@@ -0,0 +1,443 @@
+#include "lsp.h"
+#include "buffer.h"
+#include "document.h"
+#include "util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+// Slice of the message being handled; json values are looked up in place
+typedef struct {
+	const char *str;
+	int len;
+} json_t;
+
+typedef struct {
+	char *uri;
+	document_t *doc;
+} lsp_doc_t;
+
+static lsp_doc_t *docs = NULL;
+static int total_docs = 0;
+static int stats = 0;
+
+char *lsp_read_message(int *len);
+void lsp_send(buffer_t *body);
+void lsp_respond(json_t id, const char *result);
+void lsp_respond_error(json_t id, int code, const char *message);
+void lsp_handle(json_t message, int *shutdown, int *exit_code);
+void lsp_did_open(json_t params);
+void lsp_did_change(json_t params);
+void lsp_did_close(json_t params);
+void lsp_publish(const char *uri, document_t *doc);
+int lsp_find_doc(json_t uri);
+
+const char *json_skip_space(const char *p, const char *end);
+const char *json_skip_value(const char *p, const char *end);
+json_t json_get(json_t object, const char *key);
+int json_next(json_t *array, json_t *item);
+char *json_string(json_t value, int *len);
+int json_int(json_t value);
+int json_equal(json_t value, const char *str);
+
+// ========================================
+// lsp.h - definition
+// ========================================
+
+int lsp_run(int stats_flag) {
+	stats = stats_flag;
+
+	int shutdown = 0, exit_code = -1;
+	while (exit_code < 0) {
+		int len;
+		char *message = lsp_read_message(&len);
+		if (message == NULL) return shutdown ? 0 : 1;
+
+		lsp_handle((json_t) {message, len}, &shutdown, &exit_code);
+		free(message);
+	}
+
+	for (int i = 0; i < total_docs; i++) {
+		free(docs[i].uri);
+		document_close(docs[i].doc);
+	}
+	free(docs);
+	return exit_code;
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+char *lsp_read_message(int *len) {
+	// Headers end with an empty line; only Content-Length matters
+	char line[256];
+	int content_length = -1;
+	while (fgets(line, sizeof(line), stdin)) {
+		if (strcmp(line, "\r\n") == 0 || strcmp(line, "\n") == 0) break;
+		if (strncmp(line, "Content-Length:", 15) == 0) {
+			content_length = atoi(line + 15);
+		}
+	}
+	if (content_length < 0) return NULL;
+
+	char *message = malloc(content_length + 1);
+	if (message == NULL) {
+		perror("Error in lsp_read_message with malloc");
+		exit(1);
+	}
+
+	if (fread(message, 1, content_length, stdin) != content_length) {
+		free(message);
+		return NULL;
+	}
+	message[content_length] = '\0';
+
+	*len = content_length;
+	return message;
+}
+
+void lsp_send(buffer_t *body) {
+	printf("Content-Length: %d\r\n\r\n", body->len);
+	fwrite(body->data, 1, body->len, stdout);
+	fflush(stdout);
+	free_buffer(body);
+}
+
+void lsp_respond(json_t id, const char *result) {
+	buffer_t body = {};
+	buffer_printf(&body, "{\"jsonrpc\":\"2.0\",\"id\":%.*s,\"result\":%s}",
+		id.len, id.str, result);
+	lsp_send(&body);
+}
+
+void lsp_respond_error(json_t id, int code, const char *message) {
+	buffer_t body = {};
+	buffer_printf(&body, "{\"jsonrpc\":\"2.0\",\"id\":%.*s,\"error\":"
+		"{\"code\":%d,\"message\":", id.len, id.str, code);
+	buffer_string(&body, message, strlen(message));
+	buffer_append(&body, "}}", 2);
+	lsp_send(&body);
+}
+
+void lsp_handle(json_t message, int *shutdown, int *exit_code) {
+	json_t method = json_get(message, "method");
+	json_t id = json_get(message, "id");
+	json_t params = json_get(message, "params");
+
+	if (json_equal(method, "initialize")) {
+		// Sources are ascii, so columns are the same in every encoding
+		lsp_respond(id, "{\"capabilities\":{\"positionEncoding\":\"utf-8\","
+			"\"textDocumentSync\":{\"openClose\":true,\"change\":2}},"
+			"\"serverInfo\":{\"name\":\"lemon\"}}");
+	}
+	else if (json_equal(method, "shutdown")) {
+		*shutdown = 1;
+		lsp_respond(id, "null");
+	}
+	else if (json_equal(method, "exit")) {
+		*exit_code = *shutdown ? 0 : 1;
+	}
+	else if (json_equal(method, "textDocument/didOpen")) {
+		lsp_did_open(params);
+	}
+	else if (json_equal(method, "textDocument/didChange")) {
+		lsp_did_change(params);
+	}
+	else if (json_equal(method, "textDocument/didClose")) {
+		lsp_did_close(params);
+	}
+	else if (id.str) {
+		lsp_respond_error(id, -32601, "Method not found");
+	}
+}
+
+void lsp_did_open(json_t params) {
+	json_t item = json_get(params, "textDocument");
+	json_t uri = json_get(item, "uri");
+	if (!uri.str) return;
+
+	int len;
+	char *text = json_string(json_get(item, "text"), &len);
+
+	double start = time_now();
+	int index = lsp_find_doc(uri);
+	if (index < 0) {
+		docs = realloc(docs, (total_docs + 1) * sizeof(lsp_doc_t));
+		if (docs == NULL) {
+			perror("Error in lsp_did_open with realloc");
+			exit(1);
+		}
+		index = total_docs++;
+		docs[index].uri = json_string(uri, NULL);
+	}
+	else document_close(docs[index].doc);
+
+	docs[index].doc = document_open(docs[index].uri, text, len);
+	free(text);
+
+	if (stats) {
+		fprintf(stderr, "[stats] lsp: didOpen | %d statements | %.3f ms\n",
+			document_reparsed(docs[index].doc), (time_now() - start) * 1000);
+	}
+	lsp_publish(docs[index].uri, docs[index].doc);
+}
+
+void lsp_did_change(json_t params) {
+	int index = lsp_find_doc(json_get(json_get(params, "textDocument"), "uri"));
+	if (index < 0) return;
+	document_t *doc = docs[index].doc;
+
+	double start = time_now();
+	int reparsed = 0;
+
+	json_t changes = json_get(params, "contentChanges"), change;
+	while (json_next(&changes, &change)) {
+		int len;
+		char *text = json_string(json_get(change, "text"), &len);
+
+		// Without a range the change is the whole new text
+		int from = 0, to = 1 << 30;
+		json_t range = json_get(change, "range");
+		if (range.str) {
+			json_t pos = json_get(range, "start");
+			from = document_offset(doc, json_int(json_get(pos, "line")),
+				json_int(json_get(pos, "character")));
+			pos = json_get(range, "end");
+			to = document_offset(doc, json_int(json_get(pos, "line")),
+				json_int(json_get(pos, "character")));
+		}
+
+		document_edit(doc, from, to, text, len);
+		reparsed += document_reparsed(doc);
+		free(text);
+	}
+
+	if (stats) {
+		fprintf(stderr, "[stats] lsp: didChange | %d statements reparsed | %.3f ms\n",
+			reparsed, (time_now() - start) * 1000);
+	}
+	lsp_publish(docs[index].uri, doc);
+}
+
+void lsp_did_close(json_t params) {
+	int index = lsp_find_doc(json_get(json_get(params, "textDocument"), "uri"));
+	if (index < 0) return;
+
+	// Clear the diagnostics of the closed document
+	buffer_t body = {};
+	buffer_append(&body, "{\"jsonrpc\":\"2.0\",\"method\":"
+		"\"textDocument/publishDiagnostics\",\"params\":{\"uri\":", -1);
+	buffer_string(&body, docs[index].uri, strlen(docs[index].uri));
+	buffer_append(&body, ",\"diagnostics\":[]}}", -1);
+	lsp_send(&body);
+
+	free(docs[index].uri);
+	document_close(docs[index].doc);
+	docs[index] = docs[--total_docs];
+}
+
+void lsp_publish(const char *uri, document_t *doc) {
+	buffer_t body = {};
+	buffer_append(&body, "{\"jsonrpc\":\"2.0\",\"method\":"
+		"\"textDocument/publishDiagnostics\",\"params\":{\"uri\":", -1);
+	buffer_string(&body, uri, strlen(uri));
+	buffer_append(&body, ",\"diagnostics\":[", -1);
+
+	diagnostic_t *diagnostics;
+	int total = document_diagnostics(doc, &diagnostics);
+	for (int i = 0; i < total; i++) {
+		int start_line, start_column, end_line, end_column;
+		document_position(doc, diagnostics[i].start, &start_line,
+			&start_column);
+		document_position(doc, diagnostics[i].end, &end_line, &end_column);
+
+		buffer_printf(&body, "%s{\"range\":{\"start\":{\"line\":%d,"
+			"\"character\":%d},\"end\":{\"line\":%d,\"character\":%d}},"
+			"\"severity\":1,\"source\":\"lemon\",\"message\":", i ? "," : "",
+			start_line, start_column, end_line, end_column);
+		buffer_string(&body, diagnostics[i].message,
+			strlen(diagnostics[i].message));
+		buffer_append(&body, "}", 1);
+	}
+
+	buffer_append(&body, "]}}", 3);
+	lsp_send(&body);
+}
+
+int lsp_find_doc(json_t uri) {
+	if (!uri.str) return -1;
+
+	int len;
+	char *str = json_string(uri, &len);
+	int index = -1;
+	for (int i = 0; i < total_docs && index < 0; i++) {
+		if (strcmp(docs[i].uri, str) == 0) index = i;
+	}
+	free(str);
+	return index;
+}
+
+const char *json_skip_space(const char *p, const char *end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+		p++;
+	}
+	return p;
+}
+
+const char *json_skip_value(const char *p, const char *end) {
+	p = json_skip_space(p, end);
+	if (p >= end) return end;
+
+	if (*p == '"') {
+		for (p++; p < end && *p != '"'; p++) {
+			if (*p == '\\') p++;
+		}
+		return p < end ? p + 1 : end;
+	}
+
+	if (*p == '{' || *p == '[') {
+		// Brackets inside strings are skipped with the strings
+		int depth = 0;
+		while (p < end) {
+			if (*p == '"') {
+				p = json_skip_value(p, end);
+				continue;
+			}
+			if (*p == '{' || *p == '[') depth++;
+			else if (*p == '}' || *p == ']') {
+				if (--depth == 0) return p + 1;
+			}
+			p++;
+		}
+		return end;
+	}
+
+	while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' &&
+		*p != '\n' && *p != '\r' && *p != '\t') {
+		p++;
+	}
+	return p;
+}
+
+json_t json_get(json_t object, const char *key) {
+	json_t res = {NULL, 0};
+	if (!object.str) return res;
+
+	const char *end = object.str + object.len;
+	const char *p = json_skip_space(object.str, end);
+	if (p >= end || *p != '{') return res;
+	p++;
+
+	int key_len = strlen(key);
+	while (p < end) {
+		p = json_skip_space(p, end);
+		if (p >= end || *p == '}') break;
+
+		const char *name = p;
+		p = json_skip_value(p, end);
+		int match = p - name == key_len + 2 &&
+			strncmp(name + 1, key, key_len) == 0;
+
+		p = json_skip_space(p, end);
+		if (p < end && *p == ':') p++;
+		p = json_skip_space(p, end);
+
+		const char *value = p;
+		p = json_skip_value(p, end);
+		if (match) {
+			res.str = value;
+			res.len = p - value;
+			return res;
+		}
+
+		p = json_skip_space(p, end);
+		if (p < end && *p == ',') p++;
+	}
+
+	return res;
+}
+
+int json_next(json_t *array, json_t *item) {
+	// Consumes the array from the front
+	if (!array->str) return 0;
+
+	const char *end = array->str + array->len;
+	const char *p = json_skip_space(array->str, end);
+	if (p < end && (*p == '[' || *p == ',')) p++;
+	p = json_skip_space(p, end);
+	if (p >= end || *p == ']') return 0;
+
+	item->str = p;
+	p = json_skip_value(p, end);
+	item->len = p - item->str;
+
+	array->len = end - p;
+	array->str = p;
+	return 1;
+}
+
+char *json_string(json_t value, int *len) {
+	char *res = malloc(value.len + 1);
+	if (res == NULL) {
+		perror("Error in json_string with malloc");
+		exit(1);
+	}
+
+	int size = 0;
+	for (int i = 1; i + 1 < value.len; i++) {
+		char ch = value.str[i];
+		if (ch != '\\') {
+			res[size++] = ch;
+			continue;
+		}
+
+		ch = value.str[++i];
+		switch (ch) {
+		case 'n': res[size++] = '\n'; break;
+		case 't': res[size++] = '\t'; break;
+		case 'r': res[size++] = '\r'; break;
+		case 'b': res[size++] = '\b'; break;
+		case 'f': res[size++] = '\f'; break;
+		case 'u': {
+			// Encoded back as utf-8; surrogate pairs are not joined
+			char hex[5] = {};
+			for (int j = 0; j < 4 && i + 1 < value.len; j++) {
+				hex[j] = value.str[++i];
+			}
+			unsigned code = strtoul(hex, NULL, 16);
+			if (code < 0x80) res[size++] = code;
+			else if (code < 0x800) {
+				res[size++] = 0xc0 | (code >> 6);
+				res[size++] = 0x80 | (code & 0x3f);
+			}
+			else {
+				res[size++] = 0xe0 | (code >> 12);
+				res[size++] = 0x80 | ((code >> 6) & 0x3f);
+				res[size++] = 0x80 | (code & 0x3f);
+			}
+			break;
+		}
+		default: res[size++] = ch; break;
+		}
+	}
+
+	res[size] = '\0';
+	if (len) *len = size;
+	return res;
+}
+
+int json_int(json_t value) {
+	return value.str ? atoi(value.str) : 0;
+}
+
+int json_equal(json_t value, const char *str) {
+	int len = strlen(str);
+	return value.str && value.len == len + 2 &&
+		strncmp(value.str + 1, str, len) == 0;
+}
@@ -1,19 +1,42 @@
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
+#include "buffer.h"
 #include "token.h"
 #include "ast.h"
 #include "util.h"
 #include "analyze.h"
 #include "ir.h"
 #include "vm.h"
+#include "lsp.h"
+#include "intern.h"
+#include "bytecode.h"
+#include "cfg.h"
+#include "ssa.h"
+#include "opt.h"
 
 // ========================================
 // helper declaration
 // ========================================
 
 void usage(FILE *fd);
+void print_lex_stats(long bytes, int total_tokens, int threads,
+	double seconds);
+void print_stream_stats(long bytes, int total_stmts, int peak_tokens,
+	double seconds);
+void print_dump_stats(const char *dump, long bytes, double seconds);
+void print_cache_stats(int hit, const char *path, double seconds);
+void dump_cfg(ir_prog_t *ir, buffer_t *out, int stats_flag);
+ir_prog_t *compile_stream(const char *filepath, file_t file, int opt_level,
+	int keep_globals, int stats_flag);
+void free_front_end(tokens_t *tokens, file_t file);
+ir_prog_t *load_cached(const char *path, uint64_t key);
+int run_program(ir_prog_t *ir, uint64_t key, char *cache_path,
+	const char *emit_path, int vm_state_flag, buffer_t *out);
 
 // ========================================
 // main definition
@@ -27,7 +50,16 @@ int main(int argc, const char **argv) {
 	int ast_flag = 0;
 	int st_flag = 0;
 	int ir_flag = 0;
+	int cfg_flag = 0;
 	int vm_state_flag = 0;
+	int stats_flag = 0;
+	int stream_flag = 0;
+	int lsp_flag = 0;
+	int dump_format = DUMP_TEXT;
+	int lex_threads = 1;
+	int opt_level = 0;
+	const char *emit_path = NULL;
+	const char *cache_dir = getenv("LEMON_CACHE_DIR");
 
 	while (arg_index < argc) {
 		if (strcmp("--help", argv[arg_index]) == 0 ||
@@ -46,9 +78,59 @@ int main(int argc, const char **argv) {
 		else if (strcmp("--only-ir", argv[arg_index]) == 0) {
 			ir_flag = 1;
 		}
+		else if (strcmp("--only-cfg", argv[arg_index]) == 0) {
+			cfg_flag = 1;
+		}
 		else if (strcmp("--only-vm-state", argv[arg_index]) == 0) {
 			vm_state_flag = 1;
 		}
+		else if (strcmp("--stats", argv[arg_index]) == 0) {
+			stats_flag = 1;
+		}
+		else if (strcmp("--lsp", argv[arg_index]) == 0) {
+			lsp_flag = 1;
+		}
+		else if (strcmp("--stream", argv[arg_index]) == 0) {
+			stream_flag = 1;
+		}
+		else if (strcmp("--jsonl", argv[arg_index]) == 0) {
+			dump_format = DUMP_JSONL;
+		}
+		else if (strncmp("-O", argv[arg_index], 2) == 0) {
+			const char *level = argv[arg_index] + 2;
+			if (level[0] < '0' || level[0] > '0' + OPT_MAX_LEVEL ||
+				level[1] != '\0') {
+				fprintf(stderr, "ERROR: Unknown optimization level '%s'\n",
+					argv[arg_index]);
+				usage(stderr);
+				return 1;
+			}
+			opt_level = level[0] - '0';
+		}
+		else if (strcmp("--lex-threads", argv[arg_index]) == 0) {
+			if (arg_index + 1 >= argc || atoi(argv[arg_index + 1]) < 1) {
+				fprintf(stderr, "ERROR: --lex-threads expects a positive number\n");
+				usage(stderr);
+				return 1;
+			}
+			lex_threads = atoi(argv[++arg_index]);
+		}
+		else if (strcmp("--emit-bytecode", argv[arg_index]) == 0) {
+			if (arg_index + 1 >= argc) {
+				fprintf(stderr, "ERROR: --emit-bytecode expects a file\n");
+				usage(stderr);
+				return 1;
+			}
+			emit_path = argv[++arg_index];
+		}
+		else if (strcmp("--cache-dir", argv[arg_index]) == 0) {
+			if (arg_index + 1 >= argc) {
+				fprintf(stderr, "ERROR: --cache-dir expects a directory\n");
+				usage(stderr);
+				return 1;
+			}
+			cache_dir = argv[++arg_index];
+		}
 		else break;
 
 		arg_index++;
@@ -59,6 +141,10 @@ int main(int argc, const char **argv) {
 		return 0;
 	}
 
+	if (lsp_flag) {
+		return lsp_run(stats_flag);
+	}
+
 	if (arg_index >= argc) {
 		fprintf(stderr, "ERROR: No source files provided\n");
 		usage(stderr);
@@ -66,54 +152,167 @@ int main(int argc, const char **argv) {
 	}
 
 	const char *filepath = argv[arg_index];
-	char *src = read_file(filepath);
+	file_t file = read_file(filepath);
+	if (file.len >= INT32_MAX) {
+		fprintf(stderr, "ERROR: '%s' is too large (max 2 GiB)\n", filepath);
+		return 1;
+	}
+
+	// Dumps are written through one buffer; everything else printed to
+	// stdout goes through stdio after it is flushed
+	buffer_t out = buffer_sink(stdout);
+	double dump_start;
+	int front_end_dump = tokens_flag || ast_flag || st_flag;
+
+	// Bytecode runs as it is loaded, without optimizing it again; --only-ir
+	// and --only-cfg print it back
+	if (is_bytecode(file)) {
+		if (front_end_dump) {
+			fprintf(stderr, "ERROR: '%s' is bytecode, it has no source to dump\n",
+				filepath);
+			return 1;
+		}
 
-	token_t *tokens = generate_tokens(filepath, src);
+		const char *error;
+		uint64_t key;
+		ir_prog_t *ir = load_bytecode(file, &key, &error);
+		if (ir == NULL) {
+			fprintf(stderr, "ERROR: '%s' is not valid bytecode: %s\n",
+				filepath, error);
+			return 1;
+		}
+
+		if (ir_flag || cfg_flag) {
+			if (ir_flag) print_ir(ir, &out, dump_format);
+			else dump_cfg(ir, &out, stats_flag);
+			free_buffer(&out);
+			return 0;
+		}
+		return run_program(ir, key, NULL, emit_path, vm_state_flag, &out);
+	}
+
+	// With a cache directory, a source compiled before runs from its
+	// bytecode without going through the front end at all
+	int runs = !front_end_dump && !ir_flag && !cfg_flag;
+	uint64_t key = 0;
+	char *cache_path = NULL;
+	if (runs && (cache_dir || emit_path)) key = bytecode_key(file, opt_level, vm_state_flag);
+	if (runs && cache_dir) {
+		double cache_start = time_now();
+		mkdir(cache_dir, 0755);
+		cache_path = bytecode_cache_path(cache_dir, key);
+		ir_prog_t *ir = load_cached(cache_path, key);
+		if (stats_flag) {
+			print_cache_stats(ir != NULL, cache_path, time_now() - cache_start);
+		}
+
+		if (ir) {
+			free_file(file);
+			free(cache_path);
+			return run_program(ir, key, NULL, emit_path, vm_state_flag, &out);
+		}
+	}
+
+	// Every phase allocates from its own arena; only the program is needed
+	// to run it
+	arena_t ast_arena = {}, memory_arena = {}, name_arena = {};
+
+	// The dumps need the whole program, so they always go through the
+	// batch pipeline
+	if (stream_flag && !front_end_dump) {
+		ir_prog_t *ir = compile_stream(filepath, file, opt_level, vm_state_flag,
+			stats_flag);
+		free_front_end(NULL, file);
+
+		if (cfg_flag && !ir_flag) {
+			dump_cfg(ir, &out, stats_flag);
+			free_buffer(&out);
+			return 0;
+		}
+
+		if (ir_flag) {
+			dump_start = time_now();
+			print_ir(ir, &out, dump_format);
+			if (stats_flag) {
+				print_dump_stats("ir", out.total, time_now() - dump_start);
+			}
+			free_buffer(&out);
+			return 0;
+		}
+
+		return run_program(ir, key, cache_path, emit_path, vm_state_flag,
+			&out);
+	}
+
+	double lex_start = time_now();
+	tokens_t *tokens = generate_tokens_parallel(filepath, file.src, file.len,
+		lex_threads);
+	double lex_time = time_now() - lex_start;
+
+	if (stats_flag) {
+		print_lex_stats(file.len, tokens->count, lex_threads, lex_time);
+	}
 
 	if (tokens_flag) {
-		for (token_t *cur = tokens; cur; cur = cur->next) { 
-			char *lexical = token_lexical(*cur);
-			printf("%s | %s\n", token_type(*cur), lexical);
-			free(lexical);
+		dump_start = time_now();
+		print_tokens(tokens, &out, dump_format);
+		if (stats_flag) {
+			print_dump_stats("tokens", out.total, time_now() - dump_start);
 		}
+		free_buffer(&out);
 		return 0;
 	}
 
-	ast_t *ast = generate_ast(tokens);
+	ast_t *ast = generate_ast(tokens, &ast_arena);
 
 	if (ast_flag) {
-		print_ast(ast);
+		dump_start = time_now();
+		print_ast(ast, tokens, &out, dump_format);
+		if (stats_flag) {
+			print_dump_stats("ast", out.total, time_now() - dump_start);
+		}
+		free_buffer(&out);
 		return 0;
 	}
 
-	analyze(ast);
+	analyze(ast, tokens, &memory_arena, &name_arena);
 
 	if (st_flag) {
-		print_ast_scope(ast);
+		print_ast_scope(ast, tokens);
 		return 0;
 	}
 
-	ir_t *ir = generate_ir(ast);
+	ir_prog_t *ir = generate_ir(ast);
+	optimize(ir, opt_level, vm_state_flag, stats_flag);
 
-	if (ir_flag) {
-		print_ast_scope(ast);
-		print_ir(ir);
+	if (cfg_flag && !ir_flag) {
+		dump_cfg(ir, &out, stats_flag);
+		free_buffer(&out);
 		return 0;
 	}
 
-	run_vm(ir);
-	if (vm_state_flag) {
-		print_ir(ir);
-		printf("\n");
-		print_vm_state(ir);
+	if (ir_flag) {
+		// The scope dump is text only
+		if (dump_format == DUMP_TEXT) {
+			print_ast_scope(ast, tokens);
+			fflush(stdout);
+		}
+
+		dump_start = time_now();
+		print_ir(ir, &out, dump_format);
+		if (stats_flag) {
+			print_dump_stats("ir", out.total, time_now() - dump_start);
+		}
+		free_buffer(&out);
 		return 0;
 	}
 
-	free_ast(ast);
-	free_tokens(tokens);
-	free(src);
+	arena_free(&ast_arena);
+	arena_free(&name_arena);
+	arena_free(&memory_arena);
+	free_front_end(tokens, file);
 
-	return 0;
+	return run_program(ir, key, cache_path, emit_path, vm_state_flag, &out);
 }
 
 // ========================================
@@ -129,10 +328,151 @@ void usage(FILE *fd) {
 	fprintf(fd, "    --only-ast       Only print ast\n");
 	fprintf(fd, "    --only-st        Only print symbol table\n");
 	fprintf(fd, "    --only-ir        Only print ir\n");
+	fprintf(fd, "    --only-cfg       Only print the basic blocks of the ir\n");
 	fprintf(fd, "    --only-vm-state  Only print vm state\n");
+	fprintf(fd, "    --stats          Print phase statistics to stderr\n");
+	fprintf(fd, "    -O0, -O1, -O2    Optimization level of the ir (default -O0)\n");
+	fprintf(fd, "    --stream         Compile one top-level statement at a time\n");
+	fprintf(fd, "    --lex-threads N  Lex the source with up to N threads\n");
+	fprintf(fd, "    --lsp            Run as a language server over stdio\n");
+	fprintf(fd, "    --jsonl          Print the tokens, ast and ir dumps as json lines\n");
+	fprintf(fd, "    --emit-bytecode FILE\n");
+	fprintf(fd, "                     Write the program as bytecode instead of running it\n");
+	fprintf(fd, "    --cache-dir DIR  Cache the bytecode of sources in DIR (default\n");
+	fprintf(fd, "                     $LEMON_CACHE_DIR, no cache if unset)\n");
 	fprintf(fd, "\n");
 	fprintf(fd, "MORE INFO:\n");
 	fprintf(fd, "    -> To read from stdin run as follows './lemon -'\n");
+	fprintf(fd, "    -> Bytecode files run like sources: './lemon prog.lbc'\n");
 	fprintf(fd, "\n");
 }
 
+
+void print_lex_stats(long bytes, int total_tokens, int threads,
+	double seconds) {
+	double mb = bytes / (1024.0 * 1024.0);
+	double rate = seconds > 0 ? mb / seconds : 0;
+	fprintf(stderr, "[stats] lex: %ld bytes | %d tokens | %d threads | %.3f ms | %.1f MB/s\n",
+		bytes, total_tokens, threads, seconds * 1000, rate);
+}
+
+void print_stream_stats(long bytes, int total_stmts, int peak_tokens,
+	double seconds) {
+	fprintf(stderr, "[stats] stream: %ld bytes | %d statements | %d peak tokens | %.3f ms\n",
+		bytes, total_stmts, peak_tokens, seconds * 1000);
+}
+
+void print_dump_stats(const char *dump, long bytes, double seconds) {
+	double mb = bytes / (1024.0 * 1024.0);
+	double rate = seconds > 0 ? mb / seconds : 0;
+	fprintf(stderr, "[stats] dump: %s | %ld bytes | %.3f ms | %.1f MB/s\n",
+		dump, bytes, seconds * 1000, rate);
+}
+
+void print_cache_stats(int hit, const char *path, double seconds) {
+	fprintf(stderr, "[stats] cache: %s | %s | %.3f ms\n",
+		hit ? "hit" : "miss", path, seconds * 1000);
+}
+
+void dump_cfg(ir_prog_t *ir, buffer_t *out, int stats_flag) {
+	double start = time_now();
+	arena_t arena = {};
+	cfg_t *cfg = build_cfg(ir, &arena);
+	print_cfg(cfg, out);
+	print_ssa(build_ssa(cfg, &arena), out);
+	arena_free(&arena);
+	if (stats_flag) print_dump_stats("cfg", out->total, time_now() - start);
+}
+
+ir_prog_t *compile_stream(const char *filepath, file_t file, int opt_level,
+	int keep_globals, int stats_flag) {
+	double start = time_now();
+	tokens_t *tokens = generate_tokens_stream(filepath, file.src, 0, file.len);
+
+	arena_t ast_arena = {}, memory_arena = {}, name_arena = {};
+	st_t *memory_scope = analyze_begin(&memory_arena, &name_arena);
+	ir_begin(memory_scope);
+
+	// Each statement is analyzed, lowered and dropped before the next one
+	// is parsed, so only its tokens and nodes are alive at a time
+	int total_stmts = 0;
+	for (ast_t *stmt; (stmt = generate_ast_stmt(tokens, &ast_arena));
+		total_stmts++) {
+		analyze_toplevel(stmt, tokens);
+		ir_toplevel(stmt);
+		arena_free(&ast_arena);
+	}
+
+	if (total_stmts == 0) {
+		fprintf(stderr, "empty program\n");
+		exit(1);
+	}
+
+	if (stats_flag) {
+		print_stream_stats(file.len, total_stmts, tokens->cap,
+			time_now() - start);
+	}
+
+	// The global memory scope gives the size of the globals
+	ir_prog_t *ir = ir_end();
+	arena_free(&name_arena);
+	arena_free(&memory_arena);
+	free_tokens(tokens);
+
+	optimize(ir, opt_level, keep_globals, stats_flag);
+	return ir;
+}
+
+void free_front_end(tokens_t *tokens, file_t file) {
+	// Nothing the vm runs points into the source, the tokens or the
+	// symbol pool
+	if (tokens) free_tokens(tokens);
+	free_intern();
+	free_file(file);
+}
+
+ir_prog_t *load_cached(const char *path, uint64_t key) {
+	// A missing, stale or damaged entry is a miss, and is written again
+	// once the source is compiled
+	if (access(path, R_OK) != 0) return NULL;
+
+	file_t file = read_file(path);
+	const char *error;
+	uint64_t found;
+	ir_prog_t *ir = load_bytecode(file, &found, &error);
+	if (ir && found == key) return ir;
+
+	if (ir) free_ir(ir);
+	else free_file(file);
+	return NULL;
+}
+
+int run_program(ir_prog_t *ir, uint64_t key, char *cache_path,
+	const char *emit_path, int vm_state_flag, buffer_t *out) {
+	// The cache is best effort; a program that cannot be saved still runs
+	if (cache_path) {
+		write_bytecode(ir, key, cache_path);
+		free(cache_path);
+	}
+
+	if (emit_path) {
+		if (write_bytecode(ir, key, emit_path) != 0) {
+			char buffer[1024];
+			snprintf(buffer, 1024, "Error writing '%s'", emit_path);
+			perror(buffer);
+			exit(1);
+		}
+	}
+	else {
+		run_vm(ir);
+		if (vm_state_flag) {
+			print_ir(ir, out, DUMP_TEXT);
+			printf("\n");
+			print_vm_state(ir);
+		}
+	}
+
+	free_buffer(out);
+	free_ir(ir);
+	return 0;
+}
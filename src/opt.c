@@ -0,0 +1,1728 @@
+#include "opt.h"
+#include "arena.h"
+#include "cfg.h"
+#include "dataflow.h"
+#include "ssa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+// A pass rewrites the code in place and returns whether it changed it.
+// Instructions are removed by turning them into IR_NOP, which the pass
+// manager compacts away after the pass
+typedef struct {
+	const char *name;
+
+	// Lowest level the pass runs at
+	int level;
+
+	int (*run)(ir_prog_t *ir, arena_t *arena);
+} opt_pass_t;
+
+// Rounds of -O2 over the passes before it gives up on a fixed point
+#define OPT_MAX_ROUNDS 8
+
+// Jumps a jump is threaded through at a time
+#define OPT_MAX_STEPS 64
+
+// Registers of the file the allocator maps the registers onto. The last
+// two are the scratch registers spilled registers are loaded into, as an
+// instruction reads at most two
+#define OPT_REGISTERS 256
+#define OPT_SCRATCH (OPT_REGISTERS - 2)
+
+// Lattice of the values of sccp: unknown yet, a constant, or varying
+#define OPT_TOP 0
+#define OPT_CONST 1
+#define OPT_VARYING 2
+
+// Whether the global memory at exit is printed, so stores cannot be
+// dropped just because the program does not read them back
+static int keep_globals = 0;
+
+// Index + 1 of every constant in the pool of the program being optimized
+// by value (0 for an empty slot), built when a pass first adds a constant
+static int *consts_table = NULL;
+static int consts_table_cap = 0;
+static int consts_cap = 0;
+
+// State of sccp: the lattice of every value, the executable blocks and
+// edges (two per block, in the order of succs), and the work lists
+typedef struct {
+	ir_prog_t *ir;
+	cfg_t *cfg;
+	ssa_t *ssa;
+
+	char *state;
+	int64_t *value;
+
+	// Instructions (below total_code) and phis (total_code on) reading
+	// every value
+	int *user_start;
+	int *users;
+
+	char *block_live;
+	char *edge_live;
+
+	int *blocks;
+	int total_blocks;
+	int *values;
+	int total_values;
+} opt_sccp_t;
+
+// State of gvn: the value number of every value (the first value found
+// equal to it), the hash table of the leaders of the expressions, and the
+// dominator tree numbered in preorder, where last is the highest number in
+// the subtree of a block
+typedef struct {
+	ir_prog_t *ir;
+	cfg_t *cfg;
+	ssa_t *ssa;
+
+	int *vn;
+	int *defs;
+
+	int64_t (*keys)[3];
+	int *table;
+	int table_cap;
+
+	int *pre;
+	int *last;
+} opt_gvn_t;
+
+// State of the register allocator: the live interval of every register
+// (start -1 if it is never used), the register of the file it got (-1 if
+// it is spilled) or its slot in the frame, and the interval holding every
+// register of the file. The spilled intervals that ended give their slots
+// back in the order they ended, from freed[first_freed] on
+typedef struct {
+	ir_prog_t *ir;
+
+	int *start;
+	int *end;
+
+	int32_t *phys;
+	int32_t *slot;
+	int *holder;
+
+	int32_t *free_regs;
+	int total_free_regs;
+	int32_t *freed;
+	int first_freed;
+	int total_freed;
+	int total_slots;
+	int spilled;
+} opt_regalloc_t;
+
+int opt_run(ir_prog_t *ir, const opt_pass_t *pass, int stats_flag);
+int opt_unreachable(ir_prog_t *ir, arena_t *arena);
+int opt_jumps(ir_prog_t *ir, arena_t *arena);
+int opt_dead_regs(ir_prog_t *ir, arena_t *arena);
+int opt_mem2reg(ir_prog_t *ir, arena_t *arena);
+int opt_sccp(ir_prog_t *ir, arena_t *arena);
+int opt_gvn(ir_prog_t *ir, arena_t *arena);
+int opt_dce(ir_prog_t *ir, arena_t *arena);
+int opt_regalloc(ir_prog_t *ir, arena_t *arena);
+
+void mem2reg_copies(ir_prog_t *ir, arena_t *arena);
+void mem2reg_fold(ir_prog_t *ir, arena_t *arena);
+
+void sccp_users(opt_sccp_t *sccp, arena_t *arena);
+void sccp_block(opt_sccp_t *sccp, int block);
+void sccp_visit(opt_sccp_t *sccp, int index);
+void sccp_phi(opt_sccp_t *sccp, int phi);
+void sccp_edges(opt_sccp_t *sccp, int block);
+void sccp_edge(opt_sccp_t *sccp, int block, int target);
+void sccp_set(opt_sccp_t *sccp, int value, int state, int64_t constant);
+int sccp_operand(opt_sccp_t *sccp, int index, int operand,
+	int64_t *constant);
+int sccp_join(int state, int other);
+int sccp_branch(opt_sccp_t *sccp, int index);
+int64_t sccp_wrap(int64_t value, int size);
+
+int *gvn_preorder(opt_gvn_t *gvn, arena_t *arena);
+int gvn_number(opt_gvn_t *gvn, int index);
+int gvn_key(opt_gvn_t *gvn, int index, int64_t key[3]);
+int gvn_available(opt_gvn_t *gvn, int value, int index);
+
+void regalloc_intervals(opt_regalloc_t *ra, arena_t *arena);
+void regalloc_extend(opt_regalloc_t *ra, int32_t reg, int index);
+int *regalloc_sort(opt_regalloc_t *ra, int *key, int *total,
+	arena_t *arena);
+void regalloc_assign(opt_regalloc_t *ra, int32_t reg);
+void regalloc_spill(opt_regalloc_t *ra, int32_t reg);
+void regalloc_expire(opt_regalloc_t *ra, int32_t reg);
+void regalloc_rewrite(opt_regalloc_t *ra);
+
+int opt_skip(ir_prog_t *ir, int index);
+int opt_follow(ir_prog_t *ir, int index, int *seen, int stamp);
+void opt_compact(ir_prog_t *ir);
+int opt_compact_globals(ir_prog_t *ir);
+int opt_compact_consts(ir_prog_t *ir);
+int32_t *opt_const_arg(ir_t *ir);
+int32_t *opt_use_arg(ir_t *ir, int use);
+int32_t opt_const(ir_prog_t *ir, int64_t value);
+void opt_grow_consts(ir_prog_t *ir);
+void print_pass_stats(const char *name, int before, int after,
+	double seconds);
+
+static const opt_pass_t passes[] = {
+	{"unreachable", 1, opt_unreachable},
+	{"jumps", 1, opt_jumps},
+	{"dead-regs", 1, opt_dead_regs},
+	{"mem2reg", 2, opt_mem2reg},
+	{"sccp", 2, opt_sccp},
+	{"gvn", 2, opt_gvn},
+	{"dce", 2, opt_dce},
+};
+
+static const int total_passes = sizeof(passes) / sizeof(passes[0]);
+
+// Runs once after the others, as the registers it gives are final
+static const opt_pass_t regalloc_pass = {"regalloc", 1, opt_regalloc};
+
+// ========================================
+// opt.h - definition
+// ========================================
+
+void optimize(ir_prog_t *ir, int level, int keep, int stats_flag) {
+	if (level <= 0) return;
+	keep_globals = keep;
+	consts_cap = ir->total_consts;
+
+	double start = time_now();
+	int before = ir->total_code;
+	int max_rounds = level >= 2 ? OPT_MAX_ROUNDS : 1;
+
+	int rounds = 0, changed = 1;
+	while (changed && rounds < max_rounds) {
+		changed = 0;
+		rounds++;
+
+		for (int i = 0; i < total_passes; i++) {
+			if (passes[i].level > level) continue;
+			changed |= opt_run(ir, &passes[i], stats_flag);
+		}
+	}
+	opt_run(ir, &regalloc_pass, stats_flag);
+
+	free(consts_table);
+	consts_table = NULL;
+	consts_table_cap = 0;
+
+	if (stats_flag) {
+		fprintf(stderr, "[stats] opt: -O%d | %d rounds | %.3f ms | %d -> %d instructions\n",
+			level, rounds, (time_now() - start) * 1000, before,
+			ir->total_code);
+	}
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+int opt_run(ir_prog_t *ir, const opt_pass_t *pass, int stats_flag) {
+	double start = time_now();
+	int before = ir->total_code;
+
+	arena_t arena = {};
+	int changed = pass->run(ir, &arena);
+	arena_free(&arena);
+	if (changed) opt_compact(ir);
+
+	if (stats_flag) {
+		print_pass_stats(pass->name, before, ir->total_code,
+			time_now() - start);
+	}
+	return changed;
+}
+
+int opt_unreachable(ir_prog_t *ir, arena_t *arena) {
+	// Blocks the entry never reaches are dropped
+	cfg_t *cfg = build_cfg(ir, arena);
+	int changed = 0;
+
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+		if (block->order >= 0) continue;
+
+		for (int j = block->start; j < block->end; j++) {
+			if (ir->code[j].type == IR_NOP) continue;
+			ir->code[j].type = IR_NOP;
+			changed = 1;
+		}
+	}
+
+	return changed;
+}
+
+int opt_jumps(ir_prog_t *ir, arena_t *arena) {
+	// A jump to a jump goes to where the chain ends, and a jump to where
+	// control goes anyway is dropped; no jump has an effect besides where
+	// control goes
+	int *seen = arena_alloc(arena, (ir->total_code + 1) * sizeof(int));
+	memset(seen, 0, (ir->total_code + 1) * sizeof(int));
+	int changed = 0;
+
+	for (int i = 0; i < ir->total_code; i++) {
+		int32_t *target = ir_target(&ir->code[i]);
+		if (target == NULL) continue;
+
+		int dest = opt_follow(ir, *target, seen, i + 1);
+		if (dest != *target) {
+			*target = dest;
+			changed = 1;
+		}
+
+		if (dest == opt_skip(ir, i + 1)) {
+			ir->code[i].type = IR_NOP;
+			changed = 1;
+		}
+	}
+
+	return changed;
+}
+
+int opt_dead_regs(ir_prog_t *ir, arena_t *arena) {
+	// Walk every block backwards from the registers live at its end; an
+	// instruction whose only effect is a register nothing reads is
+	// dropped. live holds the block a register is live in, plus one
+	cfg_t *cfg = build_cfg(ir, arena);
+	liveness_t *solved = liveness(cfg, arena);
+	dataflow_t *flow = solved->flow;
+
+	int *live = arena_alloc(arena, (ir->total_regs + 1) * sizeof(int));
+	memset(live, 0, (ir->total_regs + 1) * sizeof(int));
+	int changed = 0;
+
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+		int stamp = i + 1;
+
+		uint64_t *out = dataflow_set(flow, flow->out, i);
+		for (int j = 0; j < flow->total_bits; j++) {
+			if (dataflow_has(out, j)) live[solved->regs[j]] = stamp;
+		}
+
+		for (int j = block->end - 1; j >= block->start; j--) {
+			ir_t *ip = &ir->code[j];
+
+			int32_t def = ir_def(ip);
+			if (def >= 0) {
+				if (live[def] != stamp && ir_pure(ip)) {
+					ip->type = IR_NOP;
+					changed = 1;
+					continue;
+				}
+				live[def] = 0;
+			}
+
+			int32_t uses[3];
+			int total_uses = ir_uses(ip, uses);
+			for (int k = 0; k < total_uses; k++) live[uses[k]] = stamp;
+		}
+	}
+
+	return changed;
+}
+
+int opt_mem2reg(ir_prog_t *ir, arena_t *arena) {
+	// Every slot variable some instruction loads gets a register of its own
+	// to live in: stores become copies to it (wrapped like the slot would),
+	// loads copies from it, and its declaration a constant load. Registers
+	// start as zero like global memory. With keep_globals the declarations
+	// stay for print_vm_state, and the registers are stored back where the
+	// program ends
+	int loads = 0;
+	for (int i = 0; i < ir->total_code && !loads; i++) {
+		loads = ir->code[i].type >= IR_LOAD8 && ir->code[i].type <= IR_LOAD64;
+	}
+	if (!loads) return 0;
+
+	cfg_t *cfg = build_cfg(ir, arena);
+	ssa_t *ssa = build_ssa(cfg, arena);
+	int n = ir->total_code;
+
+	int32_t *home = arena_alloc(arena, (ssa->total_vars + 1) *
+		sizeof(int32_t));
+	for (int i = 0; i < ssa->total_vars; i++) home[i] = -1;
+
+	int total_homes = 0, extra = 0;
+	for (int i = 0; i < n; i++) {
+		ir_t *ip = &ir->code[i];
+		int32_t offset;
+		if (ip->type < IR_LOAD8 || ip->type > IR_LOAD64) continue;
+		if (!ir_slot(ip, &offset) || ssa->slot_var[offset] < 0) continue;
+
+		int var = ssa->slot_var[offset];
+		if (home[var] < 0) home[var] = ir->total_regs + total_homes++;
+	}
+	if (total_homes == 0) return 0;
+
+	if (keep_globals) {
+		extra = total_homes;
+		for (int i = 0; i < n; i++) {
+			ir_t *ip = &ir->code[i];
+			if (ip->type == IR_GLOBAL_LOAD_CONST &&
+				ssa->slot_var[ip->arg1] >= 0 && home[ssa->slot_var[ip->arg1]] >= 0) {
+				extra++;
+			}
+		}
+	}
+
+	// map holds where every instruction moved, like in opt_compact
+	ir_t *code = malloc((n + extra + 1) * sizeof(ir_t));
+	int *map = malloc((n + 1) * sizeof(int));
+	if (code == NULL || map == NULL) {
+		perror("Error in opt_mem2reg with malloc");
+		exit(1);
+	}
+
+	int total = 0;
+	for (int i = 0; i < n; i++) {
+		ir_t ip = ir->code[i];
+		map[i] = total;
+
+		int32_t offset;
+		int size = ir_slot(&ip, &offset);
+		int var = size ? ssa->slot_var[offset] : -1;
+		if (var < 0 || home[var] < 0) {
+			code[total++] = ip;
+			continue;
+		}
+
+		switch (ip.type) {
+		case IR_GLOBAL_LOAD_CONST: {
+			if (keep_globals) code[total++] = ip;
+			int64_t value = sccp_wrap(ir->consts[ip.arg3], ip.arg2);
+			code[total++] = (ir_t) {IR_LOAD_CONST, home[var],
+				opt_const(ir, value), 0};
+			break;
+		}
+		case IR_STORE8: case IR_STORE16: case IR_STORE32: case IR_STORE64:
+			code[total++] = (ir_t) {IR_WRAP8 + ip.type - IR_STORE8, home[var],
+				ip.arg2, 0};
+			break;
+		case IR_STORE_INT:
+			code[total++] = (ir_t) {IR_MOV, home[var], ip.arg2, 0};
+			break;
+		default:
+			code[total++] = (ir_t) {IR_MOV, ip.arg1, home[var], 0};
+		}
+	}
+	map[n] = total;
+
+	// Jumps to the end of the code now reach the stores
+	if (keep_globals) {
+		for (int var = 0; var < ssa->total_vars; var++) {
+			if (home[var] < 0) continue;
+			int size = ssa->var_size[var];
+			int type = size == 8 ? IR_STORE_INT :
+				IR_STORE8 + (size == 2 ? 1 : size == 4 ? 2 : 0);
+			code[total++] = (ir_t) {type, ssa->var_offset[var], home[var], 0};
+		}
+	}
+
+	for (int i = 0; i < total; i++) {
+		int32_t *target = ir_target(&code[i]);
+		if (target) *target = map[*target];
+	}
+
+	free(ir->code);
+	free(map);
+	ir->code = code;
+	ir->total_code = total;
+	ir->total_regs += total_homes;
+
+	mem2reg_copies(ir, arena);
+	mem2reg_fold(ir, arena);
+	return 1;
+}
+
+int opt_sccp(ir_prog_t *ir, arena_t *arena) {
+	// Sparse conditional constant propagation (Wegman and Zadeck) over the
+	// ssa form: values start unknown and only go down the lattice, and
+	// only the edges a branch can take are followed, so a value is a
+	// constant if it is one on every path the program can run
+	opt_sccp_t sccp = {};
+	sccp.ir = ir;
+	sccp.cfg = build_cfg(ir, arena);
+	sccp.ssa = build_ssa(sccp.cfg, arena);
+	cfg_t *cfg = sccp.cfg;
+	ssa_t *ssa = sccp.ssa;
+	int n = ir->total_code;
+	if (cfg->total_blocks == 0) return 0;
+
+	sccp.state = arena_alloc(arena, ssa->total_values + 1);
+	sccp.value = arena_alloc(arena, (ssa->total_values + 1) * sizeof(int64_t));
+	memset(sccp.state, OPT_TOP, ssa->total_values + 1);
+	memset(sccp.value, 0, (ssa->total_values + 1) * sizeof(int64_t));
+
+	// Every register and global starts as zero
+	for (int i = 0; i < ssa->total_vars; i++) sccp.state[n + i] = OPT_CONST;
+
+	sccp.block_live = arena_alloc(arena, cfg->total_blocks);
+	sccp.edge_live = arena_alloc(arena, 2 * cfg->total_blocks);
+	memset(sccp.block_live, 0, cfg->total_blocks);
+	memset(sccp.edge_live, 0, 2 * cfg->total_blocks);
+
+	// A block is queued once, when it becomes executable, and a value at
+	// most twice, once for each step down the lattice
+	sccp.blocks = arena_alloc(arena, cfg->total_blocks * sizeof(int));
+	sccp.values = arena_alloc(arena, (2 * ssa->total_values + 1) *
+		sizeof(int));
+	sccp_users(&sccp, arena);
+
+	sccp.block_live[0] = 1;
+	sccp.blocks[sccp.total_blocks++] = 0;
+
+	while (sccp.total_blocks > 0 || sccp.total_values > 0) {
+		if (sccp.total_blocks > 0) {
+			sccp_block(&sccp, sccp.blocks[--sccp.total_blocks]);
+			continue;
+		}
+
+		int value = sccp.values[--sccp.total_values];
+		for (int i = sccp.user_start[value]; i < sccp.user_start[value + 1];
+			i++) {
+			int user = sccp.users[i];
+			if (user >= n) {
+				ssa_phi_t *phi = &ssa->phis[user - n];
+				if (sccp.block_live[phi->block]) sccp_phi(&sccp, user - n);
+				continue;
+			}
+
+			int block = cfg->block_of[user];
+			if (!sccp.block_live[block]) continue;
+			sccp_visit(&sccp, user);
+			if (user == cfg->blocks[block].end - 1) sccp_edges(&sccp, block);
+		}
+	}
+
+	// Constant registers are loaded as constants, branches that go one way
+	// become jumps or fall through, and blocks that never run are dropped
+	int changed = 0;
+	for (int b = 0; b < cfg->total_blocks; b++) {
+		cfg_block_t *block = &cfg->blocks[b];
+
+		for (int i = block->start; i < block->end; i++) {
+			ir_t *ip = &ir->code[i];
+			if (ip->type == IR_NOP) continue;
+
+			if (!sccp.block_live[b]) {
+				ip->type = IR_NOP;
+				changed = 1;
+				continue;
+			}
+
+			int32_t def = ir_def(ip);
+			if (def >= 0 && sccp.state[i] == OPT_CONST &&
+				ip->type != IR_LOAD_CONST) {
+				*ip = (ir_t) {IR_LOAD_CONST, def, opt_const(ir, sccp.value[i]), 0};
+				changed = 1;
+				continue;
+			}
+
+			int32_t *target = ir_target(ip);
+			if (target == NULL || ip->type == IR_JMP) continue;
+
+			int taken = sccp_branch(&sccp, i);
+			if (taken < 0) continue;
+			if (taken) *ip = (ir_t) {IR_JMP, *target, 0, 0};
+			else ip->type = IR_NOP;
+			changed = 1;
+		}
+	}
+
+	return changed;
+}
+
+int opt_gvn(ir_prog_t *ir, arena_t *arena) {
+	// Global value numbering over the ssa form: walking the dominator tree
+	// in preorder, an instruction computing what one that dominates it
+	// already did is dropped, and what read its value reads the register
+	// of the first one instead. Loads are numbered by the value of their
+	// slot, so a load with no store in between is redundant too
+	opt_gvn_t gvn = {};
+	gvn.ir = ir;
+	gvn.cfg = build_cfg(ir, arena);
+	gvn.ssa = build_ssa(gvn.cfg, arena);
+	cfg_t *cfg = gvn.cfg;
+	ssa_t *ssa = gvn.ssa;
+	int n = ir->total_code;
+	if (cfg->total_blocks == 0) return 0;
+
+	gvn.vn = arena_alloc(arena, (ssa->total_values + 1) * sizeof(int));
+	for (int i = 0; i < ssa->total_values; i++) gvn.vn[i] = i;
+
+	// Only a register written once holds the value of its instruction
+	// wherever that instruction dominates
+	gvn.defs = arena_alloc(arena, (ir->total_regs + 1) * sizeof(int));
+	memset(gvn.defs, 0, (ir->total_regs + 1) * sizeof(int));
+	for (int i = 0; i < n; i++) {
+		int32_t def = ir_def(&ir->code[i]);
+		if (def >= 0) gvn.defs[def]++;
+	}
+
+	gvn.keys = arena_alloc(arena, (n + 1) * sizeof(int64_t[3]));
+	gvn.table_cap = 64;
+	while (gvn.table_cap < 2 * (n + 1)) gvn.table_cap *= 2;
+	gvn.table = arena_alloc(arena, gvn.table_cap * sizeof(int));
+	memset(gvn.table, 0, gvn.table_cap * sizeof(int));
+
+	// A value a phi reads cannot move to another register, and moved holds
+	// the register every other dropped value moved to
+	char *in_phi = arena_alloc(arena, ssa->total_values + 1);
+	memset(in_phi, 0, ssa->total_values + 1);
+	for (int i = 0; i < ssa->total_phis; i++) {
+		ssa_phi_t *phi = &ssa->phis[i];
+		int total_args = cfg->blocks[phi->block].total_preds +
+			(phi->block == 0);
+		for (int j = 0; j < total_args; j++) {
+			if (phi->args[j] >= 0) in_phi[phi->args[j]] = 1;
+		}
+	}
+	int32_t *moved = arena_alloc(arena, (n + 1) * sizeof(int32_t));
+	for (int i = 0; i < n; i++) moved[i] = -1;
+
+	int *order = gvn_preorder(&gvn, arena);
+	int changed = 0;
+
+	for (int b = 0; b < cfg->total_order; b++) {
+		cfg_block_t *block = &cfg->blocks[order[b]];
+		for (int i = block->start; i < block->end; i++) {
+			ir_t *ip = &ir->code[i];
+			if (ip->type == IR_NOP) continue;
+
+			int32_t regs[3];
+			int total_regs = ir_uses(ip, regs);
+			int *uses = &ssa->uses[ssa->use_start[i]];
+			for (int k = 0; k < total_regs; k++) {
+				if (uses[k] < 0 || uses[k] >= n || moved[uses[k]] < 0) continue;
+				*opt_use_arg(ip, k) = moved[uses[k]];
+				changed = 1;
+			}
+
+			// A slot holds the exact word an int is stored as
+			if (ip->type == IR_STORE_INT && uses[0] >= 0) {
+				gvn.vn[i] = gvn.vn[uses[0]];
+				continue;
+			}
+			if (ir_def(ip) < 0) continue;
+
+			int leader = gvn_number(&gvn, i);
+			gvn.vn[i] = leader;
+			if (leader == i || leader >= n || in_phi[i] ||
+				gvn.defs[ir_def(&ir->code[leader])] != 1 ||
+				!gvn_available(&gvn, leader, i)) {
+				continue;
+			}
+
+			moved[i] = ir_def(&ir->code[leader]);
+			ip->type = IR_NOP;
+			changed = 1;
+		}
+	}
+
+	return changed;
+}
+
+int opt_dce(ir_prog_t *ir, arena_t *arena) {
+	// Mark the instructions with an effect the program shows (prints,
+	// jumps, and stores nothing reads the slots of back), then whatever
+	// defines a value they read, through the phis; the rest is dead.
+	// Unreachable blocks are left to the unreachable pass
+	cfg_t *cfg = build_cfg(ir, arena);
+	ssa_t *ssa = build_ssa(cfg, arena);
+	int n = ir->total_code;
+
+	char *live = arena_alloc(arena, ssa->total_values + 1);
+	memset(live, 0, ssa->total_values + 1);
+	int *work = arena_alloc(arena, (ssa->total_values + 1) * sizeof(int));
+	int total_work = 0;
+
+	for (int i = 0; i < cfg->total_order; i++) {
+		cfg_block_t *block = &cfg->blocks[cfg->order[i]];
+		for (int j = block->start; j < block->end; j++) {
+			ir_t *ip = &ir->code[j];
+			if (ip->type == IR_NOP || ir_pure(ip)) continue;
+			if (ssa_def(ssa, ip) >= 0 && !keep_globals) continue;
+
+			live[j] = 1;
+			work[total_work++] = j;
+		}
+	}
+
+	while (total_work > 0) {
+		int value = work[--total_work];
+		int *args, total_args;
+
+		if (value < n) {
+			args = &ssa->uses[ssa->use_start[value]];
+			total_args = ssa->use_start[value + 1] - ssa->use_start[value];
+		}
+		else if (value >= n + ssa->total_vars) {
+			ssa_phi_t *phi = &ssa->phis[value - n - ssa->total_vars];
+			args = phi->args;
+			total_args = cfg->blocks[phi->block].total_preds +
+				(phi->block == 0);
+		}
+		else continue;
+
+		for (int i = 0; i < total_args; i++) {
+			if (args[i] < 0 || live[args[i]]) continue;
+			live[args[i]] = 1;
+			work[total_work++] = args[i];
+		}
+	}
+
+	int changed = 0;
+	for (int i = 0; i < cfg->total_order; i++) {
+		cfg_block_t *block = &cfg->blocks[cfg->order[i]];
+		for (int j = block->start; j < block->end; j++) {
+			if (live[j] || ir->code[j].type == IR_NOP) continue;
+			ir->code[j].type = IR_NOP;
+			changed = 1;
+		}
+	}
+
+	// Variables nothing accesses any more give their memory back, and so
+	// do constants nothing loads
+	if (!keep_globals) changed |= opt_compact_globals(ir);
+	changed |= opt_compact_consts(ir);
+	return changed;
+}
+
+int opt_regalloc(ir_prog_t *ir, arena_t *arena) {
+	// Linear scan (Poletto and Sarkar) over the live intervals of the
+	// registers: in the order they start, every interval takes a register
+	// of the file no interval it overlaps holds. A copy (or any instruction)
+	// writing a register where the interval of one it reads ends takes over
+	// its register, so the copy goes away. When the file is full, the
+	// interval ending last is spilled to a slot of a frame after the global
+	// memory, and lives in the scratch registers only around its accesses
+	opt_regalloc_t ra = {};
+	ra.ir = ir;
+	int total_regs = ir->total_regs;
+
+	regalloc_intervals(&ra, arena);
+
+	ra.phys = arena_alloc(arena, (total_regs + 1) * sizeof(int32_t));
+	ra.slot = arena_alloc(arena, (total_regs + 1) * sizeof(int32_t));
+	ra.holder = arena_alloc(arena, OPT_SCRATCH * sizeof(int));
+	ra.free_regs = arena_alloc(arena, OPT_SCRATCH * sizeof(int32_t));
+	ra.freed = arena_alloc(arena, (total_regs + 1) * sizeof(int32_t));
+	for (int i = 0; i < total_regs; i++) ra.phys[i] = ra.slot[i] = -1;
+
+	// The lowest registers are handed out first
+	for (int i = 0; i < OPT_SCRATCH; i++) {
+		ra.holder[i] = -1;
+		ra.free_regs[ra.total_free_regs++] = OPT_SCRATCH - 1 - i;
+	}
+
+	int total = 0;
+	int *by_start = regalloc_sort(&ra, ra.start, &total, arena);
+	int *by_end = regalloc_sort(&ra, ra.end, &total, arena);
+
+	int expired = 0;
+	for (int i = 0; i < total; i++) {
+		int32_t reg = by_start[i];
+		int start = ra.start[reg];
+		while (expired < total && ra.end[by_end[expired]] < start) {
+			regalloc_expire(&ra, by_end[expired++]);
+		}
+		regalloc_assign(&ra, reg);
+	}
+
+	regalloc_rewrite(&ra);
+	return 1;
+}
+
+void mem2reg_copies(ir_prog_t *ir, arena_t *arena) {
+	// Inside a block a register copied from another is read from the
+	// other while it keeps the value copied. Every write of a register
+	// bumps its version, so a copy knows when its source changed
+	cfg_t *cfg = build_cfg(ir, arena);
+	size_t size = (ir->total_regs + 1) * sizeof(int);
+	int *version = arena_alloc(arena, size);
+	int *copy_block = arena_alloc(arena, size);
+	int *source = arena_alloc(arena, size);
+	int *source_version = arena_alloc(arena, size);
+	memset(version, 0, size);
+	memset(copy_block, 0, size);
+	int clock = 0;
+
+	for (int b = 0; b < cfg->total_blocks; b++) {
+		cfg_block_t *block = &cfg->blocks[b];
+		int stamp = b + 1;
+
+		for (int i = block->start; i < block->end; i++) {
+			ir_t *ip = &ir->code[i];
+
+			int32_t uses[3];
+			int total_uses = ir_uses(ip, uses);
+			for (int k = 0; k < total_uses; k++) {
+				int32_t reg = uses[k];
+				if (copy_block[reg] == stamp &&
+					version[source[reg]] == source_version[reg]) {
+					*opt_use_arg(ip, k) = source[reg];
+				}
+			}
+
+			int32_t def = ir_def(ip);
+			if (def < 0) continue;
+			if (ip->type == IR_MOV && ip->arg2 == def) {
+				ip->type = IR_NOP;
+				continue;
+			}
+
+			version[def] = ++clock;
+			copy_block[def] = 0;
+			if (ip->type == IR_MOV) {
+				copy_block[def] = stamp;
+				source[def] = ip->arg2;
+				source_version[def] = version[ip->arg2];
+			}
+		}
+	}
+}
+
+void mem2reg_fold(ir_prog_t *ir, arena_t *arena) {
+	// A register written once and only read by a copy later in its block
+	// is not needed: its instruction writes the copy instead, if nothing
+	// reads or writes the copy in between
+	cfg_t *cfg = build_cfg(ir, arena);
+	size_t size = (ir->total_regs + 1) * sizeof(int);
+	int *defs = arena_alloc(arena, size);
+	int *reads = arena_alloc(arena, size);
+	int *def_block = arena_alloc(arena, size);
+	int *def_at = arena_alloc(arena, size);
+	int *touch_block = arena_alloc(arena, size);
+	int *touch_at = arena_alloc(arena, size);
+	memset(defs, 0, size);
+	memset(reads, 0, size);
+	memset(def_block, 0, size);
+	memset(touch_block, 0, size);
+
+	for (int i = 0; i < ir->total_code; i++) {
+		int32_t uses[3];
+		int total_uses = ir_uses(&ir->code[i], uses);
+		for (int k = 0; k < total_uses; k++) reads[uses[k]]++;
+		int32_t def = ir_def(&ir->code[i]);
+		if (def >= 0) defs[def]++;
+	}
+
+	for (int b = 0; b < cfg->total_blocks; b++) {
+		cfg_block_t *block = &cfg->blocks[b];
+		int stamp = b + 1;
+
+		for (int i = block->start; i < block->end; i++) {
+			ir_t *ip = &ir->code[i];
+			if (ip->type == IR_NOP) continue;
+
+			if (ip->type == IR_MOV) {
+				int32_t copy = ip->arg1, value = ip->arg2;
+				if (def_block[value] == stamp && defs[value] == 1 &&
+					reads[value] == 1 &&
+					(touch_block[copy] != stamp || touch_at[copy] <= def_at[value])) {
+					ir->code[def_at[value]].arg1 = copy;
+					ip->type = IR_NOP;
+					touch_block[copy] = stamp;
+					touch_at[copy] = i;
+					continue;
+				}
+			}
+
+			int32_t uses[3];
+			int total_uses = ir_uses(ip, uses);
+			for (int k = 0; k < total_uses; k++) {
+				touch_block[uses[k]] = stamp;
+				touch_at[uses[k]] = i;
+			}
+
+			int32_t def = ir_def(ip);
+			if (def < 0) continue;
+			touch_block[def] = def_block[def] = stamp;
+			touch_at[def] = def_at[def] = i;
+		}
+	}
+}
+
+void sccp_users(opt_sccp_t *sccp, arena_t *arena) {
+	// Counting sort of the reachable instructions and phis by the values
+	// they read
+	cfg_t *cfg = sccp->cfg;
+	ssa_t *ssa = sccp->ssa;
+	int n = sccp->ir->total_code;
+
+	int *start = arena_alloc(arena, (ssa->total_values + 2) * sizeof(int));
+	memset(start, 0, (ssa->total_values + 2) * sizeof(int));
+
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 1) {
+			for (int i = 0; i < ssa->total_values; i++) start[i + 1] += start[i];
+			sccp->users = arena_alloc(arena, (start[ssa->total_values] + 1) *
+				sizeof(int));
+		}
+
+		for (int i = 0; i < cfg->total_order; i++) {
+			int b = cfg->order[i];
+			cfg_block_t *block = &cfg->blocks[b];
+
+			for (int j = ssa->block_phis[b]; j < ssa->block_phis[b + 1]; j++) {
+				int total_args = block->total_preds + (b == 0);
+				for (int k = 0; k < total_args; k++) {
+					int arg = ssa->phis[j].args[k];
+					if (arg < 0) continue;
+					if (pass == 0) start[arg + 1]++;
+					else sccp->users[start[arg]++] = n + j;
+				}
+			}
+
+			for (int j = block->start; j < block->end; j++) {
+				for (int k = ssa->use_start[j]; k < ssa->use_start[j + 1]; k++) {
+					int arg = ssa->uses[k];
+					if (arg < 0) continue;
+					if (pass == 0) start[arg + 1]++;
+					else sccp->users[start[arg]++] = j;
+				}
+			}
+		}
+	}
+
+	// Filling moved every start to the next one
+	memmove(start + 1, start, ssa->total_values * sizeof(int));
+	start[0] = 0;
+	sccp->user_start = start;
+}
+
+void sccp_block(opt_sccp_t *sccp, int block) {
+	ssa_t *ssa = sccp->ssa;
+	cfg_block_t *cur = &sccp->cfg->blocks[block];
+
+	for (int i = ssa->block_phis[block]; i < ssa->block_phis[block + 1]; i++) {
+		sccp_phi(sccp, i);
+	}
+	for (int i = cur->start; i < cur->end; i++) sccp_visit(sccp, i);
+	sccp_edges(sccp, block);
+}
+
+void sccp_visit(opt_sccp_t *sccp, int index) {
+	ir_t *ip = &sccp->ir->code[index];
+	int64_t left, right;
+	int state = OPT_VARYING;
+	int64_t constant = 0;
+
+	switch (ip->type) {
+	case IR_LOAD_CONST:
+		state = OPT_CONST;
+		constant = sccp->ir->consts[ip->arg2];
+		break;
+	case IR_GLOBAL_LOAD_CONST:
+		state = OPT_CONST;
+		constant = sccp_wrap(sccp->ir->consts[ip->arg3], ip->arg2);
+		break;
+	case IR_STORE8: case IR_STORE16: case IR_STORE32: case IR_STORE64:
+	case IR_STORE_INT: {
+		// The vm wraps to the size of the slot, and loads sign extend back
+		int32_t offset;
+		state = sccp_operand(sccp, index, 0, &left);
+		constant = sccp_wrap(left, ir_slot(ip, &offset));
+		break;
+	}
+	case IR_LOAD8: case IR_LOAD16: case IR_LOAD32: case IR_LOAD64:
+		// A slot that is not a variable reads no value
+		if (sccp->ssa->use_start[index + 1] > sccp->ssa->use_start[index]) {
+			state = sccp_operand(sccp, index, 0, &constant);
+		}
+		break;
+	case IR_ADD: case IR_SUB: {
+		state = sccp_operand(sccp, index, 0, &left);
+		int other = sccp_operand(sccp, index, 1, &right);
+		state = sccp_join(state, other);
+		if (state != OPT_CONST) break;
+
+		// A sum that does not fit the constant pool is left to the vm
+		int overflow = ip->type == IR_ADD
+			? __builtin_add_overflow(left, right, &constant)
+			: __builtin_sub_overflow(left, right, &constant);
+		if (overflow) state = OPT_VARYING;
+		break;
+	}
+	case IR_LT: case IR_LE: case IR_GT:
+	case IR_GE: case IR_EQ: case IR_NE: {
+		state = sccp_operand(sccp, index, 0, &left);
+		int other = sccp_operand(sccp, index, 1, &right);
+		state = sccp_join(state, other);
+
+		int compare = ip->type - IR_LT;
+		constant = compare == 0 ? left < right : compare == 1 ? left <= right :
+			compare == 2 ? left > right : compare == 3 ? left >= right :
+			compare == 4 ? left == right : left != right;
+		break;
+	}
+	case IR_NOT:
+		state = sccp_operand(sccp, index, 0, &left);
+		constant = !left;
+		break;
+	case IR_MOV:
+		state = sccp_operand(sccp, index, 0, &constant);
+		break;
+	case IR_WRAP8: case IR_WRAP16: case IR_WRAP32: case IR_WRAP64:
+		state = sccp_operand(sccp, index, 0, &left);
+		constant = sccp_wrap(left, 1 << (ip->type - IR_WRAP8));
+		break;
+	default:
+		// Prints and jumps define nothing
+		return;
+	}
+
+	if (ssa_def(sccp->ssa, ip) < 0) return;
+	sccp_set(sccp, index, state, constant);
+}
+
+void sccp_phi(opt_sccp_t *sccp, int phi) {
+	// Meet of the values coming in through executable edges
+	cfg_t *cfg = sccp->cfg;
+	ssa_t *ssa = sccp->ssa;
+	ssa_phi_t *cur = &ssa->phis[phi];
+	cfg_block_t *block = &cfg->blocks[cur->block];
+	int total_args = block->total_preds + (cur->block == 0);
+
+	int state = OPT_TOP;
+	int64_t constant = 0;
+	for (int i = 0; i < total_args && state != OPT_VARYING; i++) {
+		if (i < block->total_preds) {
+			cfg_block_t *pred = &cfg->blocks[block->preds[i]];
+			int edge = pred->succs[0] == cur->block ? 0 : 1;
+			if (!sccp->edge_live[2 * block->preds[i] + edge]) continue;
+		}
+
+		int arg = cur->args[i];
+		if (arg < 0 || sccp->state[arg] == OPT_TOP) continue;
+		if (sccp->state[arg] == OPT_VARYING ||
+			(state == OPT_CONST && sccp->value[arg] != constant)) {
+			state = OPT_VARYING;
+			continue;
+		}
+		state = OPT_CONST;
+		constant = sccp->value[arg];
+	}
+
+	sccp_set(sccp, sccp->ir->total_code + ssa->total_vars + phi, state,
+		constant);
+}
+
+void sccp_edges(opt_sccp_t *sccp, int block) {
+	// The edges the last instruction of an executable block can take
+	ir_prog_t *ir = sccp->ir;
+	cfg_block_t *cur = &sccp->cfg->blocks[block];
+	int last = cur->end - 1;
+	ir_t *ip = &ir->code[last];
+	int32_t *target = ir_target(ip);
+
+	if (target == NULL) {
+		sccp_edge(sccp, block, cur->end);
+		return;
+	}
+	if (ip->type == IR_JMP) {
+		sccp_edge(sccp, block, *target);
+		return;
+	}
+
+	int taken = sccp_branch(sccp, last);
+	if (taken == -2) return;
+	if (taken != 0) sccp_edge(sccp, block, *target);
+	if (taken != 1) sccp_edge(sccp, block, cur->end);
+}
+
+void sccp_edge(opt_sccp_t *sccp, int block, int target) {
+	// Leaving the code is not an edge
+	cfg_t *cfg = sccp->cfg;
+	if (target >= sccp->ir->total_code) return;
+
+	int succ = cfg->block_of[target];
+	cfg_block_t *cur = &cfg->blocks[block];
+	int edge = cur->succs[0] == succ ? 0 : 1;
+	if (sccp->edge_live[2 * block + edge]) return;
+	sccp->edge_live[2 * block + edge] = 1;
+
+	if (!sccp->block_live[succ]) {
+		sccp->block_live[succ] = 1;
+		sccp->blocks[sccp->total_blocks++] = succ;
+		return;
+	}
+
+	// A new way into a block can change its phis
+	ssa_t *ssa = sccp->ssa;
+	for (int i = ssa->block_phis[succ]; i < ssa->block_phis[succ + 1]; i++) {
+		sccp_phi(sccp, i);
+	}
+}
+
+void sccp_set(opt_sccp_t *sccp, int value, int state, int64_t constant) {
+	// Values only go down the lattice, and are queued when they do
+	if (state <= sccp->state[value]) return;
+	sccp->state[value] = state;
+	sccp->value[value] = constant;
+	sccp->values[sccp->total_values++] = value;
+}
+
+int sccp_operand(opt_sccp_t *sccp, int index, int operand,
+	int64_t *constant) {
+	// An operand of unreachable code is varying; its constant is set
+	// anyway, so a caller folding it never reads garbage
+	int value = sccp->ssa->uses[sccp->ssa->use_start[index] + operand];
+	*constant = 0;
+	if (value < 0) return OPT_VARYING;
+	*constant = sccp->value[value];
+	return sccp->state[value];
+}
+
+int sccp_join(int state, int other) {
+	// State of a result of two operands: varying if either is, otherwise
+	// unknown until both are known
+	if (state == OPT_VARYING || other == OPT_VARYING) return OPT_VARYING;
+	if (state == OPT_TOP || other == OPT_TOP) return OPT_TOP;
+	return OPT_CONST;
+}
+
+int sccp_branch(opt_sccp_t *sccp, int index) {
+	// 1 if a conditional jump is always taken, 0 if never, -1 if it
+	// depends on the run, and -2 if its operands are not known yet
+	ir_t *ip = &sccp->ir->code[index];
+	int64_t left = 0, right = 0;
+	int state = sccp_operand(sccp, index, 0, &left);
+
+	int compare;
+	switch (ip->type) {
+	case IR_JMP_TRUE:
+		compare = 5;
+		break;
+	case IR_JMP_FALSE:
+		compare = 4;
+		break;
+	case IR_JLTI: case IR_JLEI: case IR_JGTI:
+	case IR_JGEI: case IR_JEQI: case IR_JNEI:
+		compare = ip->type - IR_JLTI;
+		right = sccp->ir->consts[ip->arg2];
+		break;
+	default: {
+		compare = ip->type - IR_JLT;
+		int other = sccp_operand(sccp, index, 1, &right);
+		state = sccp_join(state, other);
+	}
+	}
+
+	if (state == OPT_TOP) return -2;
+	if (state == OPT_VARYING) return -1;
+	switch (compare) {
+	case 0: return left < right;
+	case 1: return left <= right;
+	case 2: return left > right;
+	case 3: return left >= right;
+	case 4: return left == right;
+	}
+	return left != right;
+}
+
+int64_t sccp_wrap(int64_t value, int size) {
+	switch (size) {
+	case 1: return (int8_t) value;
+	case 2: return (int16_t) value;
+	case 4: return (int32_t) value;
+	}
+	return value;
+}
+
+int *gvn_preorder(opt_gvn_t *gvn, arena_t *arena) {
+	// Reachable blocks in preorder of the dominator tree, numbering every
+	// block and the end of its subtree on the way
+	cfg_t *cfg = gvn->cfg;
+	int total = cfg->total_blocks;
+
+	int *child_start = arena_alloc(arena, (total + 2) * sizeof(int));
+	memset(child_start, 0, (total + 2) * sizeof(int));
+	for (int i = 1; i < cfg->total_order; i++) {
+		child_start[cfg->blocks[cfg->order[i]].idom + 1]++;
+	}
+	for (int i = 0; i < total; i++) child_start[i + 1] += child_start[i];
+
+	int *next = arena_alloc(arena, (total + 1) * sizeof(int));
+	memcpy(next, child_start, (total + 1) * sizeof(int));
+	int *children = arena_alloc(arena, (cfg->total_order + 1) * sizeof(int));
+	for (int i = 1; i < cfg->total_order; i++) {
+		int b = cfg->order[i];
+		children[next[cfg->blocks[b].idom]++] = b;
+	}
+
+	gvn->pre = arena_alloc(arena, (total + 1) * sizeof(int));
+	gvn->last = arena_alloc(arena, (total + 1) * sizeof(int));
+	int *order = arena_alloc(arena, (cfg->total_order + 1) * sizeof(int));
+	int *stack = next;
+	int total_stack = 0, total_order = 0;
+
+	stack[total_stack++] = 0;
+	while (total_stack > 0) {
+		int b = stack[--total_stack];
+		gvn->pre[b] = gvn->last[b] = total_order;
+		order[total_order++] = b;
+		for (int i = child_start[b]; i < child_start[b + 1]; i++) {
+			stack[total_stack++] = children[i];
+		}
+	}
+
+	// Descendants come after a block, so going backwards a subtree is done
+	// before it ends the one of its parent
+	for (int i = total_order - 1; i > 0; i--) {
+		int b = order[i];
+		int idom = cfg->blocks[b].idom;
+		if (gvn->last[b] > gvn->last[idom]) gvn->last[idom] = gvn->last[b];
+	}
+
+	return order;
+}
+
+int gvn_number(opt_gvn_t *gvn, int index) {
+	// The leader of the expression of an instruction: the first instruction
+	// computing it whose register is written only there. In preorder a
+	// leader that does not dominate an instruction never dominates a later
+	// one either, so the instruction takes its place
+	ir_prog_t *ir = gvn->ir;
+	ssa_t *ssa = gvn->ssa;
+	ir_t *ip = &ir->code[index];
+
+	// A copy is the value it copies
+	if (ip->type == IR_MOV) {
+		int value = ssa->uses[ssa->use_start[index]];
+		return value < 0 ? index : gvn->vn[value];
+	}
+
+	int64_t *key = gvn->keys[index];
+	if (!gvn_key(gvn, index, key)) return index;
+
+	// A load of an int just stored is the register stored
+	if (ip->type == IR_LOAD64) {
+		int stored = ssa->uses[ssa->use_start[index]];
+		if (stored < ir->total_code && ir->code[stored].type == IR_STORE_INT) {
+			return key[1];
+		}
+	}
+
+	uint64_t mask = gvn->table_cap - 1;
+	uint64_t hash = (uint64_t) key[0] * 0x9e3779b97f4a7c15 ^
+		(uint64_t) key[1] * 0xc2b2ae3d27d4eb4f ^
+		(uint64_t) key[2] * 0x165667b19e3779f9;
+	uint64_t slot = (hash >> 32) & mask;
+	int eligible = gvn->defs[ir_def(ip)] == 1;
+
+	for (; gvn->table[slot]; slot = (slot + 1) & mask) {
+		int leader = gvn->table[slot] - 1;
+		int64_t *other = gvn->keys[leader];
+		if (other[0] != key[0] || other[1] != key[1] || other[2] != key[2]) {
+			continue;
+		}
+
+		if (gvn_available(gvn, leader, index)) return leader;
+		if (eligible) gvn->table[slot] = index + 1;
+		return index;
+	}
+
+	if (eligible) gvn->table[slot] = index + 1;
+	return index;
+}
+
+int gvn_key(opt_gvn_t *gvn, int index, int64_t key[3]) {
+	// The operation and the value numbers of the operands, in one order
+	// for operations that can swap them; 0 if the instruction computes
+	// nothing two instructions can share
+	ir_prog_t *ir = gvn->ir;
+	ssa_t *ssa = gvn->ssa;
+	ir_t *ip = &ir->code[index];
+	int *uses = &ssa->uses[ssa->use_start[index]];
+	int total_uses = ssa->use_start[index + 1] - ssa->use_start[index];
+
+	key[0] = ip->type;
+	key[1] = key[2] = 0;
+	for (int i = 0; i < total_uses; i++) {
+		if (uses[i] < 0) return 0;
+		key[1 + i] = gvn->vn[uses[i]];
+	}
+
+	switch (ip->type) {
+	case IR_LOAD_CONST:
+		key[1] = ir->consts[ip->arg2];
+		return 1;
+	case IR_LOAD8: case IR_LOAD16: case IR_LOAD32: case IR_LOAD64:
+		// A slot that is not a variable has no value to number by
+		return total_uses == 1;
+	case IR_GT: case IR_GE: {
+		int64_t tmp = key[1];
+		key[0] = ip->type - 2;
+		key[1] = key[2];
+		key[2] = tmp;
+		return 1;
+	}
+	case IR_ADD: case IR_EQ: case IR_NE:
+		if (key[1] > key[2]) {
+			int64_t tmp = key[1];
+			key[1] = key[2];
+			key[2] = tmp;
+		}
+		return 1;
+	case IR_SUB: case IR_LT: case IR_LE: case IR_NOT:
+	case IR_WRAP8: case IR_WRAP16: case IR_WRAP32: case IR_WRAP64:
+		return 1;
+	}
+	return 0;
+}
+
+int gvn_available(opt_gvn_t *gvn, int value, int index) {
+	// Whether the instruction defining a value dominates an instruction
+	int *block_of = gvn->cfg->block_of;
+	int a = block_of[value], b = block_of[index];
+	if (a == b) return value < index;
+	return gvn->pre[a] < gvn->pre[b] && gvn->pre[b] <= gvn->last[a];
+}
+
+void regalloc_intervals(opt_regalloc_t *ra, arena_t *arena) {
+	// A register live into or out of a block is live from its first or to
+	// its last instruction; otherwise it only lives from where it is
+	// written to where it is last read. The blocks are in the order of the
+	// code, so an interval covers every block it is live in
+	ir_prog_t *ir = ra->ir;
+	size_t size = (ir->total_regs + 1) * sizeof(int);
+	ra->start = arena_alloc(arena, size);
+	ra->end = arena_alloc(arena, size);
+	memset(ra->start, -1, size);
+	memset(ra->end, -1, size);
+
+	cfg_t *cfg = build_cfg(ir, arena);
+	liveness_t *live = liveness(cfg, arena);
+	dataflow_t *flow = live->flow;
+
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+		if (block->start == block->end) continue;
+
+		uint64_t *in = dataflow_set(flow, flow->in, i);
+		uint64_t *out = dataflow_set(flow, flow->out, i);
+		for (int j = 0; j < flow->words; j++) {
+			uint64_t word = in[j] | out[j];
+			while (word) {
+				int bit = j * 64 + __builtin_ctzll(word);
+				word &= word - 1;
+
+				int32_t reg = live->regs[bit];
+				if (dataflow_has(in, bit)) regalloc_extend(ra, reg, block->start);
+				if (dataflow_has(out, bit)) {
+					regalloc_extend(ra, reg, block->end - 1);
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < ir->total_code; i++) {
+		ir_t *ip = &ir->code[i];
+		int32_t def = ir_def(ip);
+		if (def >= 0) regalloc_extend(ra, def, i);
+
+		int32_t uses[3];
+		int total_uses = ir_uses(ip, uses);
+		for (int j = 0; j < total_uses; j++) regalloc_extend(ra, uses[j], i);
+	}
+}
+
+void regalloc_extend(opt_regalloc_t *ra, int32_t reg, int index) {
+	if (ra->start[reg] < 0 || index < ra->start[reg]) ra->start[reg] = index;
+	if (index > ra->end[reg]) ra->end[reg] = index;
+}
+
+int *regalloc_sort(opt_regalloc_t *ra, int *key, int *total,
+	arena_t *arena) {
+	// The used registers by key (a position in the code), counting sort
+	ir_prog_t *ir = ra->ir;
+	int *count = arena_alloc(arena, (ir->total_code + 1) * sizeof(int));
+	memset(count, 0, (ir->total_code + 1) * sizeof(int));
+
+	*total = 0;
+	for (int i = 0; i < ir->total_regs; i++) {
+		if (key[i] < 0) continue;
+		count[key[i] + 1]++;
+		(*total)++;
+	}
+	for (int i = 0; i < ir->total_code; i++) count[i + 1] += count[i];
+
+	int *sorted = arena_alloc(arena, (*total + 1) * sizeof(int));
+	for (int i = 0; i < ir->total_regs; i++) {
+		if (key[i] >= 0) sorted[count[key[i]]++] = i;
+	}
+	return sorted;
+}
+
+void regalloc_assign(opt_regalloc_t *ra, int32_t reg) {
+	ir_prog_t *ir = ra->ir;
+	int start = ra->start[reg];
+	ir_t *ip = &ir->code[start];
+
+	// An instruction reads its registers before writing, so the one it
+	// writes can take the register of one whose interval ends there
+	if (ir_def(ip) == reg) {
+		int32_t uses[3];
+		int total_uses = ir_uses(ip, uses);
+		for (int i = 0; i < total_uses; i++) {
+			int32_t use = uses[i];
+			int32_t phys = ra->phys[use];
+			if (use == reg || ra->end[use] != start || phys < 0 ||
+				ra->holder[phys] != use) {
+				continue;
+			}
+			ra->holder[phys] = reg;
+			ra->phys[reg] = phys;
+			return;
+		}
+	}
+
+	if (ra->total_free_regs > 0) {
+		int32_t phys = ra->free_regs[--ra->total_free_regs];
+		ra->holder[phys] = reg;
+		ra->phys[reg] = phys;
+		return;
+	}
+
+	// The file is full: the interval ending last goes to the frame
+	int32_t last = reg;
+	for (int i = 0; i < OPT_SCRATCH; i++) {
+		if (ra->end[ra->holder[i]] > ra->end[last]) last = ra->holder[i];
+	}
+	if (last != reg) {
+		int32_t phys = ra->phys[last];
+		ra->holder[phys] = reg;
+		ra->phys[reg] = phys;
+		ra->phys[last] = -1;
+	}
+	regalloc_spill(ra, last);
+}
+
+void regalloc_spill(opt_regalloc_t *ra, int32_t reg) {
+	// An interval spilled after it started needs a slot given back before
+	// it started, and the slot given back first ended first. One from the
+	// start of the code gets a new slot, still zero for a read before any
+	// write
+	ra->spilled = 1;
+	if (ra->first_freed < ra->total_freed &&
+		ra->end[ra->freed[ra->first_freed]] < ra->start[reg]) {
+		ra->slot[reg] = ra->slot[ra->freed[ra->first_freed++]];
+	} else {
+		ra->slot[reg] = ra->total_slots++;
+	}
+}
+
+void regalloc_expire(opt_regalloc_t *ra, int32_t reg) {
+	// An interval that handed its register over no longer holds it
+	int32_t phys = ra->phys[reg];
+	if (phys >= 0 && ra->holder[phys] == reg) {
+		ra->holder[phys] = -1;
+		ra->free_regs[ra->total_free_regs++] = phys;
+	} else if (phys < 0 && ra->slot[reg] >= 0) {
+		ra->freed[ra->total_freed++] = reg;
+	}
+}
+
+void regalloc_rewrite(opt_regalloc_t *ra) {
+	// Registers are renamed to the ones they got. A spilled register is
+	// loaded into a scratch register before an instruction reads it, and
+	// stored from one after an instruction writes it, as an int so it keeps
+	// its exact word (and the collector sees a bigint it holds)
+	ir_prog_t *ir = ra->ir;
+	int n = ir->total_code;
+	int64_t frame = (ir->global_size + 7) / 8 * 8;
+
+	int extra = 0;
+	for (int i = 0; i < n && ra->spilled; i++) {
+		ir_t *ip = &ir->code[i];
+		int32_t uses[3];
+		int total_uses = ir_uses(ip, uses);
+		for (int j = 0; j < total_uses; j++) extra += ra->phys[uses[j]] < 0;
+		int32_t def = ir_def(ip);
+		extra += def >= 0 && ra->phys[def] < 0;
+	}
+
+	// map holds where every instruction moved, like in opt_compact
+	ir_t *code = malloc((n + extra + 1) * sizeof(ir_t));
+	int *map = malloc((n + 1) * sizeof(int));
+	if (code == NULL || map == NULL) {
+		perror("Error in regalloc_rewrite with malloc");
+		exit(1);
+	}
+
+	int total = 0;
+	for (int i = 0; i < n; i++) {
+		ir_t ip = ir->code[i];
+		map[i] = total;
+
+		int32_t uses[3];
+		int total_uses = ir_uses(&ip, uses);
+		for (int j = 0; j < total_uses; j++) {
+			int32_t reg = uses[j];
+			int32_t *arg = opt_use_arg(&ip, j);
+			if (ra->phys[reg] >= 0) {
+				*arg = ra->phys[reg];
+				continue;
+			}
+			*arg = OPT_SCRATCH + j;
+			code[total++] = (ir_t) {IR_LOAD64, *arg,
+				frame + (int64_t) ra->slot[reg] * 8, 0};
+		}
+
+		int32_t def = ir_def(&ip);
+		int spilled = def >= 0 && ra->phys[def] < 0;
+		if (def >= 0) ip.arg1 = spilled ? OPT_SCRATCH : ra->phys[def];
+		if (ip.type == IR_MOV && ip.arg1 == ip.arg2) ip.type = IR_NOP;
+		code[total++] = ip;
+
+		if (spilled) {
+			code[total++] = (ir_t) {IR_STORE_INT,
+				frame + (int64_t) ra->slot[def] * 8, OPT_SCRATCH, 0};
+		}
+	}
+	map[n] = total;
+
+	for (int i = 0; i < total; i++) {
+		int32_t *target = ir_target(&code[i]);
+		if (target) *target = map[*target];
+	}
+
+	free(ir->code);
+	free(map);
+	ir->code = code;
+	ir->total_code = total;
+	// Without spills the file only needs the registers handed out
+	int32_t top = 0;
+	for (int i = 0; i < ir->total_regs; i++) {
+		if (ra->phys[i] + 1 > top) top = ra->phys[i] + 1;
+	}
+	ir->total_regs = ra->spilled ? OPT_REGISTERS : top > 0 ? top : 1;
+	if (ra->total_slots > 0) {
+		ir->global_size = frame + (int64_t) ra->total_slots * 8;
+	}
+}
+
+int opt_skip(ir_prog_t *ir, int index) {
+	// Where control goes from an instruction on
+	while (index < ir->total_code && ir->code[index].type == IR_NOP) {
+		index++;
+	}
+	return index;
+}
+
+int opt_follow(ir_prog_t *ir, int index, int *seen, int stamp) {
+	// Follow unconditional jumps from an instruction, stopping at a jump
+	// seen before (a loop of jumps never leaves) and after OPT_MAX_STEPS,
+	// which the next round continues from
+	for (int steps = 0; steps < OPT_MAX_STEPS; steps++) {
+		int next = opt_skip(ir, index);
+		if (next >= ir->total_code || ir->code[next].type != IR_JMP ||
+			seen[next] == stamp) {
+			return next;
+		}
+		seen[next] = stamp;
+		index = ir->code[next].arg1;
+	}
+	return index;
+}
+
+void opt_compact(ir_prog_t *ir) {
+	// map holds the number of instructions kept before an instruction,
+	// which is where a jump to it (or to the instructions it falls through
+	// to) goes once they are removed
+	int *map = malloc((ir->total_code + 1) * sizeof(int));
+	if (map == NULL) {
+		perror("Error in opt_compact with malloc");
+		exit(1);
+	}
+
+	int kept = 0;
+	for (int i = 0; i < ir->total_code; i++) {
+		map[i] = kept;
+		if (ir->code[i].type != IR_NOP) kept++;
+	}
+	map[ir->total_code] = kept;
+
+	kept = 0;
+	for (int i = 0; i < ir->total_code; i++) {
+		if (ir->code[i].type == IR_NOP) continue;
+
+		ir_t *ip = &ir->code[kept++];
+		*ip = ir->code[i];
+		int32_t *target = ir_target(ip);
+		if (target) *target = map[*target];
+	}
+	ir->total_code = kept;
+
+	free(map);
+}
+
+int opt_compact_globals(ir_prog_t *ir) {
+	// Keep the 8 byte words some instruction still accesses, in order, so
+	// every slot keeps its alignment and the slots sharing a word stay
+	// together
+	int64_t words = (ir->global_size + 7) / 8;
+	int32_t *map = malloc((words + 1) * sizeof(int32_t));
+	if (map == NULL) {
+		perror("Error in opt_compact_globals with malloc");
+		exit(1);
+	}
+	for (int64_t i = 0; i < words; i++) map[i] = -1;
+
+	for (int i = 0; i < ir->total_code; i++) {
+		int32_t offset;
+		if (ir_slot(&ir->code[i], &offset)) map[offset / 8] = 0;
+	}
+
+	int32_t kept = 0;
+	for (int64_t i = 0; i < words; i++) {
+		if (map[i] == 0) map[i] = kept++;
+	}
+	if ((int64_t) kept * 8 >= ir->global_size) {
+		free(map);
+		return 0;
+	}
+
+	for (int i = 0; i < ir->total_code; i++) {
+		ir_t *ip = &ir->code[i];
+		int32_t offset;
+		if (!ir_slot(ip, &offset)) continue;
+
+		int32_t moved = map[offset / 8] * 8 + offset % 8;
+		if (ip->type >= IR_LOAD8 && ip->type <= IR_LOAD64) ip->arg2 = moved;
+		else ip->arg1 = moved;
+	}
+	ir->global_size = (int64_t) kept * 8;
+
+	free(map);
+	return 1;
+}
+
+int opt_compact_consts(ir_prog_t *ir) {
+	// Keep the constants some instruction still uses, in order
+	int32_t *map = malloc((ir->total_consts + 1) * sizeof(int32_t));
+	if (map == NULL) {
+		perror("Error in opt_compact_consts with malloc");
+		exit(1);
+	}
+	for (int i = 0; i < ir->total_consts; i++) map[i] = -1;
+
+	for (int i = 0; i < ir->total_code; i++) {
+		int32_t *arg = opt_const_arg(&ir->code[i]);
+		if (arg) map[*arg] = 0;
+	}
+
+	int kept = 0;
+	for (int i = 0; i < ir->total_consts; i++) {
+		if (map[i] < 0) continue;
+		ir->consts[kept] = ir->consts[i];
+		map[i] = kept++;
+	}
+	if (kept == ir->total_consts) {
+		free(map);
+		return 0;
+	}
+
+	for (int i = 0; i < ir->total_code; i++) {
+		int32_t *arg = opt_const_arg(&ir->code[i]);
+		if (arg) *arg = map[*arg];
+	}
+	ir->total_consts = kept;
+
+	// The indices in the table moved
+	free(consts_table);
+	consts_table = NULL;
+	consts_table_cap = 0;
+
+	free(map);
+	return 1;
+}
+
+int32_t *opt_const_arg(ir_t *ir) {
+	switch (ir->type) {
+	case IR_GLOBAL_LOAD_CONST:
+		return &ir->arg3;
+	case IR_LOAD_CONST:
+	case IR_JLTI: case IR_JLEI: case IR_JGTI:
+	case IR_JGEI: case IR_JEQI: case IR_JNEI:
+		return &ir->arg2;
+	}
+	return NULL;
+}
+
+int32_t opt_const(ir_prog_t *ir, int64_t value) {
+	// Index of the value in the constant pool, added if it is not there
+	if (2 * (ir->total_consts + 1) > consts_table_cap) opt_grow_consts(ir);
+
+	uint64_t mask = consts_table_cap - 1;
+	uint64_t slot = ((uint64_t) value * 0x9e3779b97f4a7c15 >> 32) & mask;
+	for (; consts_table[slot]; slot = (slot + 1) & mask) {
+		if (ir->consts[consts_table[slot] - 1] == value) {
+			return consts_table[slot] - 1;
+		}
+	}
+
+	if (ir->total_consts == consts_cap) {
+		consts_cap = consts_cap ? consts_cap * 2 : 64;
+		ir->consts = realloc(ir->consts, consts_cap * sizeof(int64_t));
+		if (ir->consts == NULL) {
+			perror("Error in opt_const with realloc");
+			exit(1);
+		}
+	}
+
+	ir->consts[ir->total_consts++] = value;
+	consts_table[slot] = ir->total_consts;
+	return ir->total_consts - 1;
+}
+
+int32_t *opt_use_arg(ir_t *ir, int use) {
+	// Argument holding the register ir_uses returns at a position
+	switch (ir->type) {
+	case IR_PRINT: case IR_JMP_TRUE: case IR_JMP_FALSE:
+	case IR_JLTI: case IR_JLEI: case IR_JGTI:
+	case IR_JGEI: case IR_JEQI: case IR_JNEI:
+	case IR_JLT: case IR_JLE: case IR_JGT:
+	case IR_JGE: case IR_JEQ: case IR_JNE:
+		return use == 0 ? &ir->arg1 : &ir->arg2;
+	}
+	return use == 0 ? &ir->arg2 : &ir->arg3;
+}
+
+void opt_grow_consts(ir_prog_t *ir) {
+	consts_table_cap = consts_table_cap ? consts_table_cap * 2 : 128;
+	while (consts_table_cap < 2 * (ir->total_consts + 1)) {
+		consts_table_cap *= 2;
+	}
+	free(consts_table);
+	consts_table = calloc(consts_table_cap, sizeof(int));
+	if (consts_table == NULL) {
+		perror("Error in opt_grow_consts with calloc");
+		exit(1);
+	}
+
+	uint64_t mask = consts_table_cap - 1;
+	for (int i = 0; i < ir->total_consts; i++) {
+		uint64_t slot = ((uint64_t) ir->consts[i] * 0x9e3779b97f4a7c15 >> 32) &
+			mask;
+		while (consts_table[slot]) slot = (slot + 1) & mask;
+		consts_table[slot] = i + 1;
+	}
+}
+
+void print_pass_stats(const char *name, int before, int after,
+	double seconds) {
+	fprintf(stderr, "[stats] pass: %s | %.3f ms | %d -> %d instructions\n",
+		name, seconds * 1000, before, after);
+}
@@ -0,0 +1,67 @@
+#include "pos.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+static struct {
+	const char *src;
+	int count;
+	int cap;
+	pos_t *starts;
+} line_table;
+
+void line_table_build(const char *src);
+void line_table_append(pos_t start);
+
+// ========================================
+// pos.h - definition
+// ========================================
+
+void pos_line_column(const char *src, pos_t pos, int *line, int *column) {
+	if (line_table.src != src) line_table_build(src);
+
+	// Last line starting at or before pos
+	int lo = 0, hi = line_table.count - 1;
+	while (lo < hi) {
+		int mid = lo + (hi - lo + 1) / 2;
+		if (line_table.starts[mid] <= pos) lo = mid;
+		else hi = mid - 1;
+	}
+
+	*line = lo + 1;
+	*column = pos - line_table.starts[lo] + 1;
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+void line_table_build(const char *src) {
+	line_table.src = src;
+	line_table.count = 0;
+	line_table_append(0);
+
+	const char *end = src + strlen(src);
+	for (const char *cur = src; (cur = memchr(cur, '\n', end - cur)); ) {
+		cur++;
+		line_table_append(cur - src);
+	}
+}
+
+void line_table_append(pos_t start) {
+	if (line_table.count == line_table.cap) {
+		line_table.cap = line_table.cap ? line_table.cap * 2 : 1024;
+		line_table.starts = realloc(line_table.starts,
+			line_table.cap * sizeof(pos_t));
+		if (line_table.starts == NULL) {
+			perror("Error in line_table_append with realloc");
+			exit(1);
+		}
+	}
+	line_table.starts[line_table.count++] = start;
+}
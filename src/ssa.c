@@ -0,0 +1,499 @@
+#include "ssa.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+// Pairs of ints collected before they are grouped by their first int
+typedef struct {
+	int *items;
+	int total;
+	int cap;
+} ssa_pairs_t;
+
+void ssa_slots(ssa_t *ssa, arena_t *arena);
+char *ssa_globals(ssa_t *ssa);
+void ssa_place(ssa_t *ssa, char *global, arena_t *arena);
+void ssa_rename(ssa_t *ssa, arena_t *arena);
+int ssa_is_slot(ssa_t *ssa, int32_t offset);
+
+void ssa_pairs_add(ssa_pairs_t *pairs, int first, int second);
+int *ssa_group(ssa_pairs_t *pairs, int total_groups, int **items,
+	arena_t *arena);
+void print_ssa_var(ssa_t *ssa, int var, buffer_t *out);
+void print_ssa_value(ssa_t *ssa, int value, buffer_t *out);
+
+// ========================================
+// ssa.h - definition
+// ========================================
+
+ssa_t *build_ssa(cfg_t *cfg, arena_t *arena) {
+	ssa_t *ssa = arena_alloc(arena, sizeof(ssa_t));
+	memset(ssa, 0, sizeof(ssa_t));
+	ssa->cfg = cfg;
+
+	ssa_slots(ssa, arena);
+
+	char *global = ssa_globals(ssa);
+	ssa_place(ssa, global, arena);
+	free(global);
+
+	ssa_rename(ssa, arena);
+	return ssa;
+}
+
+int ssa_def(ssa_t *ssa, ir_t *ir) {
+	int32_t def = ir_def(ir);
+	if (def >= 0) return def;
+
+	// Loads define a register, so only stores are left
+	int32_t offset;
+	if (ir_slot(ir, &offset) && ssa_is_slot(ssa, offset)) {
+		return ssa->slot_var[offset];
+	}
+	return -1;
+}
+
+int ssa_uses(ssa_t *ssa, ir_t *ir, int vars[3]) {
+	int32_t regs[3];
+	int total = ir_uses(ir, regs);
+	for (int i = 0; i < total; i++) vars[i] = regs[i];
+
+	int32_t offset;
+	if (ir->type >= IR_LOAD8 && ir->type <= IR_LOAD64 &&
+		ir_slot(ir, &offset) && ssa_is_slot(ssa, offset)) {
+		vars[total++] = ssa->slot_var[offset];
+	}
+	return total;
+}
+
+int ssa_value_var(ssa_t *ssa, int value) {
+	ir_prog_t *ir = ssa->cfg->ir;
+	if (value < ir->total_code) return ssa_def(ssa, &ir->code[value]);
+
+	value -= ir->total_code;
+	if (value < ssa->total_vars) return value;
+	return ssa->phis[value - ssa->total_vars].var;
+}
+
+void print_ssa(ssa_t *ssa, buffer_t *out) {
+	// Registers are printed as r<register>, slots as g<offset>, and values
+	// as @<instruction>, phi<phi> or <variable>.0 for the starting value
+	cfg_t *cfg = ssa->cfg;
+
+	buffer_append(out, "========== SSA PHIS ==========\n", -1);
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		for (int j = ssa->block_phis[i]; j < ssa->block_phis[i + 1]; j++) {
+			ssa_phi_t *phi = &ssa->phis[j];
+			int total_args = cfg->blocks[i].total_preds + (i == 0);
+
+			buffer_append(out, "block ", -1);
+			buffer_int(out, i);
+			buffer_append(out, " | phi", -1);
+			buffer_int(out, j);
+			buffer_append(out, ": ", 2);
+			print_ssa_var(ssa, phi->var, out);
+			buffer_append(out, " = phi(", -1);
+			for (int k = 0; k < total_args; k++) {
+				if (k) buffer_append(out, ", ", 2);
+				print_ssa_value(ssa, phi->args[k], out);
+			}
+			buffer_append(out, ")\n", 2);
+		}
+	}
+	buffer_flush(out);
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+void ssa_slots(ssa_t *ssa, arena_t *arena) {
+	// Accesses are aligned to their size, so slots can only overlap inside
+	// an 8 byte word. sizes holds the sizes every offset is accessed with
+	ir_prog_t *ir = ssa->cfg->ir;
+	int64_t size = ir->global_size;
+
+	unsigned char *sizes = calloc(size + 1, 1);
+	if (sizes == NULL) {
+		perror("Error in ssa_slots with calloc");
+		exit(1);
+	}
+	for (int i = 0; i < ir->total_code; i++) {
+		int32_t offset;
+		int width = ir_slot(&ir->code[i], &offset);
+		if (width) sizes[offset] |= width;
+	}
+
+	ssa->slot_var = arena_alloc(arena, (size + 1) * sizeof(int));
+	int total = 0;
+	for (int64_t word = 0; word < size; word += 8) {
+		int64_t end = word + 8 < size ? word + 8 : size;
+
+		for (int64_t i = word; i < end; i++) {
+			ssa->slot_var[i] = -1;
+			int width = sizes[i];
+			if (width == 0 || (width & (width - 1))) continue;
+
+			// No other offset of the word may reach into the slot, nor the
+			// slot into another offset
+			int alone = 1;
+			for (int64_t j = word; j < end && alone; j++) {
+				if (j == i || sizes[j] == 0) continue;
+				int other = sizes[j] & 8 ? 8 : sizes[j] & 4 ? 4 :
+					sizes[j] & 2 ? 2 : 1;
+				if (j < i + width && i < j + other) alone = 0;
+			}
+			if (alone) ssa->slot_var[i] = total++;
+		}
+	}
+
+	// var_offset and var_size are indexed by variable, so the registers
+	// leave them unused
+	ssa->total_vars = ir->total_regs + total;
+	ssa->var_offset = arena_alloc(arena, ssa->total_vars * sizeof(int32_t));
+	ssa->var_size = arena_alloc(arena, ssa->total_vars * sizeof(int32_t));
+	for (int64_t i = 0; i < size; i++) {
+		if (ssa->slot_var[i] < 0) continue;
+		int var = ssa->slot_var[i] += ir->total_regs;
+		ssa->var_offset[var] = i;
+		ssa->var_size[var] = sizes[i];
+	}
+
+	free(sizes);
+}
+
+char *ssa_globals(ssa_t *ssa) {
+	// A variable read in a block that did not define it first can be live
+	// across blocks, and only those can need phis. seen holds the last
+	// block that defined a variable, plus one
+	cfg_t *cfg = ssa->cfg;
+	ir_prog_t *ir = cfg->ir;
+
+	char *global = calloc(ssa->total_vars + 1, 1);
+	int *seen = calloc(ssa->total_vars + 1, sizeof(int));
+	if (global == NULL || seen == NULL) {
+		perror("Error in ssa_globals with calloc");
+		exit(1);
+	}
+
+	for (int i = 0; i < cfg->total_blocks; i++) {
+		cfg_block_t *block = &cfg->blocks[i];
+		for (int j = block->start; j < block->end; j++) {
+			int vars[3];
+			int total = ssa_uses(ssa, &ir->code[j], vars);
+			for (int k = 0; k < total; k++) {
+				if (seen[vars[k]] != i + 1) global[vars[k]] = 1;
+			}
+
+			int def = ssa_def(ssa, &ir->code[j]);
+			if (def >= 0) seen[def] = i + 1;
+		}
+	}
+
+	free(seen);
+	return global;
+}
+
+void ssa_place(ssa_t *ssa, char *global, arena_t *arena) {
+	cfg_t *cfg = ssa->cfg;
+	ir_prog_t *ir = cfg->ir;
+	int total_blocks = cfg->total_blocks;
+
+	int *mark = calloc(total_blocks + 1, sizeof(int));
+	int *work = malloc((total_blocks + 1) * sizeof(int));
+	int *queued = calloc(total_blocks + 1, sizeof(int));
+	if (mark == NULL || work == NULL || queued == NULL) {
+		perror("Error in ssa_place with malloc");
+		exit(1);
+	}
+
+	// Dominance frontiers (Cooper, Harvey and Kennedy): a block is in the
+	// frontier of the blocks from each of its predecessors up to its
+	// immediate dominator. A walk stops at a block that already has it,
+	// since the walk that added it went on up from there. The entry also
+	// has the start of the program as a predecessor, so it is in its own
+	// frontier when it is a loop header
+	ssa_pairs_t pairs = {};
+	for (int i = 0; i < cfg->total_order; i++) {
+		int b = cfg->order[i];
+		cfg_block_t *block = &cfg->blocks[b];
+
+		for (int j = 0; j < block->total_preds; j++) {
+			int runner = block->preds[j];
+			if (cfg->blocks[runner].order < 0) continue;
+
+			while (b == 0 || runner != block->idom) {
+				if (mark[runner] == b + 1) break;
+				mark[runner] = b + 1;
+				ssa_pairs_add(&pairs, runner, b);
+				if (runner == 0) break;
+				runner = cfg->blocks[runner].idom;
+			}
+		}
+	}
+	int *frontier;
+	int *frontier_start = ssa_group(&pairs, total_blocks, &frontier, arena);
+
+	// Blocks defining every variable that needs phis; every variable is
+	// defined at the entry
+	pairs.total = 0;
+	memset(mark, 0, (total_blocks + 1) * sizeof(int));
+	int *defined = calloc(ssa->total_vars + 1, sizeof(int));
+	if (defined == NULL) {
+		perror("Error in ssa_place with calloc");
+		exit(1);
+	}
+	for (int i = 0; i < cfg->total_order; i++) {
+		int b = cfg->order[i];
+		cfg_block_t *block = &cfg->blocks[b];
+		for (int j = block->start; j < block->end; j++) {
+			int def = ssa_def(ssa, &ir->code[j]);
+			if (def < 0 || !global[def] || defined[def] == b + 1) continue;
+			defined[def] = b + 1;
+			if (b != 0) ssa_pairs_add(&pairs, def, b);
+		}
+	}
+	for (int i = 0; i < ssa->total_vars; i++) {
+		if (global[i] && total_blocks) ssa_pairs_add(&pairs, i, 0);
+	}
+	free(defined);
+
+	int *def_blocks;
+	int *def_start = ssa_group(&pairs, ssa->total_vars, &def_blocks, arena);
+
+	// Phis go on the iterated frontier of the blocks defining a variable
+	pairs.total = 0;
+	memset(mark, 0, (total_blocks + 1) * sizeof(int));
+	for (int var = 0; var < ssa->total_vars; var++) {
+		int stamp = var + 1, total_work = 0;
+		for (int i = def_start[var]; i < def_start[var + 1]; i++) {
+			queued[def_blocks[i]] = stamp;
+			work[total_work++] = def_blocks[i];
+		}
+
+		while (total_work > 0) {
+			int b = work[--total_work];
+			for (int i = frontier_start[b]; i < frontier_start[b + 1]; i++) {
+				int y = frontier[i];
+				if (mark[y] == stamp) continue;
+				mark[y] = stamp;
+				ssa_pairs_add(&pairs, y, var);
+
+				if (queued[y] != stamp) {
+					queued[y] = stamp;
+					work[total_work++] = y;
+				}
+			}
+		}
+	}
+
+	int *phi_vars;
+	ssa->block_phis = ssa_group(&pairs, total_blocks, &phi_vars, arena);
+	ssa->total_phis = pairs.total;
+	ssa->phis = arena_alloc(arena, (pairs.total + 1) * sizeof(ssa_phi_t));
+
+	for (int b = 0; b < total_blocks; b++) {
+		int total_args = cfg->blocks[b].total_preds + (b == 0);
+		for (int i = ssa->block_phis[b]; i < ssa->block_phis[b + 1]; i++) {
+			ssa_phi_t *phi = &ssa->phis[i];
+			phi->var = phi_vars[i];
+			phi->block = b;
+			phi->args = arena_alloc(arena, total_args * sizeof(int));
+			for (int j = 0; j < total_args; j++) phi->args[j] = -1;
+			if (b == 0) phi->args[total_args - 1] = ir->total_code + phi->var;
+		}
+	}
+	ssa->total_values = ir->total_code + ssa->total_vars + ssa->total_phis;
+
+	free(pairs.items);
+	free(mark);
+	free(work);
+	free(queued);
+}
+
+void ssa_rename(ssa_t *ssa, arena_t *arena) {
+	// Walk the dominator tree with the value every variable has, undoing
+	// the definitions of a block when its subtree is left
+	cfg_t *cfg = ssa->cfg;
+	ir_prog_t *ir = cfg->ir;
+	int n = ir->total_code;
+
+	ssa->use_start = arena_alloc(arena, (n + 1) * sizeof(int));
+	int total_uses = 0;
+	for (int i = 0; i < n; i++) {
+		int vars[3];
+		ssa->use_start[i] = total_uses;
+		total_uses += ssa_uses(ssa, &ir->code[i], vars);
+	}
+	ssa->use_start[n] = total_uses;
+	ssa->uses = arena_alloc(arena, (total_uses + 1) * sizeof(int));
+	for (int i = 0; i < total_uses; i++) ssa->uses[i] = -1;
+	if (cfg->total_order == 0) return;
+
+	// Children of every block in the dominator tree
+	ssa_pairs_t pairs = {};
+	for (int i = 1; i < cfg->total_order; i++) {
+		int b = cfg->order[i];
+		ssa_pairs_add(&pairs, cfg->blocks[b].idom, b);
+	}
+	int *children;
+	int *child_start = ssa_group(&pairs, cfg->total_blocks, &children,
+		arena);
+	free(pairs.items);
+
+	int *cur = malloc((ssa->total_vars + 1) * sizeof(int));
+	int *stack = malloc((cfg->total_blocks + 1) * sizeof(int));
+	int *next = malloc((cfg->total_blocks + 1) * sizeof(int));
+	int *marks = malloc((cfg->total_blocks + 1) * sizeof(int));
+	if (cur == NULL || stack == NULL || next == NULL || marks == NULL) {
+		perror("Error in ssa_rename with malloc");
+		exit(1);
+	}
+	for (int i = 0; i < ssa->total_vars; i++) cur[i] = n + i;
+
+	// Variables and the values they had before a definition, as pairs
+	ssa_pairs_t undo = {};
+	int top = 0;
+	stack[top++] = 0;
+	next[0] = -1;
+
+	while (top > 0) {
+		int b = stack[top - 1];
+		cfg_block_t *block = &cfg->blocks[b];
+
+		if (next[b] < 0) {
+			next[b] = child_start[b];
+			marks[b] = undo.total;
+
+			for (int i = ssa->block_phis[b]; i < ssa->block_phis[b + 1]; i++) {
+				int var = ssa->phis[i].var;
+				ssa_pairs_add(&undo, var, cur[var]);
+				cur[var] = n + ssa->total_vars + i;
+			}
+
+			for (int i = block->start; i < block->end; i++) {
+				int vars[3];
+				int total = ssa_uses(ssa, &ir->code[i], vars);
+				for (int k = 0; k < total; k++) {
+					ssa->uses[ssa->use_start[i] + k] = cur[vars[k]];
+				}
+
+				int def = ssa_def(ssa, &ir->code[i]);
+				if (def >= 0) {
+					ssa_pairs_add(&undo, def, cur[def]);
+					cur[def] = i;
+				}
+			}
+
+			for (int i = 0; i < block->total_succs; i++) {
+				cfg_block_t *succ = &cfg->blocks[block->succs[i]];
+				int arg = 0;
+				while (succ->preds[arg] != b) arg++;
+
+				int first = ssa->block_phis[block->succs[i]];
+				int last = ssa->block_phis[block->succs[i] + 1];
+				for (int j = first; j < last; j++) {
+					ssa->phis[j].args[arg] = cur[ssa->phis[j].var];
+				}
+			}
+		}
+
+		if (next[b] < child_start[b + 1]) {
+			int child = children[next[b]++];
+			next[child] = -1;
+			stack[top++] = child;
+			continue;
+		}
+
+		while (undo.total > marks[b]) {
+			undo.total--;
+			cur[undo.items[2 * undo.total]] = undo.items[2 * undo.total + 1];
+		}
+		top--;
+	}
+
+	free(undo.items);
+	free(cur);
+	free(stack);
+	free(next);
+	free(marks);
+}
+
+int ssa_is_slot(ssa_t *ssa, int32_t offset) {
+	return offset >= 0 && offset < ssa->cfg->ir->global_size &&
+		ssa->slot_var[offset] >= 0;
+}
+
+void ssa_pairs_add(ssa_pairs_t *pairs, int first, int second) {
+	if (pairs->total == pairs->cap) {
+		pairs->cap = pairs->cap ? pairs->cap * 2 : 64;
+		pairs->items = realloc(pairs->items, pairs->cap * 2 * sizeof(int));
+		if (pairs->items == NULL) {
+			perror("Error in ssa_pairs_add with realloc");
+			exit(1);
+		}
+	}
+	pairs->items[2 * pairs->total] = first;
+	pairs->items[2 * pairs->total + 1] = second;
+	pairs->total++;
+}
+
+int *ssa_group(ssa_pairs_t *pairs, int total_groups, int **items,
+	arena_t *arena) {
+	// Counting sort of the second ints by the first ones; the items of
+	// group g are from start[g] to start[g + 1], in the order they were
+	// added
+	int *start = arena_alloc(arena, (total_groups + 1) * sizeof(int));
+	memset(start, 0, (total_groups + 1) * sizeof(int));
+	for (int i = 0; i < pairs->total; i++) start[pairs->items[2 * i] + 1]++;
+	for (int i = 0; i < total_groups; i++) start[i + 1] += start[i];
+
+	*items = arena_alloc(arena, (pairs->total + 1) * sizeof(int));
+	int *fill = malloc((total_groups + 1) * sizeof(int));
+	if (fill == NULL) {
+		perror("Error in ssa_group with malloc");
+		exit(1);
+	}
+	memcpy(fill, start, (total_groups + 1) * sizeof(int));
+	for (int i = 0; i < pairs->total; i++) {
+		(*items)[fill[pairs->items[2 * i]]++] = pairs->items[2 * i + 1];
+	}
+	free(fill);
+	return start;
+}
+
+void print_ssa_var(ssa_t *ssa, int var, buffer_t *out) {
+	int total_regs = ssa->cfg->ir->total_regs;
+	if (var < total_regs) {
+		buffer_append(out, "r", 1);
+		buffer_int(out, var);
+		return;
+	}
+	buffer_append(out, "g", 1);
+	buffer_int(out, ssa->var_offset[var]);
+}
+
+void print_ssa_value(ssa_t *ssa, int value, buffer_t *out) {
+	int n = ssa->cfg->ir->total_code;
+	if (value < 0) {
+		// From an unreachable block
+		buffer_append(out, "-", 1);
+	}
+	else if (value < n) {
+		buffer_append(out, "@", 1);
+		buffer_int(out, value);
+	}
+	else if (value < n + ssa->total_vars) {
+		print_ssa_var(ssa, value - n, out);
+		buffer_append(out, ".0", 2);
+	}
+	else {
+		buffer_append(out, "phi", 3);
+		buffer_int(out, value - n - ssa->total_vars);
+	}
+}
@@ -1,6 +1,7 @@
 #include "st.h"
 
 #include <assert.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,49 +10,43 @@
 // helper declaration
 // ========================================
 
-st_t *st_malloc(int type);
-int st_scope_append(st_t *scope, st_t *sym, int size);
-int is_token_equal(token_t left, token_t right);
+st_t *st_malloc(arena_t *arena, int type);
+int st_scope_append(st_t *scope, st_t *sym, type_t *data_type);
+void st_scope_insert(st_t *scope, st_t *sym, uint64_t hash);
+void st_scope_grow(st_t *scope);
+uint64_t st_hash_var(int sym);
 
 // ========================================
 // st.h - definition
 // ========================================
 
-st_t *st_create_scope(int scope_type, st_t *parent) {
-	st_t *res = st_malloc(scope_type);
+st_t *st_create_scope(int scope_type, st_t *parent, arena_t *arena) {
+	st_t *res = st_malloc(arena, scope_type);
 	res->scope.parent = parent;
-	res->scope.size = 0;
+	res->scope.size = res->scope.max = 0;
+	res->scope.arena = arena;
+	res->scope.tail = res;
+	res->scope.table = NULL;
+	res->scope.total = res->scope.cap = 0;
 	return res;
 }
 
-st_t *st_check_literal(st_t *scope, token_t token, type_t *data_type) {
-	if (scope == NULL) return NULL;
-
-	for (st_t *cur = scope->next; cur; cur = cur->next) {
-		if (cur->type == ST_LITERAL && 
-			cur->literal.data_type == data_type &&
-			is_token_equal(cur->literal.token, token)) {
-			return cur;
-		}
-	}
-
-	return NULL;
+int st_scope_mark(st_t *scope) {
+	return scope->scope.size;
 }
 
-st_t *st_create_literal(st_t *scope, token_t token, type_t *data_type) {
-	st_t *sym = st_malloc(ST_LITERAL);
-	sym->literal.token = token;
-	sym->literal.data_type = data_type;
-	sym->literal.offset = st_scope_append(scope, sym, data_type->size);
-	return sym;
+void st_scope_release(st_t *scope, int mark) {
+	scope->scope.size = mark;
 }
 
 st_t *st_check_var(st_t *scope, token_t identifier) {
-	if (scope == NULL) return NULL;
+	if (scope == NULL || scope->scope.cap == 0) return NULL;
+
+	int mask = scope->scope.cap - 1;
+	int slot = st_hash_var(identifier.sym) & mask;
 
-	for (st_t *cur = scope->next; cur; cur = cur->next) {
-		if (cur->type == ST_VAR && 
-			is_token_equal(cur->var.token, identifier)) {
+	for (st_t *cur; (cur = scope->scope.table[slot]); slot = (slot + 1) & mask) {
+		if (cur->type == ST_VAR && cur->var.token.sym == identifier.sym) {
 			return cur;
 		}
 	}
@@ -60,10 +55,10 @@ st_t *st_check_var(st_t *scope, token_t identifier) {
 }
 
 st_t *st_create_var(st_t *scope, token_t identifier, type_t *data_type) {
-	st_t *sym = st_malloc(ST_VAR);
+	st_t *sym = st_malloc(scope->scope.arena, ST_VAR);
 	sym->var.token = identifier;
 	sym->var.data_type = data_type;
-	sym->var.offset = st_scope_append(scope, sym, data_type->size);
+	sym->var.offset = st_scope_append(scope, sym, data_type);
 	return sym;
 }
 
@@ -71,29 +66,69 @@ st_t *st_create_var(st_t *scope, token_t identifier, type_t *data_type) {
 // helper definition
 // ========================================
 
-st_t *st_malloc(int type) {
-	st_t *res = malloc(sizeof(st_t));
+st_t *st_malloc(arena_t *arena, int type) {
+	st_t *res = arena_alloc(arena, sizeof(st_t));
 	res->type = type;
 	res->next = NULL;
 	return res;
 }
 
-int st_scope_append(st_t *scope, st_t *sym, int size) {
-	st_t *cur = NULL;
-	for (cur = scope; cur->next; cur = cur->next) {}
-	cur->next = sym;
+int st_scope_append(st_t *scope, st_t *sym, type_t *data_type) {
+	scope->scope.tail->next = sym;
+	scope->scope.tail = sym;
+
+	// Only name scopes are looked up; a memory scope holds every variable
+	// of the program, and those of different blocks can share a name
+	if (scope->type == ST_NAME_SCOPE) {
+		st_scope_insert(scope, sym, st_hash_var(sym->var.token.sym));
+	}
 
-	int offset = scope->scope.size;
-	scope->scope.size += size;
+	// Naturally aligned, so a value is a single access in the vm
+	int align = data_type->align;
+	int offset = (scope->scope.size + align - 1) / align * align;
+	scope->scope.size = offset + data_type->size;
+	if (scope->scope.size > scope->scope.max) {
+		scope->scope.max = scope->scope.size;
+	}
 	return offset;
 }
 
-int is_token_equal(token_t left, token_t right) {
-	char *cur_lex = token_lexical(left);
-	char *token_lex = token_lexical(right);
-	int same = (strcmp(cur_lex, token_lex) == 0);
-	free(cur_lex);
-	free(token_lex);
-	return same;
+void st_scope_insert(st_t *scope, st_t *sym, uint64_t hash) {
+	// Keep the load factor under a half
+	if ((scope->scope.total + 1) * 2 > scope->scope.cap) st_scope_grow(scope);
+
+	int mask = scope->scope.cap - 1;
+	int slot = hash & mask;
+	while (scope->scope.table[slot]) slot = (slot + 1) & mask;
+
+	scope->scope.table[slot] = sym;
+	scope->scope.total++;
+}
+
+void st_scope_grow(st_t *scope) {
+	// The table lives in the arena of the scope, so it is released with
+	// the scope; the tables it outgrew stay behind, at most as large as
+	// the current one in total
+	int cap = scope->scope.cap ? scope->scope.cap * 2 : 16;
+	st_t **table = arena_alloc(scope->scope.arena, cap * sizeof(st_t *));
+	memset(table, 0, cap * sizeof(st_t *));
+
+	int mask = cap - 1;
+	for (int i = 0; i < scope->scope.cap; i++) {
+		st_t *sym = scope->scope.table[i];
+		if (sym == NULL) continue;
+
+		int slot = st_hash_var(sym->var.token.sym) & mask;
+		while (table[slot]) slot = (slot + 1) & mask;
+		table[slot] = sym;
+	}
+
+	scope->scope.table = table;
+	scope->scope.cap = cap;
+}
+
+uint64_t st_hash_var(int sym) {
+	// Symbols are consecutive, so a multiplicative hash spreads them
+	return ((uint64_t) sym * 0x9e3779b97f4a7c15ull) >> 32;
 }
 
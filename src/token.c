@@ -1,8 +1,11 @@
 #include "token.h"
 #include "pos.h"
 #include "error.h"
+#include "intern.h"
 
-#include <ctype.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -11,48 +14,278 @@
 // helper declaration
 // ========================================
 
+// Character classes used by the scanner
+#define CC_SPACE  0x01
+#define CC_ALPHA  0x02
+#define CC_DIGIT  0x04
+#define CC_PUNCT  0x08
+
+#define CC_IDENT  (CC_ALPHA | CC_DIGIT)
+
+// Bulk scanning with SIMD; falls back to the class table when the
+// target has neither AVX2 nor SSE2 (or near the end of the source)
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH 32
+typedef __m256i simd_t;
+#define simd_load(p)  _mm256_loadu_si256((const __m256i *) (p))
+#define simd_set1(c)  _mm256_set1_epi8(c)
+#define simd_eq(a, b) _mm256_cmpeq_epi8(a, b)
+#define simd_gt(a, b) _mm256_cmpgt_epi8(a, b)
+#define simd_or(a, b) _mm256_or_si256(a, b)
+#define simd_and(a, b) _mm256_and_si256(a, b)
+#define simd_mask(a)  ((uint32_t) _mm256_movemask_epi8(a))
+#define SIMD_FULL     0xffffffffu
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 16
+typedef __m128i simd_t;
+#define simd_load(p)  _mm_loadu_si128((const __m128i *) (p))
+#define simd_set1(c)  _mm_set1_epi8(c)
+#define simd_eq(a, b) _mm_cmpeq_epi8(a, b)
+#define simd_gt(a, b) _mm_cmpgt_epi8(a, b)
+#define simd_or(a, b) _mm_or_si128(a, b)
+#define simd_and(a, b) _mm_and_si128(a, b)
+#define simd_mask(a)  ((uint32_t) _mm_movemask_epi8(a))
+#define SIMD_FULL     0xffffu
+#endif
+
+// Lo <= x <= hi on signed bytes (every range used is within 0..127, so
+// bytes >= 0x80 compare as negative and never match)
+#define simd_range(x, lo, hi) simd_and(simd_gt(x, simd_set1((lo) - 1)), \
+	simd_gt(simd_set1((hi) + 1), x))
+
+static unsigned char char_class[256];
+static unsigned char punct_token[256];
+
+// Two character punctuators by their first character; none of them share
+// it with another one
 static struct {
+	char second;
+	unsigned char type;
+} punct_pair[256];
+
+// Parallel lexing never hands a thread less than this many bytes
+#define LEX_MIN_CHUNK (64 * 1024)
+
+// Tokens lexed at a time by a streamed token stream
+#define LEX_STREAM_BATCH 1024
+
+// Keywords are looked up with a perfect hash over
+// (first char, last char, length); see lexer_keyword_hash
+#define KEYWORD_TABLE_SIZE 16
+
+static struct {
+	const char *name;
+	int len;
+	int type;
+} keyword_table[KEYWORD_TABLE_SIZE];
+
+// Scans the source range [cur, src_len); several lexers can run at once on
+// disjoint ranges as they share nothing but the read-only tables
+struct lexer_t {
 	const char *filepath;
 	const char *src;
 	int src_len;
 	pos_t prev;
 	pos_t cur;
-	token_t *head;
-	token_t *tail;
-} lexer;
-
-void lexer_init(const char *filepath, const char *src);
-void lexer_error(pos_t start, pos_t end, const char *message);
-int lexer_eof();
-int lexer_read_token();
-char lexer_current_char();
-char lexer_next_char();
-int lexer_append_token(int type);
-int lexer_check_keyword();
+	tokens_t *tokens;
+
+	// Scanning stops at the first unexpected character or out of range
+	// literal; it is reported only after the tokens before it are
+	// interned, so diagnostics come out in source order
+	int error;
+	pos_t error_start;
+	pos_t error_end;
+	const char *error_message;
+};
+
+typedef struct lexer_t lexer_t;
+
+void lexer_init_tables();
+void lexer_init(lexer_t *lexer, const char *filepath, const char *src,
+	int start, int end, tokens_t *tokens);
+int lexer_guess_tokens(int bytes);
+void lexer_run(lexer_t *lexer);
+void lexer_batch(lexer_t *lexer);
+void *lexer_thread(void *arg);
+void lexer_intern(lexer_t *lexer, tokens_t *tokens, int from);
+void lexer_report(lexer_t *lexer);
+int lexer_eof(lexer_t *lexer);
+int lexer_read_token(lexer_t *lexer);
+void lexer_skip_space(lexer_t *lexer);
+int lexer_span(lexer_t *lexer, int index, int cc);
+int lexer_append_token(lexer_t *lexer, int type);
+int lexer_keyword_hash(const char *lexical, int len);
+int lexer_check_keyword(lexer_t *lexer);
+int lexer_split(const char *src, int len, int target);
+
+tokens_t *tokens_create(const char *filepath, const char *src, int cap);
+void tokens_grow(tokens_t *tokens);
+int tokens_intern(tokens_t *tokens, int from, int to);
+int tokens_intern_literal(tokens_t *tokens, int index);
+int tokens_decode(const char *digits, int len, int64_t *value);
 
 // ========================================
 // token.h - definition
 // ========================================
 
-token_t *generate_tokens(const char *filepath, const char *src) {
-	lexer_init(filepath, src);
+tokens_t *generate_tokens(const char *filepath, const char *src, int len) {
+	return generate_tokens_parallel(filepath, src, len, 1);
+}
+
+tokens_t *generate_tokens_parallel(const char *filepath, const char *src,
+	int len, int threads) {
+	lexer_init_tables();
+
+	int chunks = threads;
+	if (chunks > len / LEX_MIN_CHUNK) chunks = len / LEX_MIN_CHUNK;
+	if (chunks < 1) chunks = 1;
+
+	if (chunks == 1) {
+		lexer_t lexer;
+		lexer_init(&lexer, filepath, src, 0, len,
+			tokens_create(filepath, src, lexer_guess_tokens(len)));
+		lexer_run(&lexer);
+		lexer_intern(&lexer, lexer.tokens, 0);
+		lexer_report(&lexer);
+
+		lexer.prev = lexer.cur;
+		lexer_append_token(&lexer, TT_EOF);
+		return lexer.tokens;
+	}
 
-	while (!lexer_eof()) {
-		lexer_read_token();
+	// Tokens never contain whitespace, so cutting the source right after
+	// a whitespace character gives chunks that lex exactly like the
+	// corresponding part of the whole file
+	lexer_t *lexers = malloc(chunks * sizeof(lexer_t));
+	pthread_t *ids = malloc(chunks * sizeof(pthread_t));
+	if (lexers == NULL || ids == NULL) {
+		perror("Error in generate_tokens_parallel with malloc");
+		exit(1);
 	}
 
-	lexer.prev = lexer.cur;
-	lexer_append_token(TT_EOF);
+	int start = 0;
+	for (int i = 0; i < chunks; i++) {
+		int end = len;
+		if (i + 1 < chunks) {
+			end = lexer_split(src, len, (int64_t) len * (i + 1) / chunks);
+			if (end < start) end = start;
+		}
+		lexer_init(&lexers[i], filepath, src, start, end,
+			tokens_create(filepath, src, lexer_guess_tokens(end - start)));
+		start = end;
+	}
 
-	return lexer.head;
+	for (int i = 1; i < chunks; i++) {
+		if (pthread_create(&ids[i], NULL, lexer_thread, &lexers[i]) != 0) {
+			perror("Error in generate_tokens_parallel with pthread_create");
+			exit(1);
+		}
+	}
+	lexer_run(&lexers[0]);
+	for (int i = 1; i < chunks; i++) {
+		pthread_join(ids[i], NULL);
+	}
+
+	// Stitch the chunks together; interning is done serially since the
+	// pool is shared, but the hashes were already computed by the threads
+	int total = 1;
+	for (int i = 0; i < chunks; i++) total += lexers[i].tokens->count;
+
+	tokens_t *tokens = tokens_create(filepath, src, total);
+	for (int i = 0; i < chunks; i++) {
+		tokens_t *chunk = lexers[i].tokens;
+		int at = tokens->count;
+
+		memcpy(tokens->types + at, chunk->types,
+			chunk->count * sizeof(unsigned char));
+		memcpy(tokens->starts + at, chunk->starts,
+			chunk->count * sizeof(pos_t));
+		memcpy(tokens->lens + at, chunk->lens, chunk->count * sizeof(int));
+		memcpy(tokens->syms + at, chunk->syms, chunk->count * sizeof(int));
+		tokens->count += chunk->count;
+
+		lexer_intern(&lexers[i], tokens, at);
+		lexer_report(&lexers[i]);
+		free_tokens(chunk);
+	}
+
+	int eof = tokens->count++;
+	tokens->types[eof] = TT_EOF;
+	tokens->starts[eof] = len;
+	tokens->lens[eof] = 0;
+	tokens->syms[eof] = SYM_NONE;
+
+	free(lexers);
+	free(ids);
+	return tokens;
 }
 
-void free_tokens(token_t *tokens) {
-	while (tokens) {
-		token_t *prev = tokens;
-		tokens = tokens->next;
-		free(prev);
+tokens_t *generate_tokens_stream(const char *filepath, const char *src,
+	int start, int len) {
+	lexer_init_tables();
+
+	lexer_t *lexer = malloc(sizeof(lexer_t));
+	if (lexer == NULL) {
+		perror("Error in generate_tokens_stream with malloc");
+		exit(1);
 	}
+	// Only a few statements worth of tokens are ever alive
+	tokens_t *tokens = tokens_create(filepath, src, LEX_STREAM_BATCH * 2);
+	lexer_init(lexer, filepath, src, start, len, tokens);
+	tokens->lexer = lexer;
+	return tokens;
+}
+
+int tokens_fill(tokens_t *tokens, int index) {
+	while (index - tokens->base >= tokens->count) {
+		if (tokens->lexer == NULL) return TT_EOF;
+		lexer_batch(tokens->lexer);
+	}
+	return tokens->types[index - tokens->base];
+}
+
+void tokens_discard(tokens_t *tokens, int index) {
+	int drop = index - tokens->base;
+	if (drop <= 0) return;
+	if (drop > tokens->count) drop = tokens->count;
+
+	int keep = tokens->count - drop;
+	memmove(tokens->types, tokens->types + drop, keep * sizeof(unsigned char));
+	memmove(tokens->starts, tokens->starts + drop, keep * sizeof(pos_t));
+	memmove(tokens->lens, tokens->lens + drop, keep * sizeof(int));
+	memmove(tokens->syms, tokens->syms + drop, keep * sizeof(int));
+
+	tokens->count = keep;
+	tokens->base += drop;
+}
+
+void free_tokens(tokens_t *tokens) {
+	if (tokens == NULL) return;
+
+	free(tokens->lexer);
+
+	free(tokens->types);
+	free(tokens->starts);
+	free(tokens->lens);
+	free(tokens->syms);
+	free(tokens);
+}
+
+token_t token_at(tokens_t *tokens, int index) {
+	token_t token;
+	index -= tokens->base;
+	token.type = tokens->types[index];
+	token.filepath = tokens->filepath;
+	token.src = tokens->src;
+
+	token.start = tokens->starts[index];
+	token.end = token.start + tokens->lens[index];
+	token.sym = tokens->syms[index];
+	token.value = 0;
+	if (token.type == TT_INT_LITERAL) token.value = intern_value(token.sym);
+	return token;
 }
 
 const char *token_type(token_t token) {
@@ -64,6 +297,16 @@ const char *token_type(token_t token) {
 	if (token.type == TT_EQUAL) return "TT_EQUAL";
 	if (token.type == TT_LPAREN) return "TT_LPAREN";
 	if (token.type == TT_RPAREN) return "TT_RPAREN";
+	if (token.type == TT_LESS) return "TT_LESS";
+	if (token.type == TT_LESS_EQUAL) return "TT_LESS_EQUAL";
+	if (token.type == TT_GREATER) return "TT_GREATER";
+	if (token.type == TT_GREATER_EQUAL) return "TT_GREATER_EQUAL";
+	if (token.type == TT_EQUAL_EQUAL) return "TT_EQUAL_EQUAL";
+	if (token.type == TT_BANG_EQUAL) return "TT_BANG_EQUAL";
+	if (token.type == TT_BANG) return "TT_BANG";
+	if (token.type == TT_AND_AND) return "TT_AND_AND";
+	if (token.type == TT_OR_OR) return "TT_OR_OR";
+	if (token.type == TT_COLON) return "TT_COLON";
 	if (token.type == TT_IDENTIFIER) return "TT_IDENTIFIER";
 	if (token.type == TT_VAR_KEYWORD) return "TT_VAR_KEYWORD";
 	if (token.type == TT_PRINT_KEYWORD) return "TT_PRINT_KEYWORD";
@@ -78,8 +321,8 @@ const char *token_type(token_t token) {
 }
 
 char *token_lexical(token_t token) {
-	int len = token.end.index - token.start.index;
-	const char *src = token.src + token.start.index;
+	int len = token.end - token.start;
+	const char *src = token.src + token.start;
 
 	char *res = malloc((len + 1) * sizeof(char));
 	if (res == NULL) {
@@ -95,140 +338,437 @@ char *token_lexical(token_t token) {
 	return res;
 }
 
+void print_tokens(tokens_t *tokens, buffer_t *out, int format) {
+	// Tokens are in source order, so lines are counted along the way
+	// instead of being looked up per token
+	int line = 1;
+	pos_t line_start = 0, scanned = 0;
+
+	for (int i = 0; i < tokens->count; i++) {
+		token_t token = token_at(tokens, i);
+		const char *lexical = token.src + token.start;
+		int len = token.end - token.start;
+
+		if (format == DUMP_TEXT) {
+			buffer_append(out, token_type(token), -1);
+			buffer_append(out, " | ", 3);
+			buffer_append(out, lexical, len);
+			buffer_append(out, "\n", 1);
+			continue;
+		}
+
+		const char *newline;
+		while ((newline = memchr(token.src + scanned, '\n',
+			token.start - scanned))) {
+			line++;
+			line_start = scanned = newline - token.src + 1;
+		}
+		scanned = token.start;
+
+		buffer_append(out, "{\"type\":\"", -1);
+		buffer_append(out, token_type(token), -1);
+		buffer_append(out, "\",\"text\":", -1);
+		buffer_string(out, lexical, len);
+		buffer_append(out, ",\"line\":", -1);
+		buffer_int(out, line);
+		buffer_append(out, ",\"column\":", -1);
+		buffer_int(out, token.start - line_start + 1);
+		buffer_append(out, ",\"start\":", -1);
+		buffer_int(out, token.start);
+		buffer_append(out, ",\"end\":", -1);
+		buffer_int(out, token.end);
+		if (token.type == TT_INT_LITERAL) {
+			buffer_append(out, ",\"value\":", -1);
+			buffer_int(out, token.value);
+		}
+		buffer_append(out, "}\n", 2);
+	}
+	buffer_flush(out);
+}
+
 // ========================================
 // helper definition
 // ========================================
 
-void lexer_init(const char *filepath, const char *src) {
-	lexer.filepath = filepath;
-	lexer.src = src;
-	lexer.cur = POS_INIT;
-	lexer.prev = POS_INIT;
-	lexer.head = lexer.tail = NULL;
+void lexer_init_tables() {
+	static int initialized = 0;
+	if (initialized) return;
+	initialized = 1;
 
-	lexer.src_len = strlen(src);
+	const char *spaces = " \t\n\v\f\r";
+	for (const char *c = spaces; *c; c++) {
+		char_class[(unsigned char) *c] = CC_SPACE;
+	}
+	for (int c = 'a'; c <= 'z'; c++) char_class[c] = CC_ALPHA;
+	for (int c = 'A'; c <= 'Z'; c++) char_class[c] = CC_ALPHA;
+	for (int c = '0'; c <= '9'; c++) char_class[c] = CC_DIGIT;
+	char_class['_'] = CC_ALPHA;
+
+	struct {
+		char ch;
+		int type;
+	} puncts[] = {
+		{';', TT_SEMICOLON},
+		{'{', TT_LBRACE},
+		{'}', TT_RBRACE},
+		{'+', TT_PLUS},
+		{'-', TT_MINUS},
+		{'=', TT_EQUAL},
+		{'(', TT_LPAREN},
+		{')', TT_RPAREN},
+		{'<', TT_LESS},
+		{'>', TT_GREATER},
+		{'!', TT_BANG},
+		{':', TT_COLON},
+
+		// Only valid as the start of "&&" and "||"
+		{'&', TT_EOF},
+		{'|', TT_EOF},
+	};
+	for (int i = 0; i < (int) (sizeof(puncts) / sizeof(puncts[0])); i++) {
+		char_class[(unsigned char) puncts[i].ch] = CC_PUNCT;
+		punct_token[(unsigned char) puncts[i].ch] = puncts[i].type;
+	}
+
+	struct {
+		const char *name;
+		int type;
+	} pairs[] = {
+		{"<=", TT_LESS_EQUAL},
+		{">=", TT_GREATER_EQUAL},
+		{"==", TT_EQUAL_EQUAL},
+		{"!=", TT_BANG_EQUAL},
+		{"&&", TT_AND_AND},
+		{"||", TT_OR_OR},
+	};
+	for (int i = 0; i < (int) (sizeof(pairs) / sizeof(pairs[0])); i++) {
+		unsigned char first = pairs[i].name[0];
+		punct_pair[first].second = pairs[i].name[1];
+		punct_pair[first].type = pairs[i].type;
+	}
+
+	struct {
+		const char *name;
+		int type;
+	} keywords[] = {
+		{"var", TT_VAR_KEYWORD},
+		{"print", TT_PRINT_KEYWORD},
+		{"if", TT_IF_KEYWORD},
+		{"else", TT_ELSE_KEYWORD},
+		{"while", TT_WHILE_KEYWORD},
+		{"break", TT_BREAK_KEYWORD},
+		{"continue", TT_CONTINUE_KEYWORD},
+	};
+	for (int i = 0; i < (int) (sizeof(keywords) / sizeof(keywords[0])); i++) {
+		int len = strlen(keywords[i].name);
+		int h = lexer_keyword_hash(keywords[i].name, len);
+		assert(keyword_table[h].name == NULL && "keyword hash collision");
+		keyword_table[h].name = keywords[i].name;
+		keyword_table[h].len = len;
+		keyword_table[h].type = keywords[i].type;
+	}
 }
 
-void lexer_error(pos_t start, pos_t end, const char *message) {
-	error_print(lexer.filepath, lexer.src, start, end, message);
-	exit(1);
+void lexer_init(lexer_t *lexer, const char *filepath, const char *src,
+	int start, int end, tokens_t *tokens) {
+	lexer->filepath = filepath;
+	lexer->src = src;
+	lexer->src_len = end;
+	lexer->cur = start;
+	lexer->prev = start;
+	lexer->tokens = tokens;
+	lexer->error = 0;
 }
 
-int lexer_eof() {
-	return lexer.cur.index >= lexer.src_len;
+int lexer_guess_tokens(int bytes) {
+	// Most lemon tokens are a few characters long, so a quarter of the
+	// source length is a good first guess that avoids regrowing
+	return bytes / 4 + 16;
 }
 
-int lexer_read_token() {
-	while (!lexer_eof() && isspace(lexer_current_char())) {
-		lexer_next_char();
+void lexer_run(lexer_t *lexer) {
+	while (!lexer_eof(lexer) && !lexer->error) {
+		lexer_read_token(lexer);
 	}
+}
 
-	if (lexer_eof()) return TT_EOF;
-
-	lexer.prev = lexer.cur;
-	char ch = lexer_next_char();
+void lexer_batch(lexer_t *lexer) {
+	tokens_t *tokens = lexer->tokens;
+	int from = tokens->count;
 
-	if (ch == ';') {
-		return lexer_append_token(TT_SEMICOLON);
+	while (!lexer_eof(lexer) && !lexer->error &&
+		tokens->count - from < LEX_STREAM_BATCH) {
+		lexer_read_token(lexer);
 	}
-	else if (ch == '{') {
-		return lexer_append_token(TT_LBRACE);
-	}
-	else if (ch == '}') {
-		return lexer_append_token(TT_RBRACE);
+
+	lexer_intern(lexer, tokens, from);
+
+	// The tokens before a lex error are still handed out; it is reported
+	// once the parser gets to it
+	if (tokens->count == from) lexer_report(lexer);
+
+	if (lexer_eof(lexer) && !lexer->error) {
+		lexer->prev = lexer->cur;
+		lexer_append_token(lexer, TT_EOF);
+
+		tokens->lexer = NULL;
+		free(lexer);
 	}
-	else if (ch == '+') {
-		return lexer_append_token(TT_PLUS);
+}
+
+void *lexer_thread(void *arg) {
+	lexer_run(arg);
+	return NULL;
+}
+
+void lexer_intern(lexer_t *lexer, tokens_t *tokens, int from) {
+	int bad = tokens_intern(tokens, from, tokens->count);
+	if (bad == tokens->count) return;
+
+	// Drop everything from the out of range literal on; it comes before
+	// any unexpected character the lexer stopped at
+	lexer->error = 1;
+	lexer->error_start = tokens->starts[bad];
+	lexer->error_end = tokens->starts[bad] + tokens->lens[bad];
+	lexer->error_message =
+		"Integer literal out of range (at most 9223372036854775807)";
+	tokens->count = bad;
+}
+
+void lexer_report(lexer_t *lexer) {
+	if (!lexer->error) return;
+
+	error_print(lexer->filepath, lexer->src, lexer->error_start,
+		lexer->error_end, lexer->error_message);
+	error_exit();
+}
+
+int lexer_eof(lexer_t *lexer) {
+	return lexer->cur >= lexer->src_len;
+}
+
+int lexer_read_token(lexer_t *lexer) {
+	lexer_skip_space(lexer);
+
+	if (lexer_eof(lexer)) return TT_EOF;
+
+	int start = lexer->cur;
+	unsigned char ch = lexer->src[start];
+	int cc = char_class[ch];
+	int end = start + 1;
+	int type = TT_EOF;
+
+	if (cc == CC_PUNCT) {
+		type = punct_token[ch];
+		if (punct_pair[ch].type && end < lexer->src_len &&
+			lexer->src[end] == punct_pair[ch].second) {
+			type = punct_pair[ch].type;
+			end++;
+		}
 	}
-	else if (ch == '-') {
-		return lexer_append_token(TT_MINUS);
+	else if (cc == CC_ALPHA) {
+		end = lexer_span(lexer, end, CC_IDENT);
+		type = TT_IDENTIFIER;
 	}
-	else if (ch == '=') {
-		return lexer_append_token(TT_EQUAL);
+	else if (cc == CC_DIGIT) {
+		end = lexer_span(lexer, end, CC_DIGIT);
+		type = TT_INT_LITERAL;
 	}
-	else if (ch == '(') {
-		return lexer_append_token(TT_LPAREN);
+
+	lexer->prev = start;
+	lexer->cur = end;
+
+	if (type == TT_EOF) {
+		lexer->error = 1;
+		lexer->error_start = start;
+		lexer->error_end = end;
+		lexer->error_message = "Unexpected character";
+		return TT_EOF;
 	}
-	else if (ch == ')') {
-		return lexer_append_token(TT_RPAREN);
+	if (type == TT_IDENTIFIER) {
+		type = lexer_check_keyword(lexer);
 	}
-	else if (isalpha(ch) || ch == '_') {
-		while (!lexer_eof() && (isalnum(lexer_current_char()) || lexer_current_char() == '_')) {
-			lexer_next_char();
+
+	return lexer_append_token(lexer, type);
+}
+
+void lexer_skip_space(lexer_t *lexer) {
+	const unsigned char *src = (const unsigned char *) lexer->src;
+	int i = lexer->cur;
+	int len = lexer->src_len;
+
+#ifdef SIMD_WIDTH
+	while (i + SIMD_WIDTH <= len && char_class[src[i]] == CC_SPACE) {
+		simd_t chunk = simd_load(src + i);
+		simd_t space = simd_or(simd_eq(chunk, simd_set1(' ')),
+			simd_range(chunk, '\t', '\r'));
+
+		uint32_t rest = ~simd_mask(space) & SIMD_FULL;
+		if (rest) {
+			i += __builtin_ctz(rest);
+			break;
 		}
-		int tt = lexer_check_keyword();
-		return lexer_append_token(tt);
+		i += SIMD_WIDTH;
 	}
-	else if (isdigit(ch)) {
-		while (!lexer_eof() && isdigit(lexer_current_char())) {
-			lexer_next_char();
-		}
-		return lexer_append_token(TT_INT_LITERAL);
+#endif
+
+	while (i < len && char_class[src[i]] == CC_SPACE) {
+		i++;
 	}
 
-	lexer_error(lexer.prev, lexer.cur, "Unexpected character");
-	return TT_EOF;
+	lexer->cur = i;
 }
 
-int lexer_append_token(int type) {
-	token_t *token = malloc(sizeof(token_t));
-	token->type = type;
-	token->filepath = lexer.filepath;
-	token->src = lexer.src;
-	token->start = lexer.prev;
-	token->end = lexer.cur;
-	token->next = NULL;
+int lexer_span(lexer_t *lexer, int index, int cc) {
+	const unsigned char *src = (const unsigned char *) lexer->src;
+	int len = lexer->src_len;
+
+#ifdef SIMD_WIDTH
+	while (index + SIMD_WIDTH <= len && (char_class[src[index]] & cc)) {
+		simd_t chunk = simd_load(src + index);
+		simd_t match = simd_range(chunk, '0', '9');
+		if (cc & CC_ALPHA) {
+			match = simd_or(match, simd_range(chunk, 'a', 'z'));
+			match = simd_or(match, simd_range(chunk, 'A', 'Z'));
+			match = simd_or(match, simd_eq(chunk, simd_set1('_')));
+		}
+
+		uint32_t rest = ~simd_mask(match) & SIMD_FULL;
+		if (rest) return index + __builtin_ctz(rest);
+		index += SIMD_WIDTH;
+	}
+#endif
+
+	while (index < len && (char_class[src[index]] & cc)) {
+		index++;
+	}
+	return index;
+}
 
-	if (lexer.head == NULL) {
-		lexer.head = lexer.tail = token;
+int lexer_append_token(lexer_t *lexer, int type) {
+	tokens_t *tokens = lexer->tokens;
+	if (tokens->count == tokens->cap) {
+		tokens->cap *= 2;
+		tokens_grow(tokens);
 	}
-	else {
-		lexer.tail->next = token;
-		lexer.tail = token;
+
+	int index = tokens->count++;
+	tokens->types[index] = type;
+	tokens->starts[index] = lexer->prev;
+	tokens->lens[index] = lexer->cur - lexer->prev;
+	tokens->syms[index] = SYM_NONE;
+
+	// Only hash here; the symbol id is assigned by tokens_intern
+	if (type == TT_IDENTIFIER || type == TT_INT_LITERAL) {
+		tokens->syms[index] = intern_hash(lexer->src + lexer->prev,
+			tokens->lens[index]);
 	}
 
 	return type;
 }
 
-char lexer_current_char() {
-	if (lexer_eof()) return 0;
-	return lexer.src[lexer.cur.index];
+int lexer_keyword_hash(const char *lexical, int len) {
+	unsigned char first = lexical[0];
+	unsigned char last = lexical[len - 1];
+	return (first + (last << 3) + len) & (KEYWORD_TABLE_SIZE - 1);
 }
 
-char lexer_next_char() {
-	if (lexer_eof()) return 0;
+int lexer_check_keyword(lexer_t *lexer) {
+	const char *lexical_start = lexer->src + lexer->prev;
+	int len = lexer->cur - lexer->prev;
 
-	char ch = lexer_current_char();
+	if (len < 2 || len > 8) return TT_IDENTIFIER;
 
-	if (ch == '\n') {
-		lexer.cur.line++;
-		lexer.cur.column = 0;
+	int h = lexer_keyword_hash(lexical_start, len);
+	if (keyword_table[h].len == len &&
+		memcmp(keyword_table[h].name, lexical_start, len) == 0) {
+		return keyword_table[h].type;
 	}
+	return TT_IDENTIFIER;
+}
 
-	lexer.cur.index++;
-	lexer.cur.column++;
+int lexer_split(const char *src, int len, int target) {
+	for (int i = target; i < len; i++) {
+		if (char_class[(unsigned char) src[i]] == CC_SPACE) return i + 1;
+	}
+	return len;
+}
 
-	return ch;
+tokens_t *tokens_create(const char *filepath, const char *src, int cap) {
+	tokens_t *tokens = calloc(1, sizeof(tokens_t));
+	if (tokens == NULL) {
+		perror("Error in tokens_create with calloc");
+		exit(1);
+	}
+	tokens->filepath = filepath;
+	tokens->src = src;
+	tokens->cap = cap;
+	tokens_grow(tokens);
+	return tokens;
 }
 
-int lexer_check_keyword() {
-	const char *lexical_start = lexer.src + lexer.prev.index;
-	int len = lexer.cur.index - lexer.prev.index;
+void tokens_grow(tokens_t *tokens) {
+	int cap = tokens->cap;
+	tokens->types = realloc(tokens->types, cap * sizeof(unsigned char));
+	tokens->starts = realloc(tokens->starts, cap * sizeof(pos_t));
+	tokens->lens = realloc(tokens->lens, cap * sizeof(int));
+	tokens->syms = realloc(tokens->syms, cap * sizeof(int));
 
-	if (strncmp(lexical_start, "var", len) == 0 && len == 3) 
-		return TT_VAR_KEYWORD;
-	if (strncmp(lexical_start, "print", len) == 0 && len == 5) 
-		return TT_PRINT_KEYWORD;
-	if (strncmp(lexical_start, "if", len) == 0 && len == 2) 
-		return TT_IF_KEYWORD;
-	if (strncmp(lexical_start, "else", len) == 0 && len == 4) 
-		return TT_ELSE_KEYWORD;
-	if (strncmp(lexical_start, "while", len) == 0 && len == 5) 
-		return TT_WHILE_KEYWORD;
-	if (strncmp(lexical_start, "break", len) == 0 && len == 5)
-		return TT_BREAK_KEYWORD;
-	if (strncmp(lexical_start, "continue", len) == 0 && len == 8)
-		return TT_CONTINUE_KEYWORD;
-	return TT_IDENTIFIER;
+	if (tokens->types == NULL || tokens->starts == NULL ||
+		tokens->lens == NULL || tokens->syms == NULL) {
+		perror("Error in tokens_grow with realloc");
+		exit(1);
+	}
 }
 
+int tokens_intern(tokens_t *tokens, int from, int to) {
+	for (int i = from; i < to; i++) {
+		if (tokens->types[i] == TT_IDENTIFIER) {
+			tokens->syms[i] = intern_hashed(tokens->src + tokens->starts[i],
+				tokens->lens[i], tokens->syms[i]);
+		}
+		else if (tokens->types[i] == TT_INT_LITERAL) {
+			tokens->syms[i] = tokens_intern_literal(tokens, i);
+			if (tokens->syms[i] == SYM_NONE) return i;
+		}
+	}
+	return to;
+}
+
+int tokens_intern_literal(tokens_t *tokens, int index) {
+	const char *digits = tokens->src + tokens->starts[index];
+	int len = tokens->lens[index];
+	int64_t value = 0;
+
+	// Up to 18 digits always fit in 63 bits; longer literals are checked
+	// before interning so an out of range one never gets a symbol
+	if (len > 18 && !tokens_decode(digits, len, &value)) return SYM_NONE;
+
+	// Every occurrence of a literal shares the symbol, so only the first
+	// one needs decoding
+	int total = intern_count();
+	int sym = intern_hashed(digits, len, tokens->syms[index]);
+	if (sym < total) return sym;
+
+	if (len <= 18) tokens_decode(digits, len, &value);
+	intern_set_value(sym, value);
+	return sym;
+}
+
+int tokens_decode(const char *digits, int len, int64_t *value) {
+	int64_t result = 0;
+	int i = 0;
+
+	for (; i < len && i < 18; i++) {
+		result = result * 10 + (digits[i] - '0');
+	}
+	for (; i < len; i++) {
+		if (__builtin_mul_overflow(result, 10, &result) ||
+			__builtin_add_overflow(result, digits[i] - '0', &result)) {
+			return 0;
+		}
+	}
+
+	*value = result;
+	return 1;
+}
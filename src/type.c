@@ -1,22 +1,56 @@
 #include "type.h"
 
 #include <stdio.h>
+#include <string.h>
 
 // ========================================
 // helper declaration
 // ========================================
 
-static type_t *g_int = &(type_t) {TY_INT, 4};
+// Every integer is aligned to its size; an int takes 8 bytes, a small
+// value or a pointer to a bigint
+static type_t types[] = {
+	{TY_I8, 1, 1, "i8"},
+	{TY_I16, 2, 2, "i16"},
+	{TY_I32, 4, 4, "i32"},
+	{TY_I64, 8, 8, "i64"},
+	{TY_INT, 8, 8, "int"},
+};
+
+#define TOTAL_TYPES ((int) (sizeof(types) / sizeof(types[0])))
 
 // ========================================
 // type.h - definition
 // ========================================
 
 type_t *type_int() {
-	return g_int;
+	return &types[TY_INT];
 }
 
-void print_all_types() {
-	printf("id: %p | name: %s\n", g_int, "int");
+type_t *type_get(int type) {
+	return &types[type];
 }
 
+type_t *type_find(const char *name, int len) {
+	for (int i = 0; i < TOTAL_TYPES; i++) {
+		if ((int) strlen(types[i].name) == len &&
+			strncmp(types[i].name, name, len) == 0) {
+			return &types[i];
+		}
+	}
+	return NULL;
+}
+
+int type_fits(type_t *type, int64_t value) {
+	if (type->size >= 8 || type->type == TY_INT) return 1;
+
+	int64_t max = ((int64_t) 1 << (type->size * 8 - 1)) - 1;
+	int64_t min = -max - 1;
+	return min <= value && value <= max;
+}
+
+void print_all_types() {
+	for (int i = 0; i < TOTAL_TYPES; i++) {
+		printf("id: %p | name: %s\n", &types[i], types[i].name);
+	}
+}
@@ -1,55 +1,149 @@
+#define _GNU_SOURCE
+
 #include "util.h"
 
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// ========================================
+// helper declaration
+// ========================================
+
+#define READ_INITIAL_CAP (1 << 20)
+
+size_t page_round(size_t size);
+file_t map_file(int fd, size_t len);
+file_t map_stream(int fd);
 
 // ========================================
 // util.h - definition
 // ========================================
 
-char *read_file(const char *filepath) {
-	FILE *fd = stdin;
-	if (strcmp(filepath, "-") != 0) fd = fopen(filepath, "r");
-	if (fd == NULL) {
+file_t read_file(const char *filepath) {
+	int fd = STDIN_FILENO;
+	if (strcmp(filepath, "-") != 0) fd = open(filepath, O_RDONLY);
+	if (fd < 0) {
 		char buffer[1024];
 		snprintf(buffer, 1024, "Error opening '%s'", filepath);
 		perror(buffer);
 		exit(1);
 	}
 
-	int cap = 1024, len = 0;
-	char *buffer = (char *) malloc(cap * sizeof(char));
-	if (buffer == NULL) {
-		perror("Error in read_file with malloc");
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		perror("Error in read_file with fstat");
 		exit(1);
 	}
 
-	for (;;) {
-		int n = fread(buffer, 1, cap - len, fd);
-		if (n == 0) {
-			break;
+	file_t file;
+	if (S_ISREG(st.st_mode)) file = map_file(fd, st.st_size);
+	else file = map_stream(fd);
+
+	if (fd != STDIN_FILENO) close(fd);
+	return file;
+}
+
+void free_file(file_t file) {
+	munmap((void *) file.src, file.map_size);
+}
+
+double time_now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// ========================================
+// helper definition
+// ========================================
+
+size_t page_round(size_t size) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	return (size + page - 1) & ~(page - 1);
+}
+
+file_t map_file(int fd, size_t len) {
+	file_t file;
+	file.len = len;
+	file.map_size = page_round(len + 1);
+
+	// Reserve one byte more than the file with zeroed anonymous memory
+	// and map the file over the front of it; the byte after the file is
+	// then always a null terminator, even when the size is a multiple of
+	// the page size
+	char *base = mmap(NULL, file.map_size, PROT_READ,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED) {
+		perror("Error in map_file with mmap - 1");
+		exit(1);
+	}
+
+	if (len > 0) {
+		void *res = mmap(base, len, PROT_READ, MAP_PRIVATE | MAP_FIXED,
+			fd, 0);
+		if (res == MAP_FAILED) {
+			perror("Error in map_file with mmap - 2");
+			exit(1);
 		}
 
-		len += n;
-		if (len == cap) {
-			cap *= 2;
-			buffer = realloc(buffer, cap * sizeof(char));
-			if (buffer == NULL) {
-				perror("Error in read_file with realloc - 1");
+		// Hints only; failure just means the kernel ignores them
+		madvise(base, len, MADV_SEQUENTIAL);
+		madvise(base, len, MADV_WILLNEED);
+#ifdef MADV_HUGEPAGE
+		madvise(base, len, MADV_HUGEPAGE);
+#endif
+	}
+
+	file.src = base;
+	return file;
+}
+
+file_t map_stream(int fd) {
+	size_t cap = READ_INITIAL_CAP, len = 0;
+	char *buffer = mmap(NULL, cap, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (buffer == MAP_FAILED) {
+		perror("Error in map_stream with mmap");
+		exit(1);
+	}
+#ifdef MADV_HUGEPAGE
+	madvise(buffer, cap, MADV_HUGEPAGE);
+#endif
+
+	for (;;) {
+		// Keep one byte free for the null terminator
+		if (len + 1 == cap) {
+			// mremap moves the pages instead of copying them
+			buffer = mremap(buffer, cap, cap * 2, MREMAP_MAYMOVE);
+			if (buffer == MAP_FAILED) {
+				perror("Error in map_stream with mremap");
 				exit(1);
 			}
+			cap *= 2;
+#ifdef MADV_HUGEPAGE
+			madvise(buffer, cap, MADV_HUGEPAGE);
+#endif
 		}
-	}
 
-	buffer = realloc(buffer, len + 1);
-	if (buffer == NULL) {
-		perror("Error in read_file with realloc - 2");
-		exit(1);
+		ssize_t n = read(fd, buffer + len, cap - len - 1);
+		if (n < 0) {
+			perror("Error in map_stream with read");
+			exit(1);
+		}
+		if (n == 0) break;
+		len += n;
 	}
-	buffer[len] = '\0';
 
-	if (strcmp(filepath, "-") != 0) fclose(fd);
-	return buffer;
+	// Anonymous memory is zero filled, so buffer[len] is already '\0'
+	file_t file;
+	file.src = buffer;
+	file.len = len;
+	file.map_size = cap;
+	return file;
 }
-
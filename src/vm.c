@@ -1,133 +1,316 @@
 #include "vm.h"
+#include "bigint.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 // ========================================
 // helper declaration
 // ========================================
 
+// A register (and an int in global memory) holds a tagged value: an even
+// word is a 63 bit integer shifted left by one, an odd word points (with
+// the low bit set) to a bigint. Results are normalized, so a bigint never
+// holds a value that fits in 63 bits; in particular it is never zero
 static unsigned char *global;
 static int64_t *regs;
 static int total_regs;
 
-int64_t register_get(int64_t index);
-void register_set(int64_t index, int64_t value);
+// Constant pool of the program, tagged once before it runs
+static int64_t *consts;
+static int total_consts;
+
+// Bigints of the run. Once the arena grew by collect_at bytes, the bigints
+// still reachable from the registers and the global words holding a tagged
+// value (marked in boxed) are copied to a new arena and the old one freed
+static arena_t vm_arena = {};
+static arena_chunk_t *vm_chunk;
+static size_t vm_grown, vm_collect_at;
+static unsigned char *boxed;
+static int64_t global_size;
+
+#define VM_COLLECT_MIN ((size_t) 64 << 20)
+
+int vm_compare(int compare, int64_t left, int64_t right);
+int vm_compare_values(int compare, int64_t left, int64_t right);
+void global_set(int64_t offset, int64_t size, int64_t value);
+int64_t global_get(int64_t offset, int64_t size);
+void global_unbox(int64_t offset);
+
+int64_t vm_small(int64_t value);
+int64_t vm_int(int64_t value);
+int64_t vm_wrap(int64_t value);
+int64_t vm_normalize(bigint_t *value);
+bigint_t *vm_big(int64_t value);
+int64_t vm_add(int64_t left, int64_t right, int subtract);
+void vm_print(int64_t value);
+void vm_maybe_collect();
+void vm_collect();
+int64_t vm_copy(arena_t *arena, int64_t value);
 
 // ========================================
 // vm.h - definition
 // ========================================
 
-void run_vm(ir_t *ir) {
-	global = NULL;
-	regs = NULL;
-	total_regs = 0;
+void run_vm(ir_prog_t *ir) {
+	// Everything the program uses is allocated before it starts, so the
+	// instructions index the registers and global memory directly
+	arena_free(&vm_arena);
+	vm_chunk = NULL;
+	vm_grown = 0;
+	vm_collect_at = VM_COLLECT_MIN;
 
-	ir_t *ip = ir;
+	free(global);
+	free(boxed);
+	free(regs);
+	free(consts);
+	global_size = ir->global_size;
+	// Whole words, so a slot is read as part of its word
+	global = calloc(global_size / 8 * 8 + 8, 1);
+	boxed = calloc(global_size / 8 + 1, 1);
+	total_regs = ir->total_regs;
+	regs = calloc(total_regs, sizeof(int64_t));
+	total_consts = ir->total_consts;
+	consts = calloc(total_consts + 1, sizeof(int64_t));
+	if (global == NULL || boxed == NULL || regs == NULL || consts == NULL) {
+		perror("Error in run_vm with calloc");
+		exit(1);
+	}
+
+	for (int i = 0; i < total_consts; i++) {
+		consts[i] = vm_int(ir->consts[i]);
+	}
 
-	while (ip) {
+	ir_t *code = ir->code;
+	ir_t *ip = code, *end = code + ir->total_code;
+
+	while (ip < end) {
 		switch (ip->type) {
 		case IR_NOP:
 			break;
-		case IR_GLOBAL_ALLOC: {
-			global = malloc(ip->arg1);
-			break;
-		}
 		case IR_GLOBAL_LOAD_CONST:
-		case IR_GLOBAL_LOAD: {
-			int64_t offset = ip->arg1;
-			int64_t size = ip->arg2;
-			int64_t value = ip->arg3;
-			if (ip->type == IR_GLOBAL_LOAD) {
-				value = register_get(ip->arg3);
-			}
+			global_set(ip->arg1, ip->arg2, consts[ip->arg3]);
+			break;
 
-			for (int64_t i = 0; i < size; i++) {
-				int64_t msb = value >> ((size - 1 - i) * 8);
-				msb &= 0b11111111;
-				global[i+offset] = msb;
-			}
+		// Offsets are aligned to the size, so each of these is a single
+		// native access. The fixed width integers wrap, and 8 bytes hold a
+		// tagged value like an int, boxed if it does not fit in 63 bits
+		case IR_STORE8: {
+			int8_t value = vm_wrap(regs[ip->arg2]);
+			if (boxed[ip->arg1 / 8]) global_unbox(ip->arg1);
+			memcpy(global + ip->arg1, &value, sizeof(value));
 			break;
 		}
-		case IR_LOAD_GLOBAL: {
-			int64_t reg = ip->arg1;
-			int64_t offset = ip->arg2;
-			int64_t size = ip->arg3;
-
-			int64_t value = 0;
-			for (int i = 0; i < size; i++) {
-				value = (value << 8) + global[offset + i];
-			}
+		case IR_STORE16: {
+			int16_t value = vm_wrap(regs[ip->arg2]);
+			if (boxed[ip->arg1 / 8]) global_unbox(ip->arg1);
+			memcpy(global + ip->arg1, &value, sizeof(value));
+			break;
+		}
+		case IR_STORE32: {
+			int32_t value = vm_wrap(regs[ip->arg2]);
+			if (boxed[ip->arg1 / 8]) global_unbox(ip->arg1);
+			memcpy(global + ip->arg1, &value, sizeof(value));
+			break;
+		}
+		case IR_STORE64: {
+			int64_t value = vm_int(vm_wrap(regs[ip->arg2]));
+			memcpy(global + ip->arg1, &value, sizeof(value));
+			boxed[ip->arg1 / 8] = 1;
+			if (value & 1) vm_maybe_collect();
+			break;
+		}
+		case IR_STORE_INT: {
+			int64_t value = regs[ip->arg2];
+			memcpy(global + ip->arg1, &value, sizeof(value));
+			boxed[ip->arg1 / 8] = 1;
+			break;
+		}
+		case IR_LOAD8: {
+			int8_t value;
+			memcpy(&value, global + ip->arg2, sizeof(value));
+			regs[ip->arg1] = vm_small(value);
+			break;
+		}
+		case IR_LOAD16: {
+			int16_t value;
+			memcpy(&value, global + ip->arg2, sizeof(value));
+			regs[ip->arg1] = vm_small(value);
+			break;
+		}
+		case IR_LOAD32: {
+			int32_t value;
+			memcpy(&value, global + ip->arg2, sizeof(value));
+			regs[ip->arg1] = vm_small(value);
+			break;
+		}
+		case IR_LOAD64: {
+			// Only a word marked in boxed holds a tagged value. One last
+			// written by a narrower store holds raw bytes (a reused slot,
+			// or bytecode nobody compiled), loaded as the integer they make
+			int64_t value;
+			memcpy(&value, global + ip->arg2, sizeof(value));
+			if (!boxed[ip->arg2 / 8]) value = vm_int(value);
 
-			register_set(reg, value);
+			// In the register before collecting, so a new bigint is kept
+			regs[ip->arg1] = value;
+			if (value & 1) vm_maybe_collect();
 			break;
 		}
 		case IR_ADD: {
-			int64_t left = register_get(ip->arg2);
-			int64_t right = register_get(ip->arg3);
-			register_set(ip->arg1, left + right);
+			// Two small values add as tagged words; the sum is only boxed
+			// when it overflows
+			int64_t left = regs[ip->arg2];
+			int64_t right = regs[ip->arg3];
+			int64_t res;
+			if (((left | right) & 1) ||
+				__builtin_add_overflow(left, right, &res)) {
+				regs[ip->arg1] = vm_add(left, right, 0);
+				vm_maybe_collect();
+				break;
+			}
+			regs[ip->arg1] = res;
 			break;
 		}
 		case IR_SUB: {
-			int64_t left = register_get(ip->arg2);
-			int64_t right = register_get(ip->arg3);
-			register_set(ip->arg1, left - right);
+			int64_t left = regs[ip->arg2];
+			int64_t right = regs[ip->arg3];
+			int64_t res;
+			if (((left | right) & 1) ||
+				__builtin_sub_overflow(left, right, &res)) {
+				regs[ip->arg1] = vm_add(left, right, 1);
+				vm_maybe_collect();
+				break;
+			}
+			regs[ip->arg1] = res;
 			break;
 		}
-		case IR_PRINT: {
-			int64_t value = register_get(ip->arg1);
-			printf("%lld\n", value);
+		case IR_PRINT:
+			vm_print(regs[ip->arg1]);
+			printf("\n");
 			break;
-		}
-		case IR_JMP: {
-			ir_t *next = (ir_t *) ip->arg1;
-			ip = next;
+		case IR_JMP:
+			ip = code + ip->arg1;
 			continue;
+		case IR_JMP_TRUE:
+			if (regs[ip->arg1]) {
+				ip = code + ip->arg2;
+				continue;
+			}
+			break;
+		case IR_JMP_FALSE:
+			if (!regs[ip->arg1]) {
+				ip = code + ip->arg2;
+				continue;
+			}
+			break;
+		case IR_LOAD_CONST:
+			regs[ip->arg1] = consts[ip->arg2];
+			break;
+		case IR_LT: case IR_LE: case IR_GT:
+		case IR_GE: case IR_EQ: case IR_NE: {
+			int64_t left = regs[ip->arg2];
+			int64_t right = regs[ip->arg3];
+			int res = vm_compare_values(ip->type - IR_LT, left, right);
+			regs[ip->arg1] = vm_small(res);
+			break;
 		}
-		case IR_JMP_TRUE: {
-			int64_t cond = register_get(ip->arg1);
-			ir_t *next = (ir_t *) ip->arg2;
-			if (cond) {
-				ip = next;
+		case IR_NOT:
+			// Zero is the only false value, and it is never a bigint
+			regs[ip->arg1] = vm_small(!regs[ip->arg2]);
+			break;
+		case IR_JLT: case IR_JLE: case IR_JGT:
+		case IR_JGE: case IR_JEQ: case IR_JNE: {
+			int64_t left = regs[ip->arg1];
+			int64_t right = regs[ip->arg2];
+			int compare = ip->type - IR_JLT;
+			int taken = (left | right) & 1
+				? vm_compare_values(compare, left, right)
+				: vm_compare(compare, left, right);
+			if (taken) {
+				ip = code + ip->arg3;
 				continue;
 			}
 			break;
 		}
-		case IR_JMP_FALSE: {
-			int64_t cond = register_get(ip->arg1);
-			ir_t *next = (ir_t *) ip->arg2;
-			if (!cond) {
-				ip = next;
+		case IR_JLTI: case IR_JLEI: case IR_JGTI:
+		case IR_JGEI: case IR_JEQI: case IR_JNEI: {
+			int64_t left = regs[ip->arg1];
+			int64_t right = consts[ip->arg2];
+			int compare = ip->type - IR_JLTI;
+			int taken = (left | right) & 1
+				? vm_compare_values(compare, left, right)
+				: vm_compare(compare, left, right);
+			if (taken) {
+				ip = code + ip->arg3;
 				continue;
 			}
 			break;
 		}
+		case IR_MOV:
+			regs[ip->arg1] = regs[ip->arg2];
+			break;
+
+		// A variable kept in a register wraps like its slot would
+		case IR_WRAP8:
+			regs[ip->arg1] = vm_small((int8_t) vm_wrap(regs[ip->arg2]));
+			break;
+		case IR_WRAP16:
+			regs[ip->arg1] = vm_small((int16_t) vm_wrap(regs[ip->arg2]));
+			break;
+		case IR_WRAP32:
+			regs[ip->arg1] = vm_small((int32_t) vm_wrap(regs[ip->arg2]));
+			break;
+		case IR_WRAP64: {
+			int64_t value = vm_int(vm_wrap(regs[ip->arg2]));
+			regs[ip->arg1] = value;
+			if (value & 1) vm_maybe_collect();
+			break;
+		}
 		}
 
-		ip = ip->next;
+		ip++;
 	}
 }
 
-void print_vm_state(ir_t *ir) {
+void print_vm_state(ir_prog_t *ir) {
 	printf("========== GLOBAL STATE ==========\n");
 
-	ir_t *ip = ir;
+	for (int i = 0; i < ir->total_code; i++) {
+		ir_t *ip = &ir->code[i];
+		if (ip->type != IR_GLOBAL_LOAD_CONST) continue;
 
-	while (ip) {
-		switch (ip->type) {
-		case IR_GLOBAL_LOAD_CONST: {
-			int64_t offset = ip->arg1;
-			int64_t size = ip->arg2;
-			int64_t value = 0;
-			for (int i = 0; i < size; i++) {
-				value = (value << 8) + global[offset + i];
-			}
-			printf("%lld %lld: %lld\n", offset, size, value);
-			break;
-		}
+		// The slot of a variable of an ended block can be reused by one of
+		// another width. A word last written raw is printed as the bytes it
+		// holds, and the bytes of one holding a tagged value are those of
+		// the integer it stands for (never the bits of a bigint pointer),
+		// like global_unbox leaves them
+		int64_t offset = ip->arg1;
+		int64_t size = ip->arg2;
+		printf("%lld %lld: ", (long long) offset, (long long) size);
+
+		int64_t word;
+		memcpy(&word, global + offset / 8 * 8, 8);
+		if (size == 8 && boxed[offset / 8]) {
+			vm_print(word);
+			printf("\n");
+			continue;
 		}
 
-		ip = ip->next;
+		// Sign extended like IR_LOAD8..64
+		if (boxed[offset / 8]) word = vm_wrap(word);
+		unsigned char *bytes = (unsigned char *) &word + offset % 8;
+		int8_t value8;
+		int16_t value16;
+		int32_t value32;
+		int64_t value = word;
+		switch (size) {
+		case 1: memcpy(&value8, bytes, 1); value = value8; break;
+		case 2: memcpy(&value16, bytes, 2); value = value16; break;
+		case 4: memcpy(&value32, bytes, 4); value = value32; break;
+		}
+		printf("%lld\n", (long long) value);
 	}
 }
 
@@ -135,19 +318,194 @@ void print_vm_state(ir_t *ir) {
 // helper definition
 // ========================================
 
-int64_t register_get(int64_t index) {
-	if (index >= total_regs) {
-		total_regs = index + 1;
-		regs = realloc(regs, total_regs * sizeof(int64_t));
+int vm_compare_values(int compare, int64_t left, int64_t right) {
+	// Tagged small values compare like the integers they hold. A bigint
+	// never holds a value that fits in 63 bits, so against a small value
+	// only its sign counts, and nothing is allocated unless both are big
+	if (left & right & 1) {
+		left = bigint_cmp(vm_big(left), vm_big(right));
+		right = 0;
+	} else if (left & 1) {
+		left = vm_big(left)->sign;
+		right = 0;
+	} else if (right & 1) {
+		left = 0;
+		right = vm_big(right)->sign;
+	}
+	return vm_compare(compare, left, right);
+}
+
+int vm_compare(int compare, int64_t left, int64_t right) {
+	// compare is the offset of the comparison in its group of instructions
+	switch (compare) {
+	case 0: return left < right;
+	case 1: return left <= right;
+	case 2: return left > right;
+	case 3: return left >= right;
+	case 4: return left == right;
+	case 5: return left != right;
+	}
+	return 0;
+}
+
+void global_set(int64_t offset, int64_t size, int64_t value) {
+	// The low size bytes of a tagged value, in native order like
+	// IR_STORE8..64; 8 bytes keep the value tagged
+	if (size < 8) value = vm_wrap(value);
+	if (size < 8 && boxed[offset / 8]) global_unbox(offset);
+	boxed[offset / 8] = size == 8;
+
+	switch (size) {
+	case 1: {
+		int8_t narrow = value;
+		memcpy(global + offset, &narrow, 1);
+		break;
+	}
+	case 2: {
+		int16_t narrow = value;
+		memcpy(global + offset, &narrow, 2);
+		break;
+	}
+	case 4: {
+		int32_t narrow = value;
+		memcpy(global + offset, &narrow, 4);
+		break;
 	}
-	return regs[index];
+	default:
+		memcpy(global + offset, &value, 8);
+	}
+}
+
+void global_unbox(int64_t offset) {
+	// A narrower store into a word holding a tagged value (the slot of a
+	// variable of an ended block) leaves the bytes of the integer around
+	// it, never those of a bigint pointer
+	int64_t word;
+	memcpy(&word, global + offset / 8 * 8, 8);
+	word = vm_wrap(word);
+	memcpy(global + offset / 8 * 8, &word, 8);
+	boxed[offset / 8] = 0;
 }
 
-void register_set(int64_t index, int64_t value) {
-	if (index >= total_regs) {
-		total_regs = index + 1;
-		regs = realloc(regs, total_regs * sizeof(int64_t));
+int64_t global_get(int64_t offset, int64_t size) {
+	// Tagged value at an offset, like IR_LOAD8..64
+	switch (size) {
+	case 1: {
+		int8_t value;
+		memcpy(&value, global + offset, 1);
+		return vm_small(value);
+	}
+	case 2: {
+		int16_t value;
+		memcpy(&value, global + offset, 2);
+		return vm_small(value);
 	}
-	regs[index] = value;
+	case 4: {
+		int32_t value;
+		memcpy(&value, global + offset, 4);
+		return vm_small(value);
+	}
+	}
+
+	int64_t value;
+	memcpy(&value, global + offset, 8);
+	return value;
+}
+
+int64_t vm_small(int64_t value) {
+	// Tag a value known to fit in 63 bits
+	return (int64_t) ((uint64_t) value << 1);
+}
+
+int64_t vm_int(int64_t value) {
+	// Tag any integer, boxing it if it does not fit in 63 bits
+	if ((vm_small(value) >> 1) == value) return vm_small(value);
+	return (int64_t) bigint_from_int(&vm_arena, value) | 1;
+}
+
+int64_t vm_wrap(int64_t value) {
+	// Low 64 bits of a tagged value
+	if (value & 1) return bigint_wrap((bigint_t *) (value & ~(int64_t) 1));
+	return value >> 1;
 }
 
+int64_t vm_normalize(bigint_t *value) {
+	int64_t small = 0;
+	if (bigint_to_int(value, &small)) return vm_int(small);
+	return (int64_t) value | 1;
+}
+
+bigint_t *vm_big(int64_t value) {
+	if (value & 1) return (bigint_t *) (value & ~(int64_t) 1);
+	return bigint_from_int(&vm_arena, value >> 1);
+}
+
+int64_t vm_add(int64_t left, int64_t right, int subtract) {
+	// Slow path of IR_ADD and IR_SUB, for a bigint or an overflow
+	bigint_t *a = vm_big(left), *b = vm_big(right);
+	if (subtract) return vm_normalize(bigint_sub(&vm_arena, a, b));
+	return vm_normalize(bigint_add(&vm_arena, a, b));
+}
+
+void vm_print(int64_t value) {
+	if (!(value & 1)) {
+		printf("%lld", (long long) (value >> 1));
+		return;
+	}
+
+	char *str = bigint_str(vm_big(value));
+	printf("%s", str);
+	free(str);
+}
+
+void vm_maybe_collect() {
+	// The arena only grows by whole chunks
+	if (vm_arena.head == vm_chunk) return;
+	vm_chunk = vm_arena.head;
+	vm_grown += vm_chunk->size;
+
+	if (vm_grown > vm_collect_at) vm_collect();
+}
+
+void vm_collect() {
+	arena_t fresh = {};
+
+	for (int i = 0; i < total_regs; i++) {
+		regs[i] = vm_copy(&fresh, regs[i]);
+	}
+	for (int i = 0; i < total_consts; i++) {
+		consts[i] = vm_copy(&fresh, consts[i]);
+	}
+	for (int64_t i = 0; i < global_size / 8; i++) {
+		if (!boxed[i]) continue;
+
+		int64_t value;
+		memcpy(&value, global + i * 8, sizeof(value));
+		value = vm_copy(&fresh, value);
+		memcpy(global + i * 8, &value, sizeof(value));
+	}
+
+	arena_free(&vm_arena);
+	vm_arena = fresh;
+
+	// Collect again once the arena grew to twice what survived
+	size_t live = 0;
+	for (arena_chunk_t *cur = vm_arena.head; cur; cur = cur->next) {
+		live += cur->size;
+	}
+	vm_chunk = vm_arena.head;
+	vm_grown = 0;
+	vm_collect_at = live > VM_COLLECT_MIN ? live : VM_COLLECT_MIN;
+}
+
+int64_t vm_copy(arena_t *arena, int64_t value) {
+	// Bigints hold no pointers, so a copy of the limbs is a full copy; a
+	// bigint reachable twice is copied twice
+	if (!(value & 1)) return value;
+
+	bigint_t *big = vm_big(value);
+	size_t size = sizeof(bigint_t) + big->len * sizeof(uint32_t);
+	bigint_t *copy = arena_alloc(arena, size);
+	memcpy(copy, big, size);
+	return (int64_t) copy | 1;
+}
@@ -0,0 +1,103 @@
+#!/bin/sh
+# Run every program of tests/run at every optimization level, alone and
+# with --stream, and compare what it prints with the .out file next to it.
+# A .state file holds the global state --only-vm-state prints at the end,
+# and the .lbc files of tests/bytecode run like the programs. The programs
+# also run from the bytecode --emit-bytecode and --cache-dir write, and
+# damaged copies of it must be rejected. Every line of a tests/lsp .jsonl
+# file is sent to --lsp as a message, and the replies are compared with the
+# .out file
+#
+# USAGE: ./tests/run.sh
+
+LEMON=${LEMON:-./build/lemon}
+DIR=$(dirname "$0")
+TMP=${TMPDIR:-/tmp}/lemon_test_$$
+FAILED=0
+
+fail() {
+	echo "FAILED: $*"
+	FAILED=1
+}
+
+mkdir -p "$TMP"
+
+for INPUT in "$DIR"/run/*.lemon; do
+	for FLAGS in -O0 -O1 -O2 "-O2 --stream"; do
+		$LEMON $FLAGS "$INPUT" > "$TMP/out" 2>&1
+		cmp -s "$TMP/out" "$INPUT.out" || fail "$FLAGS $INPUT"
+
+		[ -f "$INPUT.state" ] || continue
+		$LEMON $FLAGS --only-vm-state "$INPUT" 2> /dev/null |
+			sed -n '/GLOBAL STATE/,$p' > "$TMP/state"
+		cmp -s "$TMP/state" "$INPUT.state" || fail "$FLAGS --only-vm-state $INPUT"
+	done
+done
+
+# Bytecode written by hand, which the vm must not trust
+for INPUT in "$DIR"/bytecode/*.lbc; do
+	$LEMON "$INPUT" > "$TMP/out" 2>&1
+	cmp -s "$TMP/out" "$INPUT.out" || fail "$INPUT"
+done
+
+# The same programs written out as bytecode and run from the file
+for INPUT in "$DIR"/run/*.lemon; do
+	for FLAGS in -O0 -O2; do
+		$LEMON $FLAGS --emit-bytecode "$TMP/prog.lbc" "$INPUT" > "$TMP/out" 2>&1 ||
+			fail "$FLAGS --emit-bytecode $INPUT"
+		$LEMON "$TMP/prog.lbc" > "$TMP/out" 2>&1
+		cmp -s "$TMP/out" "$INPUT.out" || fail "$FLAGS --emit-bytecode $INPUT (run)"
+	done
+done
+
+# Copy the bytecode of the last program, damage it with the given bytes at
+# an offset (or cut it to a length), and expect it to be refused
+reject() {
+	REASON=$1
+	cp "$TMP/prog.lbc" "$TMP/bad.lbc"
+	if [ "$2" = cut ]; then
+		head -c "$3" "$TMP/prog.lbc" > "$TMP/bad.lbc"
+	else
+		printf "$3" | dd of="$TMP/bad.lbc" bs=1 seek="$2" conv=notrunc 2> /dev/null
+	fi
+
+	$LEMON "$TMP/bad.lbc" > "$TMP/out" 2>&1
+	STATUS=$?
+	echo "ERROR: '$TMP/bad.lbc' is not valid bytecode: $REASON" > "$TMP/expected"
+	[ $STATUS -eq 1 ] && cmp -s "$TMP/out" "$TMP/expected" || fail "reject: $REASON"
+}
+
+SIZE=$(wc -c < "$TMP/prog.lbc")
+reject "File is too short" cut 20
+reject "Unsupported bytecode version" 4 '\002'
+reject "Damaged header" 24 '\000\000\000\000'
+reject "File size does not match the header" cut $((SIZE - 1))
+reject "Instruction argument out of range" $((SIZE - 12)) '\377\377\377\177'
+reject "Unknown instruction" $((SIZE - 16)) '\377\000\000\000'
+
+# A cache entry is written on the first run and used on the next; a
+# damaged one is compiled again
+INPUT=$(ls "$DIR"/run/*.lemon | head -n 1)
+for HIT in miss hit damaged; do
+	if [ $HIT = damaged ]; then
+		for ENTRY in "$TMP"/cache/*.lbc; do printf 'x' >> "$ENTRY"; done
+	fi
+	$LEMON -O2 --stats --cache-dir "$TMP/cache" "$INPUT" > "$TMP/out" 2> "$TMP/stats"
+	cmp -s "$TMP/out" "$INPUT.out" || fail "--cache-dir $INPUT ($HIT)"
+
+	EXPECTED=$HIT
+	[ $HIT = damaged ] && EXPECTED=miss
+	grep -q "cache: $EXPECTED " "$TMP/stats" || fail "--cache-dir $INPUT is not a $EXPECTED"
+done
+
+# Language server sessions, one message per line
+for INPUT in "$DIR"/lsp/*.jsonl; do
+	while IFS= read -r MESSAGE; do
+		printf 'Content-Length: %d\r\n\r\n%s' ${#MESSAGE} "$MESSAGE"
+	done < "$INPUT" | $LEMON --lsp > "$TMP/out" 2>&1
+	cmp -s "$TMP/out" "${INPUT%.jsonl}.out" || fail "--lsp $INPUT"
+done
+
+rm -rf "$TMP"
+[ $FAILED -eq 0 ] && echo "ALL PASSED"
+exit $FAILED